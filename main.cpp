@@ -7,9 +7,66 @@
 #include <ctime>
 #include <sstream>
 #include <limits>
+#include <memory>
+#include <optional>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <deque>
+#include <unordered_map>
+#include <functional>
+#include <fstream>
+#include <mutex>
+#include <condition_variable>
+#include <shared_mutex>
+#include <future>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <cerrno>
+#include <climits>
+#include <cstdarg>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#define fsync _commit
+#define ftruncate _chsize
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <csignal>
+#endif
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
 
 using namespace std;
 
+// Money is kept in whole paise (1/100 rupee), so sums are exact
+typedef long long Paise;
+
+// 123450 -> "1234.50"
+string formatRupees(Paise amount) {
+    char text[32];
+    snprintf(text, sizeof(text), "%s%lld.%02lld", amount < 0 ? "-" : "",
+             llabs(amount) / 100, llabs(amount) % 100);
+    return text;
+}
+
 // Enum for seat types
 enum class SeatType {
     REGULAR,
@@ -24,16 +81,86 @@ enum class SeatStatus {
     BOOKED
 };
 
+// Seat ids: a row label then the 1-based column, e.g. "B12". Rows run A-Z,
+// then AA, AB, ... ZZ like spreadsheet columns, so large halls keep short
+// ids. Parsing and formatting work on character buffers and never throw or
+// allocate; bad ids from clients are rejected in a few compares.
+class SeatCode {
+public:
+    static constexpr int MAX_ROWS = 26 + 26 * 26; // "ZZ"
+    static constexpr int MAX_COLS = 9999;
+    static constexpr int MAX_LENGTH = 6; // "ZZ9999"
+    
+    // Writes the row label ("A", "AB") to out and returns its length
+    static int formatRow(int row, char* out) {
+        if(row < 26) {
+            out[0] = char('A' + row);
+            return 1;
+        }
+        row -= 26;
+        out[0] = char('A' + row / 26);
+        out[1] = char('A' + row % 26);
+        return 2;
+    }
+    
+    // Writes the seat id to out (room for MAX_LENGTH chars) and returns its length
+    static int format(int row, int col, char* out) {
+        int length = formatRow(row, out);
+        char digits[4];
+        int count = 0;
+        for(int number = col + 1; number > 0 && count < 4; number /= 10) digits[count++] = char('0' + number % 10);
+        while(count > 0) out[length++] = digits[--count];
+        return length;
+    }
+    
+    static string toString(int row, int col) {
+        char text[MAX_LENGTH];
+        return string(text, format(row, col, text));
+    }
+    
+    // Parses one id, letters in either case; false if it is not a seat id.
+    // Says nothing about whether the hall has that seat.
+    static bool parse(const char* text, size_t length, int& row, int& col) {
+        if(length < 2 || length > (size_t)MAX_LENGTH) return false;
+        size_t letters = 0;
+        while(letters < 2 && letters < length && isLetter(text[letters])) letters++;
+        if(letters == 0 || length - letters > 4) return false;
+        int number = 0;
+        for(size_t i = letters; i < length; i++) {
+            unsigned digit = unsigned(text[i] - '0');
+            if(digit > 9) return false;
+            number = number * 10 + int(digit);
+        }
+        if(number == 0) return false;
+        col = number - 1;
+        return parseRow(text, letters, row);
+    }
+    
+    // Parses a row label alone ("B", "ab")
+    static bool parseRow(const char* text, size_t length, int& row) {
+        if(length < 1 || length > 2 || !isLetter(text[0]) || !isLetter(text[length - 1])) return false;
+        int first = (text[0] & ~0x20) - 'A', last = (text[length - 1] & ~0x20) - 'A';
+        row = length == 1 ? first : 26 + first * 26 + last;
+        return true;
+    }
+    
+private:
+    static bool isLetter(char c) {
+        c = char(c & ~0x20); // upper case; digits stop being letters
+        return c >= 'A' && c <= 'Z';
+    }
+};
+
 // Seat class
 class Seat {
 private:
     int row, col;
     SeatType type;
     SeatStatus status;
-    double price;
+    Paise price;
     
 public:
-    Seat(int r, int c, SeatType t, double p) 
+    Seat(int r, int c, SeatType t, Paise p) 
         : row(r), col(c), type(t), status(SeatStatus::AVAILABLE), price(p) {}
     
     // Getters
@@ -41,14 +168,15 @@ public:
     int getCol() const { return col; }
     SeatType getType() const { return type; }
     SeatStatus getStatus() const { return status; }
-    double getPrice() const { return price; }
+    Paise getPrice() const { return price; }
     string getSeatId() const { 
-        return string(1, 'A' + row) + to_string(col + 1); 
+        return SeatCode::toString(row, col); 
     }
+    int formatSeatId(char* out) const { return SeatCode::format(row, col, out); }
     
     // Setters
     void setStatus(SeatStatus s) { status = s; }
-    void setPrice(double p) { price = p; }
+    void setPrice(Paise p) { price = p; }
     
     // Utility methods
     bool isAvailable() const { return status == SeatStatus::AVAILABLE; }
@@ -66,579 +194,8579 @@ public:
             case SeatStatus::AVAILABLE: return 'O';
             case SeatStatus::RESERVED: return 'R';
             case SeatStatus::BOOKED: return 'X';
-            default: return '?';
+            default: return ' '; // a gap in the hall
         }
     }
 };
 
-// Movie class
-class Movie {
+// What stands at a place in the hall
+enum class SeatKind {
+    STANDARD,
+    RECLINER,
+    WHEELCHAIR,
+    GAP // no seat: an aisle, stairs, or past the end of a short row
+};
+
+// Seat layout shared read-only by every show in a hall. By default every
+// row is full width: VIP seats (first 2 rows), Premium (next 3 rows),
+// Regular (remaining rows). A layout file can set tiers, gaps and seat
+// kinds per row range.
+class SeatLayout {
 private:
-    string title;
-    string genre;
-    int duration; // in minutes
-    string rating;
+    int rows, cols;
+    vector<SeatType> rowTypes;
+    vector<SeatKind> kinds; // per place, row by row
+    int maskWords;
+    vector<uint64_t> pickable; // per row, a bit per seat best-seat search may hand out
+    int seatCount;
+    int tierSeats[3];
     
-public:
-    Movie(string t, string g, int d, string r) 
-        : title(t), genre(g), duration(d), rating(r) {}
+    // Counts seats and rebuilds the pickable masks after kinds change
+    void recount() {
+        seatCount = 0;
+        fill(tierSeats, tierSeats + 3, 0);
+        pickable.assign(size_t(rows) * maskWords, 0);
+        for(int i = 0; i < rows; i++) {
+            for(int j = 0; j < cols; j++) {
+                SeatKind kind = getSeatKind(i, j);
+                if(kind == SeatKind::GAP) continue;
+                seatCount++;
+                tierSeats[int(rowTypes[i])]++;
+                // Wheelchair spaces are booked by id, never handed out as best seats
+                if(kind != SeatKind::WHEELCHAIR) pickable[i * maskWords + j / 64] |= uint64_t(1) << (j % 64);
+            }
+        }
+    }
     
-    // Getters
-    string getTitle() const { return title; }
-    string getGenre() const { return genre; }
-    int getDuration() const { return duration; }
-    string getRating() const { return rating; }
+    // "C-E", "AA", or "*" for every row
+    static bool parseRows(const string& token, int rows, int& first, int& last) {
+        if(token == "*") {
+            first = 0;
+            last = rows - 1;
+            return true;
+        }
+        size_t dash = token.find('-');
+        size_t toStart = dash == string::npos ? 0 : dash + 1;
+        return SeatCode::parseRow(token.data(), min(dash, token.size()), first) &&
+               SeatCode::parseRow(token.data() + toStart, token.size() - toStart, last) &&
+               first <= last && last < rows;
+    }
     
-    void displayInfo() const {
-        cout << "Title: " << title << endl;
-        cout << "Genre: " << genre << endl;
-        cout << "Duration: " << duration << " minutes" << endl;
-        cout << "Rating: " << rating << endl;
+    // "1-4,57-60" -> those columns set in selected; empty selects them all
+    static bool parseCols(const string& token, int cols, vector<bool>& selected) {
+        selected.assign(cols, token.empty());
+        stringstream ranges(token);
+        string range;
+        while(getline(ranges, range, ',')) {
+            int first = 0, last = 0;
+            char dash = 0;
+            stringstream parts(range);
+            if(!(parts >> first)) return false;
+            last = first;
+            if(parts >> dash && (dash != '-' || !(parts >> last))) return false;
+            if(first < 1 || last < first || last > cols) return false;
+            for(int j = first - 1; j < last; j++) selected[j] = true;
+        }
+        return true;
     }
-};
-
-// Show class
-class Show {
-private:
-    Movie movie;
-    string showTime;
-    string showDate;
-    int showId;
     
 public:
-    Show(Movie m, string time, string date, int id) 
-        : movie(m), showTime(time), showDate(date), showId(id) {}
+    SeatLayout(int r, int c)
+        : rows(r), cols(c), kinds(size_t(r) * c, SeatKind::STANDARD), maskWords((c + 63) / 64) {
+        for(int i = 0; i < rows; i++) {
+            // VIP seats (first 2 rows), Premium (next 3 rows), Regular (remaining rows)
+            if(i < 2) rowTypes.push_back(SeatType::VIP);
+            else if(i < 5) rowTypes.push_back(SeatType::PREMIUM);
+            else rowTypes.push_back(SeatType::REGULAR);
+        }
+        recount();
+    }
+    
+    // Reads a layout file: one directive per line, later lines win, and
+    // '#' starts a comment.
+    //   hall <rows> <cols>                          first; the full grid
+    //   tier <rows> <vip|premium|regular>
+    //   width <rows> <seats>                        shorter rows, centred
+    //   gap <rows> [cols]                           no seats there
+    //   kind <rows> <standard|recliner|wheelchair> [cols]
+    // Rows are a label, a range like C-E or AA-AD, or * for all; cols are
+    // 1-based numbers and ranges like 1-4,57-60, every column if left out.
+    // Returns null with a message in error on the first bad line.
+    static shared_ptr<SeatLayout> parse(istream& in, string& error) {
+        shared_ptr<SeatLayout> layout;
+        string line;
+        for(int lineNumber = 1; getline(in, line); lineNumber++) {
+            line = line.substr(0, line.find('#'));
+            stringstream words(line);
+            string directive, rowToken, value, colToken;
+            if(!(words >> directive)) continue;
+            
+            auto bad = [&](const string& what) {
+                error = "line " + to_string(lineNumber) + ": " + what;
+                return nullptr;
+            };
+            if(directive == "hall") {
+                int r = 0, c = 0;
+                if(layout) return bad("hall given twice");
+                if(!(words >> r >> c) || r < 1 || r > SeatCode::MAX_ROWS || c < 1 || c > SeatCode::MAX_COLS) {
+                    return bad("hall needs rows (1-" + to_string(SeatCode::MAX_ROWS) + ") and columns (1-" +
+                               to_string(SeatCode::MAX_COLS) + ")");
+                }
+                layout = make_shared<SeatLayout>(r, c);
+                continue;
+            }
+            if(!layout) return bad("the first directive must be hall");
+            
+            int first = 0, last = 0;
+            words >> rowToken;
+            if(!parseRows(rowToken, layout->rows, first, last)) return bad("bad rows '" + rowToken + "'");
+            vector<bool> selected;
+            if(directive == "tier") {
+                words >> value;
+                SeatType tier;
+                if(value == "vip") tier = SeatType::VIP;
+                else if(value == "premium") tier = SeatType::PREMIUM;
+                else if(value == "regular") tier = SeatType::REGULAR;
+                else return bad("unknown tier '" + value + "'");
+                for(int i = first; i <= last; i++) layout->rowTypes[i] = tier;
+            } else if(directive == "width") {
+                int seats = 0;
+                if(!(words >> seats) || seats < 1 || seats > layout->cols) return bad("bad width");
+                int start = (layout->cols - seats) / 2;
+                for(int i = first; i <= last; i++) {
+                    for(int j = 0; j < layout->cols; j++) {
+                        if(j < start || j >= start + seats) layout->kinds[size_t(i) * layout->cols + j] = SeatKind::GAP;
+                    }
+                }
+            } else if(directive == "gap" || directive == "kind") {
+                SeatKind kind = SeatKind::GAP;
+                if(directive == "kind") {
+                    words >> value;
+                    if(value == "standard") kind = SeatKind::STANDARD;
+                    else if(value == "recliner") kind = SeatKind::RECLINER;
+                    else if(value == "wheelchair") kind = SeatKind::WHEELCHAIR;
+                    else return bad("unknown seat kind '" + value + "'");
+                }
+                words >> colToken;
+                if(!parseCols(colToken, layout->cols, selected)) return bad("bad columns '" + colToken + "'");
+                for(int i = first; i <= last; i++) {
+                    for(int j = 0; j < layout->cols; j++) {
+                        if(selected[j]) layout->kinds[size_t(i) * layout->cols + j] = kind;
+                    }
+                }
+            } else {
+                return bad("unknown directive '" + directive + "'");
+            }
+            string extra;
+            if(words >> extra) return bad("unexpected '" + extra + "'");
+        }
+        if(!layout) {
+            error = "no hall line";
+            return nullptr;
+        }
+        layout->recount();
+        return layout;
+    }
+    
+    static shared_ptr<SeatLayout> load(const string& path, string& error) {
+        ifstream in(path);
+        if(!in) {
+            error = "cannot open " + path;
+            return nullptr;
+        }
+        return parse(in, error);
+    }
     
     // Getters
-    Movie getMovie() const { return movie; }
-    string getShowTime() const { return showTime; }
-    string getShowDate() const { return showDate; }
-    int getShowId() const { return showId; }
+    int getRows() const { return rows; }
+    int getCols() const { return cols; }
+    int getTotalSeats() const { return seatCount; }
+    SeatType getRowType(int row) const { return rowTypes[row]; }
+    SeatKind getSeatKind(int row, int col) const { return kinds[size_t(row) * cols + col]; }
     
-    void displayShowInfo() const {
-        cout << "Show ID: " << showId << endl;
-        cout << "Date: " << showDate << " | Time: " << showTime << endl;
-        movie.displayInfo();
+    // 64-bit words per row of getPickableMask
+    int getMaskWords() const { return maskWords; }
+    const uint64_t* getPickableMask(int row) const { return &pickable[size_t(row) * maskWords]; }
+    
+    bool rowHasKind(int row, SeatKind kind) const {
+        const SeatKind* begin = &kinds[size_t(row) * cols];
+        return find(begin, begin + cols, kind) != begin + cols;
+    }
+    
+    bool hasKind(SeatKind kind) const {
+        return find(kinds.begin(), kinds.end(), kind) != kinds.end();
+    }
+    
+    int getTierSeatCount(SeatType type) const { return tierSeats[int(type)]; }
+    
+    static const char* getTierName(SeatType type) {
+        switch(type) {
+            case SeatType::VIP: return "VIP";
+            case SeatType::PREMIUM: return "Premium";
+            default: return "Regular";
+        }
+    }
+    
+    // Price before any demand pricing
+    static Paise getTierPrice(SeatType type) {
+        switch(type) {
+            case SeatType::VIP: return 30000;
+            case SeatType::PREMIUM: return 20000;
+            default: return 15000;
+        }
+    }
+    
+    bool isValid(int row, int col) const {
+        return row >= 0 && row < rows && col >= 0 && col < cols && getSeatKind(row, col) != SeatKind::GAP;
+    }
+    
+    Seat makeSeat(int row, int col, SeatStatus status) const {
+        SeatType type = rowTypes[row];
+        Seat seat(row, col, type, getTierPrice(type));
+        seat.setStatus(status);
+        return seat;
     }
 };
 
-// Customer class
-class Customer {
+// Seats of one booking or hold, stored inline up to a fixed capacity so
+// a booking never needs heap memory for its seat list. Each seat packs
+// into one word, and prices are kept per tier: every seat of a tier in one
+// booking is priced by the same pass. Seats are handed back by value.
+class SeatList {
+public:
+    static constexpr int CAPACITY = 10;
+    
 private:
-    string name;
-    string phone;
-    string email;
-    int customerId;
+    // Bits of a packed seat: row, column, tier, status
+    static const int ROW_BITS = 10, COL_BITS = 14, TYPE_BITS = 2;
+    static_assert(SeatCode::MAX_ROWS < (1 << ROW_BITS) && SeatCode::MAX_COLS < (1 << COL_BITS),
+                  "every seat code must fit a packed seat");
+    
+    uint32_t seats[CAPACITY];
+    int32_t tierPrices[3]; // paise, by SeatType; a seat costs well under 2^31 paise
+    uint8_t count;
+    
+    static uint32_t pack(const Seat& seat) {
+        return uint32_t(seat.getRow()) | uint32_t(seat.getCol()) << ROW_BITS |
+               uint32_t(seat.getType()) << (ROW_BITS + COL_BITS) |
+               uint32_t(seat.getStatus()) << (ROW_BITS + COL_BITS + TYPE_BITS);
+    }
+    
+    static int rowOf(uint32_t packed) { return packed & ((1u << ROW_BITS) - 1); }
+    static int colOf(uint32_t packed) { return (packed >> ROW_BITS) & ((1u << COL_BITS) - 1); }
+    static SeatType typeOf(uint32_t packed) { return SeatType((packed >> (ROW_BITS + COL_BITS)) & 3); }
+    static SeatStatus statusOf(uint32_t packed) { return SeatStatus(packed >> (ROW_BITS + COL_BITS + TYPE_BITS)); }
     
 public:
-    Customer(string n, string p, string e, int id) 
-        : name(n), phone(p), email(e), customerId(id) {}
+    class Iterator {
+    private:
+        const SeatList* list;
+        int index;
+        
+    public:
+        Iterator(const SeatList* l, int i) : list(l), index(i) {}
+        Seat operator*() const { return (*list)[index]; }
+        Iterator& operator++() { index++; return *this; }
+        bool operator!=(const Iterator& other) const { return index != other.index; }
+    };
     
-    // Getters
-    string getName() const { return name; }
-    string getPhone() const { return phone; }
-    string getEmail() const { return email; }
-    int getCustomerId() const { return customerId; }
+    SeatList() : tierPrices{0, 0, 0}, count(0) {}
     
-    void displayInfo() const {
-        cout << "Customer: " << name << endl;
-        cout << "Phone: " << phone << endl;
-        cout << "Email: " << email << endl;
+    // Returns false when the list is already full, or already has a seat
+    // of the same tier at another price
+    bool add(const Seat& seat) {
+        if(count == CAPACITY) return false;
+        int tier = int(seat.getType());
+        for(int i = 0; i < count; i++) {
+            if(typeOf(seats[i]) == seat.getType() && tierPrices[tier] != seat.getPrice()) return false;
+        }
+        tierPrices[tier] = int32_t(seat.getPrice());
+        seats[count++] = pack(seat);
+        return true;
+    }
+    
+    // Prices the i-th seat, and with it every seat of its tier
+    void setPrice(int i, Paise price) { tierPrices[int(typeOf(seats[i]))] = int32_t(price); }
+    
+    Seat operator[](int i) const {
+        SeatType type = typeOf(seats[i]);
+        Seat seat(rowOf(seats[i]), colOf(seats[i]), type, tierPrices[int(type)]);
+        seat.setStatus(statusOf(seats[i]));
+        return seat;
     }
+    
+    int size() const { return count; }
+    bool empty() const { return count == 0; }
+    Iterator begin() const { return Iterator(this, 0); }
+    Iterator end() const { return Iterator(this, count); }
 };
 
-// Booking class
-class Booking {
+// Seat positions a client asked for, parsed from a comma-separated id list
+// in one pass without building strings. An id that does not parse is kept
+// as row -1, so the booking reports it as invalid at its place in the list.
+class SeatRequest {
 private:
-    int bookingId;
-    Customer customer;
-    Show show;
-    vector<Seat*> bookedSeats;
-    double totalAmount;
-    string bookingTime;
+    int16_t rows[SeatList::CAPACITY], cols[SeatList::CAPACITY];
+    int count;
     
 public:
-    Booking(int id, Customer c, Show s) 
-        : bookingId(id), customer(c), show(s), totalAmount(0.0) {
-        // Get current time
-        time_t now = time(0);
-        bookingTime = ctime(&now);
-        bookingTime.pop_back(); // Remove newline
-    }
+    SeatRequest() : count(0) {}
     
-    void addSeat(Seat* seat) {
-        bookedSeats.push_back(seat);
-        totalAmount += seat->getPrice();
+    // Adds one id; ids past CAPACITY are only counted
+    void add(const char* text, size_t length) {
+        if(count < SeatList::CAPACITY) {
+            int row, col;
+            if(!SeatCode::parse(text, length, row, col)) row = col = -1;
+            rows[count] = int16_t(row);
+            cols[count] = int16_t(col);
+        }
+        count++;
     }
     
-    // Getters
-    int getBookingId() const { return bookingId; }
-    Customer getCustomer() const { return customer; }
-    Show getShow() const { return show; }
-    vector<Seat*> getBookedSeats() const { return bookedSeats; }
-    double getTotalAmount() const { return totalAmount; }
-    string getBookingTime() const { return bookingTime; }
-    
-    void displayBookingDetails() const {
-        cout << "\n=== BOOKING CONFIRMATION ===" << endl;
-        cout << "Booking ID: " << bookingId << endl;
-        cout << "Booking Time: " << bookingTime << endl;
-        cout << "\nCustomer Details:" << endl;
-        customer.displayInfo();
-        cout << "\nShow Details:" << endl;
-        show.displayShowInfo();
-        cout << "\nBooked Seats:" << endl;
-        for(const auto& seat : bookedSeats) {
-            cout << "Seat " << seat->getSeatId() 
-                 << " (" << seat->getTypeString() << ") - Rs." 
-                 << seat->getPrice() << endl;
+    // "a1,A2,B10" -> three seats; a trailing comma is ignored
+    void parseList(const char* text, size_t length) {
+        const char* end = text + length;
+        while(text < end) {
+            const char* comma = static_cast<const char*>(memchr(text, ',', end - text));
+            if(!comma) comma = end;
+            add(text, comma - text);
+            text = comma + 1;
         }
-        cout << "\nTotal Amount: Rs." << totalAmount << endl;
-        cout << "=============================" << endl;
     }
     
-    void printReceipt() const {
-        cout << "\n";
-        cout << "************************************************" << endl;
-        cout << "*                                              *" << endl;
-        cout << "*            CINEPLEX THEATER                  *" << endl;
-        cout << "*              TICKET RECEIPT                  *" << endl;
-        cout << "*                                              *" << endl;
-        cout << "************************************************" << endl;
-        cout << endl;
-        
-        // Receipt Header
-        cout << "Receipt No: " << bookingId << endl;
-        cout << "Date & Time: " << bookingTime << endl;
-        cout << "________________________________________________" << endl;
-        cout << endl;
-        
-        // Customer Information
-        cout << "CUSTOMER DETAILS:" << endl;
-        cout << "Name        : " << customer.getName() << endl;
-        cout << "Phone       : " << customer.getPhone() << endl;
-        cout << "Email       : " << customer.getEmail() << endl;
-        cout << "Customer ID : " << customer.getCustomerId() << endl;
-        cout << "________________________________________________" << endl;
-        cout << endl;
-        
-        // Movie & Show Information
-        cout << "SHOW DETAILS:" << endl;
-        cout << "Movie       : " << show.getMovie().getTitle() << endl;
-        cout << "Genre       : " << show.getMovie().getGenre() << endl;
-        cout << "Duration    : " << show.getMovie().getDuration() << " mins" << endl;
-        cout << "Rating      : " << show.getMovie().getRating() << endl;
-        cout << "Show Date   : " << show.getShowDate() << endl;
-        cout << "Show Time   : " << show.getShowTime() << endl;
-        cout << "Show ID     : " << show.getShowId() << endl;
-        cout << "________________________________________________" << endl;
-        cout << endl;
-        
-        // Seat Details
-        cout << "TICKET DETAILS:" << endl;
-        cout << left << setw(8) << "Seat" 
-             << setw(12) << "Type" 
-             << setw(10) << "Price" << endl;
-        cout << "--------------------------------" << endl;
-        
-        double subtotal = 0.0;
-        for(const auto& seat : bookedSeats) {
-            cout << left << setw(8) << seat->getSeatId()
-                 << setw(12) << seat->getTypeString()
-                 << "Rs." << setw(7) << fixed << setprecision(2) << seat->getPrice() << endl;
-            subtotal += seat->getPrice();
-        }
-        
-        cout << "--------------------------------" << endl;
-        cout << "Number of Tickets: " << bookedSeats.size() << endl;
-        cout << "Subtotal         : Rs." << fixed << setprecision(2) << subtotal << endl;
-        
-        // Calculate taxes and fees
-        double serviceFee = subtotal * 0.02; // 2% service fee
-        double gst = subtotal * 0.18; // 18% GST
-        double total = subtotal + serviceFee + gst;
-        
-        cout << "Service Fee (2%) : Rs." << fixed << setprecision(2) << serviceFee << endl;
-        cout << "GST (18%)        : Rs." << fixed << setprecision(2) << gst << endl;
-        cout << "--------------------------------" << endl;
-        cout << "TOTAL AMOUNT     : Rs." << fixed << setprecision(2) << total << endl;
-        cout << "================================" << endl;
-        cout << endl;
-        
-        // Important Information
-        cout << "IMPORTANT INFORMATION:" << endl;
-        cout << "• Please arrive 15 minutes before show time" << endl;
-        cout << "• Carry a valid ID proof" << endl;
-        cout << "• Outside food & beverages not allowed" << endl;
-        cout << "• No refunds or exchanges" << endl;
-        cout << "• Keep this receipt for entry" << endl;
-        cout << endl;
-        
-        // Footer
-        cout << "************************************************" << endl;
-        cout << "*     Thank you for choosing Cineplex!        *" << endl;
-        cout << "*        Have a great movie experience!        *" << endl;
-        cout << "************************************************" << endl;
-        cout << endl;
-        
-        // Update total amount with taxes
-        const_cast<Booking*>(this)->totalAmount = total;
-    }
+    int size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool isTooLong() const { return count > SeatList::CAPACITY; }
+    int getRow(int i) const { return rows[i]; }
+    int getCol(int i) const { return cols[i]; }
 };
 
-// Theater class
-class Theater {
+// Per-show seat occupancy, packed 2 status bits per seat (32 seats per word).
+// Words are atomic so many threads can claim seats without a lock.
+//
+// Every successful change gets the next version number, and each row
+// remembers the last version that changed it; readers can cache rows or
+// send only what changed. A change may take its version before its rows
+// carry it, so a row still being stamped counts as changed (isStamping).
+//
+// Bookings claiming seats and cancellations freeing them are also counted
+// per row while under way, so a read view can tell it read a row in the
+// middle of one and read it again (see Theater::ReadView).
+class ShowOccupancy {
 private:
-    string name;
-    vector<vector<Seat>> seats;
-    int rows, cols;
-    vector<Show> shows;
-    vector<Booking> bookings;
-    int nextBookingId;
+    static constexpr int SEATS_PER_WORD = 32;
+    static constexpr uint64_t NO_SEAT = 3; // status bits of a gap in the hall
+    
+    // Seats of one request that fall in the same word
+    struct WordClaim {
+        int index;
+        uint64_t mask, fromBits, toBits;
+    };
     
-    void initializeSeats() {
-        seats.resize(rows, vector<Seat>());
+    shared_ptr<const SeatLayout> layout;
+    int wordsPerRow;
+    unique_ptr<atomic<uint64_t>[]> words;
+    atomic<uint64_t> casRetries;
+    unique_ptr<atomic<uint64_t>[]> rowVersions;
+    unique_ptr<atomic<uint32_t>[]> rowStamps; // changes with a version not yet on the row
+    atomic<uint64_t> nextVersion;
+    
+    // Changes of one row begun and finished that read views must see
+    // together with the show's change log; equal when none is under way
+    struct RowChanges {
+        atomic<uint32_t> begun{0}, done{0};
+    };
+    unique_ptr<RowChanges[]> rowChanges;
+    
+    // The best block so far in findBestBlock
+    struct BlockChoice {
+        bool found = false;
+        double score = 0.0;
+        int row = 0, col = 0;
         
-        for(int i = 0; i < rows; i++) {
-            for(int j = 0; j < cols; j++) {
-                SeatType type;
-                double price;
-                
-                // VIP seats (first 2 rows)
-                if(i < 2) {
-                    type = SeatType::VIP;
-                    price = 300.0;
-                }
-                // Premium seats (next 3 rows)
-                else if(i < 5) {
-                    type = SeatType::PREMIUM;
-                    price = 200.0;
-                }
-                // Regular seats (remaining rows)
-                else {
-                    type = SeatType::REGULAR;
-                    price = 150.0;
+        // Scores each block start set in mask, a row's 64-bit words
+        void consider(const uint64_t* mask, int maskWords, int r, double rowScore, double centredCol) {
+            for(int w = 0; w < maskWords; w++) {
+                for(uint64_t bits = mask[w]; bits; bits &= bits - 1) {
+                    int c = w * 64 + __builtin_ctzll(bits);
+                    double candidate = rowScore + fabs(c - centredCol);
+                    if(!found || candidate < score) {
+                        found = true;
+                        score = candidate;
+                        row = r;
+                        col = c;
+                    }
                 }
-                
-                seats[i].emplace_back(i, j, type, price);
             }
         }
-    }
-    
-public:
-    Theater(string n, int r, int c) 
-        : name(n), rows(r), cols(c), nextBookingId(1001) {
-        initializeSeats();
-    }
+    };
     
-    void addShow(const Show& show) {
-        shows.push_back(show);
+    // Undoes the first claims of a failed transition. Readers may have
+    // seen the claimed seats meanwhile, so their rows count as changed.
+    void rollback(const WordClaim* claims, int count) {
+        for(int k = 0; k < count; k++) {
+            // We own these seats, so flipping the changed bits restores them
+            words[claims[k].index].fetch_xor(claims[k].fromBits ^ claims[k].toBits, memory_order_release);
+        }
+        if(count > 0) publishChange(claims, count);
     }
     
-    // Get number of shows - FIXED: Added this method
-    int getShowCount() const {
-        return shows.size();
+    // Stamps the rows of the claimed words with the next version. The rows
+    // are marked as being stamped before the version is taken, so a reader
+    // that sees the version also sees the mark until the stamp is on.
+    void publishChange(const WordClaim* claims, int count) {
+        for(int k = 0; k < count; k++) {
+            rowStamps[claims[k].index / wordsPerRow].fetch_add(1, memory_order_relaxed);
+        }
+        uint64_t version = nextVersion.fetch_add(1, memory_order_acq_rel) + 1;
+        for(int k = 0; k < count; k++) {
+            int row = claims[k].index / wordsPerRow;
+            uint64_t seen = rowVersions[row].load(memory_order_relaxed);
+            while(seen < version && !rowVersions[row].compare_exchange_weak(seen, version, memory_order_release,
+                                                                             memory_order_relaxed)) {}
+            rowStamps[row].fetch_sub(1, memory_order_release);
+        }
     }
     
-    void displaySeatingGrid() const {
-        cout << "\n=== SEATING ARRANGEMENT ===" << endl;
-        cout << "Legend: O = Available, R = Reserved, X = Booked" << endl;
-        cout << "VIP (Rs.300) | Premium (Rs.200) | Regular (Rs.150)" << endl;
-        cout << "\n    ";
-        
-        // Column numbers
-        for(int j = 0; j < cols; j++) {
-            cout << setw(3) << (j + 1);
+public:
+    explicit ShowOccupancy(shared_ptr<const SeatLayout> l)
+        : layout(l),
+          wordsPerRow((l->getCols() + SEATS_PER_WORD - 1) / SEATS_PER_WORD),
+          words(new atomic<uint64_t>[l->getRows() * wordsPerRow]),
+          casRetries(0), rowVersions(new atomic<uint64_t>[l->getRows()]),
+          rowStamps(new atomic<uint32_t>[l->getRows()]), nextVersion(0),
+          rowChanges(new RowChanges[l->getRows()]) {
+        for(int i = 0; i < l->getRows() * wordsPerRow; i++) {
+            words[i].store(getGapBits(i), memory_order_relaxed);
         }
-        cout << endl;
-        
-        for(int i = 0; i < rows; i++) {
-            cout << char('A' + i) << "   ";
-            for(int j = 0; j < cols; j++) {
-                cout << setw(3) << seats[i][j].getDisplayChar();
-            }
-            
-            // Show seat type for each row
-            cout << "  (";
-            if(i < 2) cout << "VIP";
-            else if(i < 5) cout << "Premium";
-            else cout << "Regular";
-            cout << ")" << endl;
+        for(int i = 0; i < l->getRows(); i++) {
+            rowVersions[i].store(0, memory_order_relaxed);
+            rowStamps[i].store(0, memory_order_relaxed);
         }
-        cout << "\n        SCREEN" << endl;
-        cout << "=========================" << endl;
     }
     
-    void displayShows() const {
-        cout << "\n=== AVAILABLE SHOWS ===" << endl;
-        for(size_t i = 0; i < shows.size(); i++) {
-            cout << "\n" << (i + 1) << ". ";
-            shows[i].displayShowInfo();
-            cout << "------------------------" << endl;
-        }
+    const SeatLayout& getLayout() const { return *layout; }
+    uint64_t getCasRetries() const { return casRetries.load(memory_order_relaxed); }
+    
+    // Position of a seat's two status bits
+    int wordIndex(int row, int col) const {
+        return row * wordsPerRow + col / SEATS_PER_WORD;
     }
+    static int shiftFor(int col) { return (col % SEATS_PER_WORD) * 2; }
+    int getWordCount() const { return layout->getRows() * wordsPerRow; }
     
-    bool bookSeats(int showIndex, const vector<string>& seatIds, const Customer& customer) {
-        if(showIndex < 0 || showIndex >= (int)shows.size()) {
-            cout << "Invalid show selection! Available shows: 1-" << shows.size() << endl;
-            return false;
+    // NO_SEAT pairs for the gaps that fall in one packed word
+    uint64_t getGapBits(int index) const {
+        int row = index / wordsPerRow, w = index % wordsPerRow;
+        uint64_t bits = 0;
+        for(int k = 0; k < seatsInWord(w); k++) {
+            if(layout->getSeatKind(row, w * SEATS_PER_WORD + k) == SeatKind::GAP) bits |= NO_SEAT << (k * 2);
         }
-        
-        vector<Seat*> seatsToBook;
-        
-        // Validate all seats first
-        for(const string& seatId : seatIds) {
-            Seat* seat = findSeat(seatId);
-            if(!seat) {
-                cout << "Invalid seat: " << seatId << endl;
-                return false;
-            }
-            if(!seat->isAvailable()) {
-                cout << "Seat " << seatId << " is not available!" << endl;
-                return false;
+        return bits;
+    }
+    
+    // Whether saved words have gaps exactly where this hall has them
+    bool fitsLayout(const uint64_t* saved) const {
+        for(int i = 0; i < getWordCount(); i++) {
+            uint64_t gaps = getGapBits(i);
+            for(int k = 0; k < seatsInWord(i % wordsPerRow); k++) {
+                uint64_t pair = uint64_t(3) << (k * 2);
+                if(((saved[i] & pair) == pair) != ((gaps & pair) != 0)) return false;
             }
-            seatsToBook.push_back(seat);
-        }
-        
-        // Book all seats
-        Booking booking(nextBookingId++, customer, shows[showIndex]);
-        for(Seat* seat : seatsToBook) {
-            seat->setStatus(SeatStatus::BOOKED);
-            booking.addSeat(seat);
-        }
-        
-        bookings.push_back(booking);
-        
-        // Print detailed receipt
-        cout << "\n🎫 PRINTING RECEIPT... 🎫" << endl;
-        booking.printReceipt();
-        
-        // Ask if user wants a copy
-        char choice;
-        cout << "Would you like to save this receipt? (y/n): ";
-        cin >> choice;
-        cin.ignore(); // FIXED: Clear the input buffer
-        if(choice == 'y' || choice == 'Y') {
-            cout << "Receipt saved! (In a real system, this would save to file)" << endl;
         }
-        
         return true;
     }
     
-    Seat* findSeat(const string& seatId) {
-        if(seatId.length() < 2) return nullptr;
-        
-        int row = seatId[0] - 'A';
-        int col = stoi(seatId.substr(1)) - 1;
-        
-        if(row < 0 || row >= rows || col < 0 || col >= cols) {
-            return nullptr;
+    // Replaces the whole map with saved words; only before booking starts.
+    // Counts as one change to every row.
+    void loadWords(const uint64_t* saved) {
+        for(int i = 0; i < getWordCount(); i++) {
+            words[i].store(saved[i], memory_order_relaxed);
         }
-        
-        return &seats[row][col];
+        uint64_t version = nextVersion.load(memory_order_relaxed) + 1;
+        for(int i = 0; i < layout->getRows(); i++) {
+            rowVersions[i].store(version, memory_order_relaxed);
+        }
+        nextVersion.store(version, memory_order_release);
     }
     
-    void displayBookings() const {
-        cout << "\n=== ALL BOOKINGS ===" << endl;
-        if(bookings.empty()) {
-            cout << "No bookings found." << endl;
-            return;
-        }
-        
-        for(size_t i = 0; i < bookings.size(); i++) {
-            cout << "\n" << (i + 1) << ". ";
-            bookings[i].displayBookingDetails();
-            cout << endl;
+    // Every change up to the returned version is in the seat words; one
+    // whose rows are not stamped yet still shows in isStamping
+    uint64_t getVersion() const { return nextVersion.load(memory_order_acquire); }
+    uint64_t getRowVersion(int row) const { return rowVersions[row].load(memory_order_acquire); }
+    
+    // Whether a change of the row has its version but has not stamped the
+    // row with it yet; check before reading the row version
+    bool isStamping(int row) const { return rowStamps[row].load(memory_order_acquire) != 0; }
+    
+    // Brackets a change of the seats that read views must see together
+    // with its change log record: begun before the seats change, ended once
+    // the record is linked or updated
+    void beginChange(const SeatList& seats) {
+        for(int i = 0; i < seats.size(); i++) {
+            if(i > 0 && seats[i].getRow() == seats[i - 1].getRow()) continue;
+            rowChanges[seats[i].getRow()].begun.fetch_add(1, memory_order_relaxed);
         }
     }
     
-    void searchBooking(int bookingId) const {
-        for(const auto& booking : bookings) {
-            if(booking.getBookingId() == bookingId) {
-                cout << "\n📋 Booking Found!" << endl;
-                booking.displayBookingDetails();
-                
-                // Ask if user wants to print receipt
-                char choice;
-                cout << "\nWould you like to print the receipt? (y/n): ";
-                cin >> choice;
-                cin.ignore(); // FIXED: Clear the input buffer
-                if(choice == 'y' || choice == 'Y') {
-                    cout << "\n🎫 PRINTING RECEIPT... 🎫" << endl;
-                    booking.printReceipt();
-                }
-                return;
-            }
+    void endChange(const SeatList& seats) {
+        for(int i = 0; i < seats.size(); i++) {
+            if(i > 0 && seats[i].getRow() == seats[i - 1].getRow()) continue;
+            rowChanges[seats[i].getRow()].done.fetch_add(1, memory_order_release);
         }
-        cout << "❌ Booking not found!" << endl;
     }
     
-    void displayStats() const {
-        int totalSeats = rows * cols;
-        int bookedSeats = 0;
-        double totalRevenue = 0.0;
-        
-        for(int i = 0; i < rows; i++) {
-            for(int j = 0; j < cols; j++) {
-                if(seats[i][j].getStatus() == SeatStatus::BOOKED) {
-                    bookedSeats++;
+    // A reader that finds no change of the row under way, reads it, then
+    // finds the same number begun, read it with the matching records
+    uint32_t getChangesBegun(int row) const { return rowChanges[row].begun.load(memory_order_acquire); }
+    uint32_t getChangesDone(int row) const { return rowChanges[row].done.load(memory_order_acquire); }
+    
+    // Appends a row as runs of status letters and counts, O/R/X as on the
+    // seating grid: "O3X2O5" is 3 available, 2 booked, 5 available seats
+    void appendRowRuns(int row, string& out) const {
+        char current = 0;
+        int run = 0;
+        for(int w = 0; w < wordsPerRow; w++) {
+            uint64_t word = words[row * wordsPerRow + w].load(memory_order_acquire);
+            for(int k = 0; k < seatsInWord(w); k++, word >>= 2) {
+                char letter = "ORX_"[word & 3];
+                if(letter != current && run > 0) {
+                    out += current;
+                    out += to_string(run);
+                    run = 0;
                 }
+                current = letter;
+                run++;
             }
         }
+        if(run > 0) {
+            out += current;
+            out += to_string(run);
+        }
+    }
+    
+    SeatStatus getStatus(int row, int col) const {
+        return SeatStatus((words[wordIndex(row, col)].load(memory_order_acquire) >> shiftFor(col)) & 3);
+    }
+    
+    Seat getSeat(int row, int col) const {
+        return layout->makeSeat(row, col, getStatus(row, col));
+    }
+    
+    // Moves every seat from one status to another, all or nothing.
+    // Each touched word is claimed with compare-and-swap in ascending order;
+    // if any seat is not in the expected status, words already claimed are
+    // rolled back. Returns -1 on success, else the index of the blocking seat.
+    int transition(const SeatList& seats, SeatStatus from, SeatStatus to) {
+        WordClaim claims[SeatList::CAPACITY];
+        int claimCount = 0;
+        for(int i = 0; i < seats.size(); i++) {
+            Seat seat = seats[i];
+            int index = wordIndex(seat.getRow(), seat.getCol());
+            int shift = shiftFor(seat.getCol());
+            WordClaim* it = find_if(claims, claims + claimCount,
+                                    [index](const WordClaim& c) { return c.index == index; });
+            if(it == claims + claimCount) {
+                claims[claimCount++] = {index, 0, 0, 0};
+            }
+            if(it->mask & (uint64_t(3) << shift)) {
+                return i; // same seat listed twice
+            }
+            it->mask |= uint64_t(3) << shift;
+            it->fromBits |= uint64_t(from) << shift;
+            it->toBits |= uint64_t(to) << shift;
+        }
+        // A request spans only a few words, so insertion sort is enough
+        for(int k = 1; k < claimCount; k++) {
+            WordClaim claim = claims[k];
+            int j = k;
+            for(; j > 0 && claims[j - 1].index > claim.index; j--) claims[j] = claims[j - 1];
+            claims[j] = claim;
+        }
         
-        for(const auto& booking : bookings) {
-            totalRevenue += booking.getTotalAmount();
+        for(int k = 0; k < claimCount; k++) {
+            const WordClaim& claim = claims[k];
+            uint64_t current = words[claim.index].load(memory_order_relaxed);
+            while(true) {
+                if((current & claim.mask) != claim.fromBits) {
+                    rollback(claims, k);
+                    for(int i = 0; i < seats.size(); i++) {
+                        Seat seat = seats[i];
+                        int shift = shiftFor(seat.getCol());
+                        if(wordIndex(seat.getRow(), seat.getCol()) == claim.index &&
+                           ((current >> shift) & 3) != uint64_t(from)) {
+                            return i;
+                        }
+                    }
+                    return 0;
+                }
+                uint64_t desired = (current & ~claim.mask) | claim.toBits;
+                if(words[claim.index].compare_exchange_weak(current, desired,
+                                                            memory_order_acq_rel,
+                                                            memory_order_relaxed)) {
+                    break;
+                }
+                casRetries.fetch_add(1, memory_order_relaxed);
+            }
         }
         
-        cout << "\n=== THEATER STATISTICS ===" << endl;
-        cout << "Theater: " << name << endl;
-        cout << "Total Seats: " << totalSeats << endl;
-        cout << "Booked Seats: " << bookedSeats << endl;
-        cout << "Available Seats: " << (totalSeats - bookedSeats) << endl;
-        cout << "Occupancy Rate: " << fixed << setprecision(1) 
-             << (double(bookedSeats) / totalSeats * 100) << "%" << endl;
-        cout << "Total Revenue: Rs." << totalRevenue << endl;
-        cout << "Total Bookings: " << bookings.size() << endl;
-        cout << "=========================" << endl;
+        publishChange(claims, claimCount);
+        return -1;
     }
-};
-
-// Main application class
-class MovieBookingSystem {
-private:
-    Theater theater;
     
-    void displayMenu() const {
-        cout << "\n===== MOVIE BOOKING SYSTEM =====" << endl;
-        cout << "1. View Shows" << endl;
-        cout << "2. View Seating Arrangement" << endl;
-        cout << "3. Book Tickets" << endl;
-        cout << "4. View All Bookings" << endl;
-        cout << "5. Search Booking & Print Receipt" << endl;
-        cout << "6. Theater Statistics" << endl;
-        cout << "7. Exit" << endl;
-        cout << "=================================" << endl;
-        cout << "Enter your choice: ";
+    // Counts as a change to the seats' rows without changing any seat, so
+    // rows cached by version are redrawn; a cancellation does this before
+    // it is committed, since its seats are only freed after
+    void touch(const SeatList& seats) {
+        WordClaim claims[SeatList::CAPACITY];
+        for(int i = 0; i < seats.size(); i++) {
+            claims[i] = {wordIndex(seats[i].getRow(), seats[i].getCol()), 0, 0, 0};
+        }
+        publishChange(claims, seats.size());
     }
     
-    // FIXED: Added input validation helper
-    int getValidatedInput(int min, int max) {
-        int input;
-        while(true) {
-            if(cin >> input) {
-                if(input >= min && input <= max) {
-                    return input;
-                } else {
-                    cout << "Please enter a number between " << min << " and " << max << ": ";
-                }
-            } else {
-                cout << "Invalid input! Please enter a number: ";
-                cin.clear();
-                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    // Count seats in a given status using the packed words directly.
+    // Halls up to 128 seats wide get a scan specialised for their row width.
+    int countStatus(SeatStatus status) const {
+        switch(wordsPerRow) {
+            case 1: return countStatusIn<1>(status);
+            case 2: return countStatusIn<2>(status);
+            case 3: return countStatusIn<3>(status);
+            case 4: return countStatusIn<4>(status);
+            default: return countStatusGeneric(status);
+        }
+    }
+    
+    // countStatus for any row width; also what the specialised scans are
+    // benchmarked against
+    int countStatusGeneric(SeatStatus status) const {
+        int count = 0;
+        for(int i = 0; i < layout->getRows(); i++) {
+            for(int w = 0; w < wordsPerRow; w++) {
+                uint64_t word = words[i * wordsPerRow + w].load(memory_order_acquire);
+                count += __builtin_popcountll(matchStatus(word, status, seatsInWord(w)));
             }
         }
+        return count;
     }
     
-    Customer getCustomerDetails() const {
-        string name, phone, email;
-        cout << "\nEnter customer details:" << endl;
-        cout << "Name: ";
-        cin.ignore(); // FIXED: Clear input buffer before getline
-        getline(cin, name);
-        cout << "Phone: ";
-        getline(cin, phone);
-        cout << "Email: ";
-        getline(cin, email);
-        
-        return Customer(name, phone, email, rand() % 9000 + 1000);
+    // One bit per seat of a row, set where the seat is in the given status.
+    // Each packed word of 32 seats fills half of a mask word.
+    void getRowMask(int row, SeatStatus status, vector<uint64_t>& mask) const {
+        mask.assign((layout->getCols() + 63) / 64, 0);
+        for(int w = 0; w < wordsPerRow; w++) {
+            uint64_t word = words[row * wordsPerRow + w].load(memory_order_acquire);
+            mask[w / 2] |= compressSeatBits(matchStatus(word, status, seatsInWord(w))) << ((w % 2) * 32);
+        }
     }
     
-public:
-    MovieBookingSystem() : theater("Cineplex Theater", 8, 10) {
-        // Initialize with some sample shows
-        Movie movie1("Avengers: Endgame", "Action/Adventure", 181, "PG-13");
-        Movie movie2("The Lion King", "Animation/Family", 118, "PG");
-        Movie movie3("Joker", "Crime/Drama", 122, "R");
-        
-        theater.addShow(Show(movie1, "10:00 AM", "2024-01-15", 101));
-        theater.addShow(Show(movie1, "02:00 PM", "2024-01-15", 102));
-        theater.addShow(Show(movie2, "11:00 AM", "2024-01-15", 103));
-        theater.addShow(Show(movie3, "06:00 PM", "2024-01-15", 104));
+    // Finds the best block of `count` adjacent available seats in a tier:
+    // the one nearest the middle of its row, with rows scored by how far
+    // they are from the ideal viewing distance of about two thirds of the
+    // hall back from the screen (the screen is past the last row).
+    // Rows are searched a whole word at a time, so a hall of a few hundred
+    // seats takes well under a microsecond per row. Blocks never span a
+    // gap, and wheelchair spaces are left for customers who ask for them.
+    bool findBestBlock(SeatType tier, int count, int& bestRow, int& bestCol) const {
+        switch(wordsPerRow) {
+            case 1: return findBestBlockIn<1>(tier, count, bestRow, bestCol);
+            case 2: return findBestBlockIn<2>(tier, count, bestRow, bestCol);
+            case 3: return findBestBlockIn<3>(tier, count, bestRow, bestCol);
+            case 4: return findBestBlockIn<4>(tier, count, bestRow, bestCol);
+            default: return findBestBlockGeneric(tier, count, bestRow, bestCol);
+        }
     }
     
-    void run() {
-        srand(time(nullptr));
-        int choice;
+    // findBestBlock for any row width, with row masks in vectors
+    bool findBestBlockGeneric(SeatType tier, int count, int& bestRow, int& bestCol) const {
+        int rows = layout->getRows(), cols = layout->getCols();
+        if(count < 1 || count > cols) return false;
         
-        cout << "Welcome to Movie Booking System!" << endl;
+        double idealDistance = rows * 2 / 3.0;
+        double centredCol = (cols - count) / 2.0;
+        BlockChoice best;
+        vector<uint64_t> mask;
+        for(int row = 0; row < rows; row++) {
+            if(layout->getRowType(row) != tier) continue;
+            double rowScore = getRowScore(row, idealDistance);
+            if(best.found && rowScore >= best.score) continue; // cannot beat the best block
+            
+            getRowMask(row, SeatStatus::AVAILABLE, mask);
+            const uint64_t* pickable = layout->getPickableMask(row);
+            for(size_t w = 0; w < mask.size(); w++) mask[w] &= pickable[w];
+            keepRunStarts(mask, count);
+            best.consider(mask.data(), mask.size(), row, rowScore, centredCol);
+        }
+        bestRow = best.row;
+        bestCol = best.col;
+        return best.found;
+    }
+    
+private:
+    // The scans for halls whose rows are WORDS packed words: loops over a
+    // row have a fixed trip count and its masks live on the stack
+    template<int WORDS>
+    int countStatusIn(SeatStatus status) const {
+        const int lastSeats = seatsInWord(WORDS - 1);
+        int count = 0;
+        for(int i = 0; i < layout->getRows(); i++) {
+            const atomic<uint64_t>* row = &words[i * WORDS];
+            for(int w = 0; w < WORDS; w++) {
+                uint64_t word = row[w].load(memory_order_acquire);
+                count += __builtin_popcountll(matchStatus(word, status, w == WORDS - 1 ? lastSeats : SEATS_PER_WORD));
+            }
+        }
+        return count;
+    }
+    
+    template<int WORDS>
+    bool findBestBlockIn(SeatType tier, int count, int& bestRow, int& bestCol) const {
+        constexpr int MASK_WORDS = (WORDS + 1) / 2;
+        int rows = layout->getRows(), cols = layout->getCols();
+        if(count < 1 || count > cols) return false;
         
-        while(true) {
-            displayMenu();
-            choice = getValidatedInput(1, 7); // FIXED: Use validated input
+        const int lastSeats = seatsInWord(WORDS - 1);
+        double idealDistance = rows * 2 / 3.0;
+        double centredCol = (cols - count) / 2.0;
+        BlockChoice best;
+        for(int row = 0; row < rows; row++) {
+            if(layout->getRowType(row) != tier) continue;
+            double rowScore = getRowScore(row, idealDistance);
+            if(best.found && rowScore >= best.score) continue;
             
-            switch(choice) {
-                case 1:
-                    theater.displayShows();
-                    break;
-                    
-                case 2:
-                    theater.displaySeatingGrid();
-                    break;
-                    
-                case 3: {
-                    theater.displayShows();
-                    int showCount = theater.getShowCount(); // FIXED: Dynamic show count
-                    cout << "\nSelect show number (1-" << showCount << "): ";
-                    int showChoice = getValidatedInput(1, showCount); // FIXED: Use validated input
-                    
-                    theater.displaySeatingGrid();
-                    
-                    cout << "\nHow many seats do you want to book? ";
-                    int numSeats = getValidatedInput(1, 10); // FIXED: Reasonable max limit
-                    
-                    vector<string> seatIds;
-                    cout << "Enter seat IDs (e.g., A1, B5): ";
-                    cin.ignore(); // FIXED: Clear input buffer
-                    for(int i = 0; i < numSeats; i++) {
-                        string seatId;
-                        cin >> seatId;
-                        transform(seatId.begin(), seatId.end(), seatId.begin(), ::toupper);
-                        seatIds.push_back(seatId);
-                    }
-                    
-                    Customer customer = getCustomerDetails();
-                    theater.bookSeats(showChoice - 1, seatIds, customer);
-                    break;
-                }
-                
-                case 4:
-                    theater.displayBookings();
-                    break;
-                    
-                case 5: {
-                    cout << "Enter booking ID: ";
-                    int bookingId = getValidatedInput(1000, 9999); // FIXED: Use validated input
-                    theater.searchBooking(bookingId);
-                    break;
-                }
-                
-                case 6:
-                    theater.displayStats();
-                    break;
-                    
-                case 7:
-                    cout << "Thank you for using Movie Booking System!" << endl;
-                    return;
-                    
-                default:
-                    cout << "Invalid choice! Please try again." << endl;
+            const atomic<uint64_t>* rowWords = &words[row * WORDS];
+            const uint64_t* pickable = layout->getPickableMask(row);
+            uint64_t mask[MASK_WORDS];
+            for(int m = 0; m < MASK_WORDS; m++) mask[m] = 0;
+            for(int w = 0; w < WORDS; w++) {
+                uint64_t word = rowWords[w].load(memory_order_acquire);
+                uint64_t available = matchStatus(word, SeatStatus::AVAILABLE, w == WORDS - 1 ? lastSeats : SEATS_PER_WORD);
+                mask[w / 2] |= compressSeatBits(available) << ((w % 2) * 32);
+            }
+            for(int m = 0; m < MASK_WORDS; m++) mask[m] &= pickable[m];
+            keepRunStartsIn<MASK_WORDS>(mask, count);
+            best.consider(mask, MASK_WORDS, row, rowScore, centredCol);
+        }
+        bestRow = best.row;
+        bestCol = best.col;
+        return best.found;
+    }
+    
+    // Rows are scored by how far they are from the ideal viewing distance
+    double getRowScore(int row, double idealDistance) const {
+        const double ROW_WEIGHT = 1.5; // one row off ideal costs 1.5 seats off centre
+        return ROW_WEIGHT * fabs((layout->getRows() - 1 - row) - idealDistance);
+    }
+    
+    int seatsInWord(int w) const {
+        return min(SEATS_PER_WORD, layout->getCols() - w * SEATS_PER_WORD);
+    }
+    
+    // Low bit of each seat's pair set where the seat has the given status
+    static uint64_t matchStatus(uint64_t word, SeatStatus status, int seats) {
+        const uint64_t LOW_BITS = 0x5555555555555555ULL;
+        uint64_t valid = seats == SEATS_PER_WORD ? ~0ULL : (uint64_t(1) << (seats * 2)) - 1;
+        // A seat matches when both of its bits equal the pattern
+        uint64_t diff = (word ^ (LOW_BITS * uint64_t(status))) & valid;
+        return ~(diff | (diff >> 1)) & LOW_BITS & valid;
+    }
+    
+    // Packs the even bits of a word into its low 32 bits
+    static uint64_t compressSeatBits(uint64_t bits) {
+        bits &= 0x5555555555555555ULL;
+        bits = (bits | (bits >> 1)) & 0x3333333333333333ULL;
+        bits = (bits | (bits >> 2)) & 0x0F0F0F0F0F0F0F0FULL;
+        bits = (bits | (bits >> 4)) & 0x00FF00FF00FF00FFULL;
+        bits = (bits | (bits >> 8)) & 0x0000FFFF0000FFFFULL;
+        return (bits | (bits >> 16)) & 0x00000000FFFFFFFFULL;
+    }
+    
+    // Keeps only the bits that start a run of at least `length` set bits.
+    // Each step ands the mask with itself shifted down by the run length
+    // covered so far, so the run length doubles per step.
+    static void keepRunStarts(vector<uint64_t>& mask, int length) {
+        vector<uint64_t> shifted(mask.size());
+        for(int run = 1; run < length; ) {
+            int step = min(run, length - run);
+            int wordShift = step / 64, bitShift = step % 64;
+            for(size_t i = 0; i < mask.size(); i++) {
+                uint64_t low = i + wordShift < mask.size() ? mask[i + wordShift] : 0;
+                uint64_t high = i + wordShift + 1 < mask.size() ? mask[i + wordShift + 1] : 0;
+                shifted[i] = bitShift ? (low >> bitShift) | (high << (64 - bitShift)) : low;
+            }
+            for(size_t i = 0; i < mask.size(); i++) mask[i] &= shifted[i];
+            run += step;
+        }
+    }
+    
+    // keepRunStarts for a mask of N words on the stack
+    template<int N>
+    static void keepRunStartsIn(uint64_t* mask, int length) {
+        for(int run = 1; run < length; ) {
+            int step = min(run, length - run);
+            int wordShift = step / 64, bitShift = step % 64;
+            uint64_t shifted[N];
+            for(int i = 0; i < N; i++) {
+                uint64_t low = i + wordShift < N ? mask[i + wordShift] : 0;
+                uint64_t high = i + wordShift + 1 < N ? mask[i + wordShift + 1] : 0;
+                shifted[i] = bitShift ? (low >> bitShift) | (high << (64 - bitShift)) : low;
+            }
+            for(int i = 0; i < N; i++) mask[i] &= shifted[i];
+            run += step;
+        }
+    }
+};
+
+// Movie class
+class Movie {
+private:
+    string title;
+    string genre;
+    int duration; // in minutes
+    string rating;
+    
+public:
+    Movie(string t, string g, int d, string r) 
+        : title(t), genre(g), duration(d), rating(r) {}
+    
+    // Getters
+    const string& getTitle() const { return title; }
+    const string& getGenre() const { return genre; }
+    int getDuration() const { return duration; }
+    const string& getRating() const { return rating; }
+    
+    void displayInfo() const {
+        cout << "Title: " << title << endl;
+        cout << "Genre: " << genre << endl;
+        cout << "Duration: " << duration << " minutes" << endl;
+        cout << "Rating: " << rating << endl;
+    }
+};
+
+// Show class. The movie is shared, so shows of the same movie added to a
+// Catalog all point at one copy.
+class Show {
+private:
+    shared_ptr<const Movie> movie;
+    string showTime;
+    string showDate;
+    int showId;
+    time_t startTime; // local; -1 if the date or time cannot be read
+    
+    static string formatLocal(time_t at, const char* format) {
+        struct tm local;
+#ifdef _WIN32
+        localtime_s(&local, &at);
+#else
+        localtime_r(&at, &local);
+#endif
+        char text[32];
+        strftime(text, sizeof(text), format, &local);
+        return text;
+    }
+    
+public:
+    Show(Movie m, string time, string date, int id) 
+        : Show(make_shared<const Movie>(move(m)), time, date, id) {}
+    
+    Show(shared_ptr<const Movie> m, string time, string date, int id) 
+        : movie(m), showTime(time), showDate(date), showId(id), startTime(parseStartTime(date, time)) {}
+    
+    // A show whose start was already read from its date and time
+    Show(shared_ptr<const Movie> m, string time, string date, int id, time_t start) 
+        : movie(m), showTime(time), showDate(date), showId(id), startTime(start) {}
+    
+    // A show starting at a local time, displayed as "2024-01-15" and "06:00 PM"
+    Show(Movie m, time_t start, int id)
+        : Show(make_shared<const Movie>(move(m)), formatLocal(start, "%I:%M %p"), formatLocal(start, "%Y-%m-%d"), id) {}
+    
+    // Getters
+    const Movie& getMovie() const { return *movie; }
+    const shared_ptr<const Movie>& getSharedMovie() const { return movie; }
+    const string& getShowTime() const { return showTime; }
+    const string& getShowDate() const { return showDate; }
+    int getShowId() const { return showId; }
+    time_t getStartTime() const { return startTime; }
+    
+    // When the movie ends, from its duration; -1 if the start is unknown
+    time_t getEndTime() const {
+        return startTime < 0 ? -1 : startTime + time_t(movie->getDuration()) * 60;
+    }
+    
+    // Reads a "2024-01-15" date and a "10:00 AM" (or "18:00") time into
+    // the calendar fields of a struct tm, ready for mktime; false if they
+    // cannot be read
+    static bool readStartTime(const char* date, const char* time, struct tm& local) {
+        local = {};
+        int hour, minute;
+        char half[3] = "";
+        if(sscanf(date, "%d-%d-%d", &local.tm_year, &local.tm_mon, &local.tm_mday) != 3 ||
+           sscanf(time, "%d:%d %2s", &hour, &minute, half) < 2) return false;
+        if(local.tm_mon < 1 || local.tm_mon > 12 || local.tm_mday < 1 || local.tm_mday > 31 ||
+           hour < 0 || hour > 23 || minute < 0 || minute > 59) return false;
+        if(half[0]) {
+            hour %= 12;
+            if(toupper((unsigned char)half[0]) == 'P') hour += 12;
+        }
+        local.tm_year -= 1900;
+        local.tm_mon -= 1;
+        local.tm_hour = hour;
+        local.tm_min = minute;
+        local.tm_isdst = -1;
+        return true;
+    }
+    
+    // Local time from a "2024-01-15" date and a "10:00 AM" (or "18:00")
+    // time; -1 if they cannot be read
+    static time_t parseStartTime(const string& date, const string& time) {
+        struct tm local;
+        return readStartTime(date.c_str(), time.c_str(), local) ? mktime(&local) : -1;
+    }
+    
+    void displayShowInfo() const {
+        cout << "Show ID: " << showId << endl;
+        cout << "Date: " << showDate << " | Time: " << showTime << endl;
+        movie->displayInfo();
+    }
+};
+
+// Customer class
+class Customer {
+private:
+    string name;
+    string phone;
+    string email;
+    int customerId;
+    
+public:
+    Customer(string n, string p, string e, int id) 
+        : name(n), phone(p), email(e), customerId(id) {}
+    
+    // Getters
+    const string& getName() const { return name; }
+    const string& getPhone() const { return phone; }
+    const string& getEmail() const { return email; }
+    int getCustomerId() const { return customerId; }
+    
+    void displayInfo() const {
+        cout << "Customer: " << name << endl;
+        cout << "Phone: " << phone << endl;
+        cout << "Email: " << email << endl;
+    }
+};
+
+// Interned catalog of the shows and customers that bookings refer to. Each
+// is stored once and never moves, so a booking keeps only compact ids and
+// readers resolve them without copying anything. Shows (and their movies,
+// interned by title) are added before booking starts; customers are added
+// concurrently and looked up by id without a lock.
+class Catalog {
+private:
+    static const int CUSTOMER_SEGMENT_BITS = 12;
+    static const int CUSTOMER_SEGMENT_SIZE = 1 << CUSTOMER_SEGMENT_BITS;
+    static const int MAX_CUSTOMER_SEGMENTS = 4096;
+    
+    unordered_map<string, shared_ptr<const Movie>> moviesByTitle;
+    deque<Show> shows;
+    
+    mutex customersLock;
+    deque<Customer> customers; // owns every customer; only grows
+    atomic<atomic<const Customer*>*> customerSegments[MAX_CUSTOMER_SEGMENTS]; // by id
+    
+    static bool isIndexable(int customerId) {
+        return customerId >= 0 && customerId < CUSTOMER_SEGMENT_SIZE * MAX_CUSTOMER_SEGMENTS;
+    }
+    
+public:
+    Catalog() {
+        for(auto& segment : customerSegments) segment.store(nullptr, memory_order_relaxed);
+    }
+    
+    ~Catalog() {
+        for(auto& segment : customerSegments) delete[] segment.load(memory_order_relaxed);
+    }
+    
+    Catalog(const Catalog&) = delete;
+    Catalog& operator=(const Catalog&) = delete;
+    
+    // Returns the new show's index
+    int addShow(const Show& show) {
+        shared_ptr<const Movie>& movie = moviesByTitle[show.getMovie().getTitle()];
+        if(!movie) movie = show.getSharedMovie();
+        shows.emplace_back(movie, show.getShowTime(), show.getShowDate(), show.getShowId(), show.getStartTime());
+        return shows.size() - 1;
+    }
+    
+    int getShowCount() const { return shows.size(); }
+    int getMovieCount() const { return moviesByTitle.size(); }
+    const Show& getShow(int showIndex) const { return shows[showIndex]; }
+    
+    // Stores a customer under its id. If the id is already taken, the
+    // customer stored first is kept and returned.
+    const Customer& addCustomer(const Customer& customer) {
+        int id = customer.getCustomerId();
+        lock_guard<mutex> guard(customersLock);
+        if(const Customer* existing = findCustomer(id)) return *existing;
+        customers.push_back(customer);
+        const Customer* stored = &customers.back();
+        if(isIndexable(id)) {
+            // Writers are serialized by the lock; readers only load
+            atomic<const Customer*>* segment = customerSegments[id >> CUSTOMER_SEGMENT_BITS].load(memory_order_relaxed);
+            if(!segment) {
+                segment = new atomic<const Customer*>[CUSTOMER_SEGMENT_SIZE];
+                for(int i = 0; i < CUSTOMER_SEGMENT_SIZE; i++) segment[i].store(nullptr, memory_order_relaxed);
+                customerSegments[id >> CUSTOMER_SEGMENT_BITS].store(segment, memory_order_release);
             }
+            segment[id & (CUSTOMER_SEGMENT_SIZE - 1)].store(stored, memory_order_release);
         }
+        return *stored;
+    }
+    
+    // Returns nullptr if no customer has this id
+    const Customer* findCustomer(int customerId) const {
+        if(!isIndexable(customerId)) return nullptr;
+        atomic<const Customer*>* segment =
+            customerSegments[customerId >> CUSTOMER_SEGMENT_BITS].load(memory_order_acquire);
+        return segment ? segment[customerId & (CUSTOMER_SEGMENT_SIZE - 1)].load(memory_order_acquire) : nullptr;
+    }
+    
+    const Customer& getCustomer(int customerId) const {
+        static const Customer unknown("Unknown", "", "", -1);
+        const Customer* customer = findCustomer(customerId);
+        return customer ? *customer : unknown;
     }
 };
 
-int main() {
-    MovieBookingSystem system;
+// Shows indexed by start time, by movie and by screen. Each index is a
+// vector kept sorted by start, so a range query is one binary search plus
+// a scan of the shows it returns. Like the Catalog, it is filled before
+// booking starts and only read after.
+class ShowSchedule {
+public:
+    struct Entry {
+        time_t start, end; // end from the movie's duration
+        int screen;
+        int showId;
+        
+        bool operator<(const Entry& other) const {
+            return start != other.start ? start < other.start : showId < other.showId;
+        }
+    };
+    
+private:
+    vector<Entry> byStart;
+    unordered_map<string, vector<Entry>> byMovie; // by title
+    unordered_map<int, vector<Entry>> byScreen;   // never overlapping
+    
+    static void insertSorted(vector<Entry>& entries, const Entry& entry) {
+        entries.insert(upper_bound(entries.begin(), entries.end(), entry), entry);
+    }
+    
+    static vector<Entry> getStartingIn(const vector<Entry>& entries, time_t from, time_t to, size_t limit) {
+        vector<Entry> found;
+        auto it = lower_bound(entries.begin(), entries.end(), from,
+                              [](const Entry& entry, time_t at) { return entry.start < at; });
+        for(; it != entries.end() && it->start < to && found.size() < limit; ++it) found.push_back(*it);
+        return found;
+    }
+    
+public:
+    // The show on the entry's screen that overlaps it, or nullptr. Shows on
+    // one screen never overlap, so only the neighbours by start can.
+    const Entry* findOverlap(const Entry& entry) const {
+        auto screen = byScreen.find(entry.screen);
+        if(screen == byScreen.end()) return nullptr;
+        const vector<Entry>& entries = screen->second;
+        auto next = lower_bound(entries.begin(), entries.end(), entry);
+        if(next != entries.end() && next->start < entry.end) return &*next;
+        if(next != entries.begin() && prev(next)->end > entry.start) return &*prev(next);
+        return nullptr;
+    }
+    
+    // Returns false, adding nothing, if the show overlaps another on its screen
+    bool add(const Entry& entry, const string& title) {
+        if(findOverlap(entry)) return false;
+        insertSorted(byStart, entry);
+        insertSorted(byMovie[title], entry);
+        insertSorted(byScreen[entry.screen], entry);
+        return true;
+    }
+    
+    int size() const { return byStart.size(); }
+    
+    // Shows starting in [from, to) in start order, at most limit of them
+    vector<Entry> getStarting(time_t from, time_t to, size_t limit = SIZE_MAX) const {
+        return getStartingIn(byStart, from, to, limit);
+    }
+    
+    vector<Entry> getStarting(const string& title, time_t from, time_t to, size_t limit = SIZE_MAX) const {
+        auto movie = byMovie.find(title);
+        return movie == byMovie.end() ? vector<Entry>() : getStartingIn(movie->second, from, to, limit);
+    }
+};
+
+// Booking class. Refers to its show and customer by id in the theater's
+// Catalog and keeps its seats inline, so a booking is one fixed-size block.
+// Amounts are in paise. The service fee and GST are worked out per seat,
+// so a booking's total, its receipt and the revenue counters all add up
+// the same per-seat figures exactly; they are summed from the seats when
+// asked for rather than stored.
+class Booking {
+private:
+    int bookingId;
+    int showIndex;  // into the Catalog
+    int customerId;
+    SeatList bookedSeats;
+    time_t bookedAt;
+    
+    // Sum over the seats of `percent` of each seat's price
+    Paise sumSeats(int percent) const {
+        Paise sum = 0;
+        for(const Seat& seat : bookedSeats) sum += percentOf(seat.getPrice(), percent);
+        return sum;
+    }
+    
+public:
+    Booking(int id, int show, int customer) : Booking(id, show, customer, time(0)) {}
+    
+    // Used when restoring a booking made at an earlier time
+    Booking(int id, int show, int customer, time_t at) 
+        : bookingId(id), showIndex(show), customerId(customer), bookedAt(at) {}
+    
+    static const int SERVICE_FEE_PERCENT = 2;
+    static const int GST_PERCENT = 18;
+    
+    // A percentage of a price, rounded to the nearest paisa
+    static Paise percentOf(Paise price, int percent) {
+        return (price * percent + 50) / 100;
+    }
+    
+    // What the customer pays for a seat of this price, fees and tax included
+    static Paise getGrossPrice(Paise price) {
+        return price + percentOf(price, SERVICE_FEE_PERCENT) + percentOf(price, GST_PERCENT);
+    }
+    
+    // Returns false when the booking already holds SeatList::CAPACITY
+    // seats, or a seat of the same tier at another price
+    bool addSeat(const Seat& seat) { return bookedSeats.add(seat); }
+    
+    // Getters
+    int getBookingId() const { return bookingId; }
+    int getShowIndex() const { return showIndex; }
+    int getCustomerId() const { return customerId; }
+    const SeatList& getBookedSeats() const { return bookedSeats; }
+    Paise getSubtotal() const { return sumSeats(100); }
+    Paise getServiceFee() const { return sumSeats(SERVICE_FEE_PERCENT); }
+    Paise getGst() const { return sumSeats(GST_PERCENT); }
+    Paise getTotalAmount() const { return getSubtotal() + getServiceFee() + getGst(); }
+    time_t getBookedAt() const { return bookedAt; }
+    
+    string getBookingTime() const { return formatTime(bookedAt); }
+    
+    // Same format as ctime, without its shared buffer
+    static string formatTime(time_t at) {
+        struct tm local;
+#ifdef _WIN32
+        localtime_s(&local, &at);
+#else
+        localtime_r(&at, &local);
+#endif
+        char text[32];
+        strftime(text, sizeof(text), "%a %b %d %H:%M:%S %Y", &local);
+        return text;
+    }
+    
+    void displayBookingDetails(const Catalog& catalog) const {
+        cout << "\n=== BOOKING CONFIRMATION ===" << endl;
+        cout << "Booking ID: " << bookingId << endl;
+        cout << "Booking Time: " << getBookingTime() << endl;
+        cout << "\nCustomer Details:" << endl;
+        catalog.getCustomer(customerId).displayInfo();
+        cout << "\nShow Details:" << endl;
+        catalog.getShow(showIndex).displayShowInfo();
+        cout << "\nBooked Seats:" << endl;
+        for(const auto& seat : bookedSeats) {
+            cout << "Seat " << seat.getSeatId() 
+                 << " (" << seat.getTypeString() << ") - Rs." 
+                 << formatRupees(seat.getPrice()) << endl;
+        }
+        cout << "\nTotal Amount: Rs." << formatRupees(getTotalAmount()) << endl;
+        cout << "=============================" << endl;
+    }
+    
+    void printReceipt(const Catalog& catalog, ostream& out = cout) const {
+        string text;
+        renderReceipt(catalog, text);
+        out << text << flush;
+    }
+    
+    // Appends the receipt text to out. Builds it with plain appends rather
+    // than stream formatting, so many receipts can be rendered into one
+    // buffer and written at once.
+    void renderReceipt(const Catalog& catalog, string& out) const {
+        const char* RULE = "________________________________________________\n";
+        const char* DASHES = "--------------------------------\n";
+        const char* STARS = "************************************************\n";
+        const Customer& customer = catalog.getCustomer(customerId);
+        const Show& show = catalog.getShow(showIndex);
+        const Movie& movie = show.getMovie();
+        
+        out += "\n";
+        out += STARS;
+        out += "*                                              *\n";
+        out += "*            CINEPLEX THEATER                  *\n";
+        out += "*              TICKET RECEIPT                  *\n";
+        out += "*                                              *\n";
+        out += STARS;
+        out += "\n";
+        
+        // Receipt Header
+        out += "Receipt No: " + to_string(bookingId) + "\n";
+        out += "Date & Time: " + getBookingTime() + "\n";
+        out += RULE;
+        out += "\n";
+        
+        // Customer Information
+        out += "CUSTOMER DETAILS:\n";
+        out += "Name        : " + customer.getName() + "\n";
+        out += "Phone       : " + customer.getPhone() + "\n";
+        out += "Email       : " + customer.getEmail() + "\n";
+        out += "Customer ID : " + to_string(customer.getCustomerId()) + "\n";
+        out += RULE;
+        out += "\n";
+        
+        // Movie & Show Information
+        out += "SHOW DETAILS:\n";
+        out += "Movie       : " + movie.getTitle() + "\n";
+        out += "Genre       : " + movie.getGenre() + "\n";
+        out += "Duration    : " + to_string(movie.getDuration()) + " mins\n";
+        out += "Rating      : " + movie.getRating() + "\n";
+        out += "Show Date   : " + show.getShowDate() + "\n";
+        out += "Show Time   : " + show.getShowTime() + "\n";
+        out += "Show ID     : " + to_string(show.getShowId()) + "\n";
+        out += RULE;
+        out += "\n";
+        
+        // Seat Details
+        out += "TICKET DETAILS:\n";
+        out += "Seat    Type        Price     \n";
+        out += DASHES;
+        for(const auto& seat : bookedSeats) {
+            char seatId[SeatCode::MAX_LENGTH];
+            int length = seat.formatSeatId(seatId);
+            out.append(seatId, length);
+            out.append(8 - length, ' ');
+            appendPadded(out, seat.getTypeString(), 12);
+            out += "Rs.";
+            appendPadded(out, formatRupees(seat.getPrice()), 7);
+            out += "\n";
+        }
+        
+        out += DASHES;
+        out += "Number of Tickets: " + to_string(bookedSeats.size()) + "\n";
+        out += "Subtotal         : Rs." + formatRupees(getSubtotal()) + "\n";
+        out += "Service Fee (2%) : Rs." + formatRupees(getServiceFee()) + "\n";
+        out += "GST (18%)        : Rs." + formatRupees(getGst()) + "\n";
+        out += DASHES;
+        out += "TOTAL AMOUNT     : Rs." + formatRupees(getTotalAmount()) + "\n";
+        out += "================================\n";
+        out += "\n";
+        
+        // Important Information
+        out += "IMPORTANT INFORMATION:\n";
+        out += "• Please arrive 15 minutes before show time\n";
+        out += "• Carry a valid ID proof\n";
+        out += "• Outside food & beverages not allowed\n";
+        out += "• Cancellations are refunded in full\n";
+        out += "• Keep this receipt for entry\n";
+        out += "\n";
+        
+        // Footer
+        out += STARS;
+        out += "*     Thank you for choosing Cineplex!        *\n";
+        out += "*        Have a great movie experience!        *\n";
+        out += STARS;
+        out += "\n";
+    }
+    
+private:
+    static void appendPadded(string& out, const string& text, size_t width) {
+        out += text;
+        if(text.size() < width) out.append(width - text.size(), ' ');
+    }
+};
+
+// Background receipt writer. Booking threads only queue pointers to the
+// committed booking and its catalog; one renderer thread formats everything queued into a
+// reused buffer and writes it in as few calls as possible, so receipt I/O
+// never sits on the booking path. Queued bookings must stay alive until
+// the pipeline is closed (the booking store never frees them).
+class ReceiptPipeline {
+private:
+    static const size_t BUFFER_BYTES = 256 * 1024;
+    
+    FILE* out;
+    bool ownsFile;
+    mutex lock;
+    condition_variable wake;
+    struct Job {
+        const Booking* booking;
+        const Catalog* catalog;
+    };
+    
+    vector<Job> pending; // filled by booking threads
+    vector<Job> batch;   // being rendered; swapped with pending
+    bool stopping;
+    thread renderer;
+    string buffer;
+    atomic<long long> rendered, batches, bytesWritten;
+    atomic<bool> writeFailed;
+    
+    void flushBuffer() {
+        if(buffer.empty()) return;
+        if(fwrite(buffer.data(), 1, buffer.size(), out) != buffer.size()) writeFailed = true;
+        bytesWritten.fetch_add(buffer.size(), memory_order_relaxed);
+        buffer.clear();
+    }
+    
+    void renderLoop() {
+        unique_lock<mutex> guard(lock);
+        while(true) {
+            wake.wait(guard, [this]() { return stopping || !pending.empty(); });
+            if(pending.empty()) break; // stopping, and everything is written
+            batch.swap(pending);
+            guard.unlock();
+            
+            for(const Job& job : batch) {
+                job.booking->renderReceipt(*job.catalog, buffer);
+                if(buffer.size() >= BUFFER_BYTES) flushBuffer();
+            }
+            flushBuffer();
+            if(fflush(out) != 0) writeFailed = true;
+            rendered.fetch_add(batch.size(), memory_order_relaxed);
+            batches.fetch_add(1, memory_order_relaxed);
+            batch.clear();
+            
+            guard.lock();
+        }
+    }
+    
+public:
+    ReceiptPipeline()
+        : out(nullptr), ownsFile(false), stopping(false),
+          rendered(0), batches(0), bytesWritten(0), writeFailed(false) {}
+    
+    ~ReceiptPipeline() { close(); }
+    
+    ReceiptPipeline(const ReceiptPipeline&) = delete;
+    ReceiptPipeline& operator=(const ReceiptPipeline&) = delete;
+    
+    // Appends receipts to a file, or to stdout for "-"
+    bool open(const string& path) {
+        return open(path == "-" ? stdout : fopen(path.c_str(), "ab"), path != "-");
+    }
+    
+    bool open(FILE* file, bool closeWhenDone) {
+        if(!file || renderer.joinable()) return false;
+        out = file;
+        ownsFile = closeWhenDone;
+        buffer.reserve(BUFFER_BYTES + 4096);
+        pending.reserve(1024);
+        batch.reserve(1024);
+        renderer = thread(&ReceiptPipeline::renderLoop, this);
+        return true;
+    }
+    
+    void submit(const Booking& booking, const Catalog& catalog) {
+        lock_guard<mutex> guard(lock);
+        pending.push_back({&booking, &catalog});
+        if(pending.size() == 1) wake.notify_one(); // renderer may be asleep
+    }
+    
+    // Writes everything still queued, then stops the renderer
+    void close() {
+        if(!renderer.joinable()) return;
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        renderer.join();
+        if(ownsFile) fclose(out);
+        out = nullptr;
+    }
+    
+    long long getRenderedCount() const { return rendered.load(memory_order_relaxed); }
+    long long getBatchCount() const { return batches.load(memory_order_relaxed); }
+    long long getBytesWritten() const { return bytesWritten.load(memory_order_relaxed); }
+    bool hasFailed() const { return writeFailed.load(); }
+};
+
+// Append-only booking store. Slots never move once written, so booking
+// threads only share one counter and readers never take a lock. Slots
+// below the snapshot boundary are backed by a loaded snapshot and are only
+// turned into Booking objects the first time someone reads them.
+//
+// A cancelled booking stays in its slot as a tombstone: the slot records
+// when it was cancelled, so booking ids and customer links stay valid and
+// cancelling never moves or frees anything.
+class BookingStore {
+public:
+    // Builds the booking for a snapshot-backed slot in place; returns false
+    // if the snapshot has no booking in that slot
+    typedef function<bool(int index, void* storage)> SnapshotLoader;
+    
+    enum class SlotState : uint8_t {
+        EMPTY,
+        LOADING,
+        READY
+    };
+    
+    // Commit version of a booking or cancellation that has not happened
+    static constexpr uint64_t NEVER = UINT64_MAX;
+    
+private:
+    static const int SEGMENT_BITS = 12;
+    static const int SEGMENT_SIZE = 1 << SEGMENT_BITS;
+    static const int MAX_SEGMENTS = 4096;
+    
+    static const int64_t CANCELLING = -1;
+    
+    struct Slot {
+        atomic<SlotState> state{SlotState::EMPTY};
+        atomic<int64_t> cancelledAt{0}; // 0 while live, CANCELLING while a cancel is in progress
+        atomic<uint64_t> bookedVersion{0}, cancelledVersion{0}; // 0 until stamped
+        alignas(Booking) unsigned char storage[sizeof(Booking)];
+        
+        const Booking* get() const { return reinterpret_cast<const Booking*>(storage); }
+    };
+    
+    unique_ptr<atomic<Slot*>[]> segments;
+    atomic<int> reserved;
+    atomic<uint64_t> version; // the commit clock
+    int snapshotCount;
+    SnapshotLoader loader;
+    
+    Slot* slotAt(int index) const {
+        Slot* segment = segments[index >> SEGMENT_BITS].load(memory_order_acquire);
+        return segment ? &segment[index & (SEGMENT_SIZE - 1)] : nullptr;
+    }
+    
+    Slot* ensureSlot(int index) const {
+        atomic<Slot*>& segment = segments[index >> SEGMENT_BITS];
+        Slot* current = segment.load(memory_order_acquire);
+        if(!current) {
+            Slot* fresh = new Slot[SEGMENT_SIZE];
+            if(segment.compare_exchange_strong(current, fresh, memory_order_acq_rel)) {
+                current = fresh;
+            } else {
+                delete[] fresh;
+            }
+        }
+        return &current[index & (SEGMENT_SIZE - 1)];
+    }
+    
+    // Materializes a snapshot-backed slot; concurrent readers wait for the winner
+    const Booking* load(int index) const {
+        Slot* slot = ensureSlot(index);
+        SlotState state = SlotState::EMPTY;
+        if(slot->state.compare_exchange_strong(state, SlotState::LOADING, memory_order_acquire)) {
+            bool loaded = loader(index, slot->storage);
+            slot->state.store(loaded ? SlotState::READY : SlotState::EMPTY, memory_order_release);
+            return loaded ? slot->get() : nullptr;
+        }
+        while(state == SlotState::LOADING) {
+            this_thread::yield();
+            state = slot->state.load(memory_order_acquire);
+        }
+        return state == SlotState::READY ? slot->get() : nullptr;
+    }
+    
+public:
+    BookingStore() : segments(new atomic<Slot*>[MAX_SEGMENTS]), reserved(0), version(0), snapshotCount(0) {
+        for(int i = 0; i < MAX_SEGMENTS; i++) {
+            segments[i].store(nullptr, memory_order_relaxed);
+        }
+    }
+    
+    ~BookingStore() {
+        for(int i = 0; i < MAX_SEGMENTS; i++) {
+            Slot* segment = segments[i].load(memory_order_relaxed);
+            if(!segment) continue;
+            for(int j = 0; j < SEGMENT_SIZE; j++) {
+                if(segment[j].state.load(memory_order_relaxed) == SlotState::READY) {
+                    segment[j].get()->~Booking();
+                }
+            }
+            delete[] segment;
+        }
+    }
+    
+    BookingStore(const BookingStore&) = delete;
+    BookingStore& operator=(const BookingStore&) = delete;
+    
+    static int capacity() { return SEGMENT_SIZE * MAX_SEGMENTS; }
+    
+    // Serves slots [0, count) from a snapshot; only before booking starts
+    void attachSnapshot(int count, SnapshotLoader snapshotLoader) {
+        snapshotCount = min(count, capacity());
+        loader = snapshotLoader;
+        if(snapshotCount > reserved.load(memory_order_relaxed)) {
+            reserved.store(snapshotCount, memory_order_relaxed);
+        }
+    }
+    
+    int getSnapshotCount() const { return snapshotCount; }
+    
+    // Allocates the segments for slots [0, count) up front, so booking
+    // threads never allocate while claiming slots
+    void preallocate(int count) {
+        count = min(count, capacity());
+        for(int index = 0; index < count; index += SEGMENT_SIZE) ensureSlot(index);
+    }
+    
+    // Reserves the next slot; returns -1 once the store is full
+    int reserve() {
+        int index = reserved.fetch_add(1, memory_order_relaxed);
+        if(index >= capacity()) {
+            reserved.fetch_sub(1, memory_order_relaxed);
+            return -1;
+        }
+        ensureSlot(index);
+        return index;
+    }
+    
+    // Reserves a specific slot; only for single-threaded recovery
+    bool reserveAt(int index) {
+        if(index < 0 || index >= capacity() || get(index)) return false;
+        if(index >= reserved.load(memory_order_relaxed)) {
+            reserved.store(index + 1, memory_order_relaxed);
+        }
+        ensureSlot(index);
+        return true;
+    }
+    
+    // Constructs the booking in its reserved slot and makes it visible to
+    // readers, then stamps it with the next commit version
+    const Booking& publish(int index, Booking&& booking) {
+        Slot* slot = slotAt(index);
+        new (slot->storage) Booking(move(booking));
+        slot->state.store(SlotState::READY, memory_order_release);
+        slot->bookedVersion.store(version.fetch_add(1, memory_order_acq_rel) + 1, memory_order_release);
+        return *slot->get();
+    }
+    
+    // The commit clock. Every booking and cancellation takes the next
+    // version only once it is visible, so a reader that takes the version
+    // first finds everything stamped at or before it already in place.
+    uint64_t getVersion() const { return version.load(memory_order_acquire); }
+    
+    // Moves the clock on without a commit and returns the new version. A
+    // reader that takes this version or a later one sees everything the
+    // caller did before.
+    uint64_t advanceVersion() { return version.fetch_add(1, memory_order_acq_rel) + 1; }
+    
+    // Version the slot's booking was committed at: 0 for bookings served
+    // from the snapshot, NEVER if it is not published. Waits out a commit
+    // that is visible but not yet stamped.
+    uint64_t getBookedVersion(int index) const {
+        Slot* slot = slotAt(index);
+        if(!slot || slot->state.load(memory_order_acquire) != SlotState::READY) {
+            return index < snapshotCount ? 0 : NEVER;
+        }
+        uint64_t stamped = slot->bookedVersion.load(memory_order_acquire);
+        while(stamped == 0 && index >= snapshotCount) {
+            this_thread::yield();
+            stamped = slot->bookedVersion.load(memory_order_acquire);
+        }
+        return stamped;
+    }
+    
+    // Version the slot's booking was cancelled at, or NEVER if it is live
+    // or its cancellation is still in progress
+    uint64_t getCancelledVersion(int index) const {
+        Slot* slot = slotAt(index);
+        if(!slot || slot->cancelledAt.load(memory_order_acquire) <= 0) return NEVER;
+        uint64_t stamped = slot->cancelledVersion.load(memory_order_acquire);
+        while(stamped == 0) {
+            this_thread::yield();
+            stamped = slot->cancelledVersion.load(memory_order_acquire);
+        }
+        return stamped;
+    }
+    
+    // Returns nullptr for slots that are out of range or not yet published
+    const Booking* get(int index) const {
+        if(index < 0 || index >= size()) return nullptr;
+        Slot* slot = slotAt(index);
+        if(slot && slot->state.load(memory_order_acquire) == SlotState::READY) return slot->get();
+        if(index < snapshotCount) return load(index);
+        return nullptr;
+    }
+    
+    // Like get, but never materializes a snapshot-backed slot; returns
+    // nullptr with fromSnapshot set if the slot is still only in the snapshot
+    const Booking* peek(int index, bool& fromSnapshot) const {
+        fromSnapshot = false;
+        Slot* slot = slotAt(index);
+        if(slot) {
+            SlotState state = slot->state.load(memory_order_acquire);
+            while(state == SlotState::LOADING) {
+                this_thread::yield();
+                state = slot->state.load(memory_order_acquire);
+            }
+            if(state == SlotState::READY) return slot->get();
+        }
+        fromSnapshot = index < snapshotCount;
+        return nullptr;
+    }
+    
+    // Claims a booking for cancellation; false if it is already cancelled
+    // or being cancelled. The claim ends with finishCancel or abortCancel.
+    bool beginCancel(int index) {
+        if(index < 0 || index >= size()) return false;
+        int64_t live = 0;
+        return ensureSlot(index)->cancelledAt.compare_exchange_strong(live, CANCELLING, memory_order_acq_rel);
+    }
+    
+    void finishCancel(int index, time_t at) {
+        Slot* slot = slotAt(index);
+        slot->cancelledAt.store(max<int64_t>(at, 1), memory_order_release);
+        slot->cancelledVersion.store(version.fetch_add(1, memory_order_acq_rel) + 1, memory_order_release);
+    }
+    
+    void abortCancel(int index) {
+        slotAt(index)->cancelledAt.store(0, memory_order_release);
+    }
+    
+    // When the booking in this slot was cancelled, or 0 if it is live
+    time_t getCancelledAt(int index) const {
+        Slot* slot = index >= 0 && index < size() ? slotAt(index) : nullptr;
+        int64_t at = slot ? slot->cancelledAt.load(memory_order_acquire) : 0;
+        return at > 0 ? time_t(at) : 0;
+    }
+    
+    int size() const { return min(reserved.load(memory_order_acquire), capacity()); }
+    
+    template<typename Fn>
+    void forEach(Fn fn) const {
+        int count = size();
+        for(int i = 0; i < count; i++) {
+            if(const Booking* booking = get(i)) fn(*booking);
+        }
+    }
+};
+
+// The read views open right now, each with the commit version it reads
+// at, so writers know which earlier states a view may still ask for. A
+// view holds an entry while it is open; if all are taken, the next view
+// waits for one to close.
+class ReadViewRegistry {
+public:
+    static constexpr uint64_t NONE = UINT64_MAX; // a free entry, or no view open
+    
+private:
+    static const int ENTRIES = 64;
+    
+    atomic<uint64_t> versions[ENTRIES];
+    atomic<int> used; // entries ever taken; only these are scanned
+    
+public:
+    ReadViewRegistry() : used(0) {
+        for(auto& version : versions) version.store(NONE, memory_order_relaxed);
+    }
+    
+    // Takes an entry for a view that has yet to read the clock; until it
+    // does, the entry reads as older than any version
+    int open() {
+        while(true) {
+            for(int i = 0; i < ENTRIES; i++) {
+                uint64_t free = NONE;
+                if(!versions[i].compare_exchange_strong(free, 0, memory_order_relaxed)) continue;
+                int seen = used.load(memory_order_relaxed);
+                while(seen <= i && !used.compare_exchange_weak(seen, i + 1, memory_order_relaxed)) {}
+                return i;
+            }
+            this_thread::yield();
+        }
+    }
+    
+    void setVersion(int entry, uint64_t version) { versions[entry].store(version, memory_order_release); }
+    void close(int entry) { versions[entry].store(NONE, memory_order_release); }
+    
+    // Version of the oldest open view, or NONE
+    uint64_t getOldest() const {
+        uint64_t oldest = NONE;
+        int count = used.load(memory_order_acquire);
+        for(int i = 0; i < count; i++) oldest = min(oldest, versions[i].load(memory_order_acquire));
+        return oldest;
+    }
+};
+
+// Seat changes of one show that a read view may not see yet: each record
+// names a booking slot and the seats it took, or is giving back if it is a
+// cancellation still under way. Readers walk the records, newest first,
+// without a lock; writers link and drop them under the log's lock.
+//
+// A record is dropped once every view, open or still to come, reads its
+// seats the same without it, and reused once no open view can be reading
+// it. With no views open that is soon after its booking commits, so the
+// log holds little more than the bookings in flight.
+//
+// Records stay in the order they were linked, which is close to the order
+// their bookings commit, and are dropped oldest first up to the first one
+// still needed; dropped records are reused in the order they were dropped.
+// While a view stays open the log is only trimmed again once it has
+// doubled, so a view held for long costs each booking a constant amount.
+class SeatChangeLog {
+public:
+    struct Change {
+        int slot = -1;
+        int count = 0;
+        uint16_t rows[SeatList::CAPACITY], cols[SeatList::CAPACITY];
+        bool cancellation = false;     // the seats a cancellation gives back, not a booking's
+        atomic<bool> freeing{false}; // a cancellation whose seats are still BOOKED
+        atomic<Change*> next{nullptr}; // the next older record
+        Change* newer = nullptr;       // the next newer record; writers only
+        Change* spareLink = nullptr;   // dropped and free records, kept apart from next
+        uint64_t reusableFrom = 0;    // dropped: views from this version on cannot reach it; 0 until known
+    };
+    
+private:
+    static constexpr int MIN_TRIM = 64; // records linked before trimming again while a view is open
+    
+    mutex lock;
+    atomic<Change*> head;
+    Change* last; // the oldest linked record
+    Change* dropped; // unlinked, oldest first, but open views may still be reading them
+    Change* droppedLast;
+    Change* spare;
+    int linked;
+    int trimAt; // records linked when a view still open at the last trim lets it run again
+    uint64_t trimmedFor; // the oldest open view at the last trim
+    deque<Change> records; // owns every record; only grows
+    
+    // Whether views from `oldest` on read the record's seats the same
+    // without it: it was cancelled by then, or is a booking's and booked by
+    // then. A later cancellation logs the seats again, so a booking's
+    // record once droppable stays so and the oldest first order holds.
+    static bool canDrop(const Change& change, const BookingStore& bookings, uint64_t oldest) {
+        if(change.freeing.load(memory_order_relaxed)) return false;
+        if(bookings.getCancelledVersion(change.slot) <= oldest) return true;
+        return !change.cancellation && bookings.getBookedVersion(change.slot) <= oldest;
+    }
+    
+    // Frees the dropped records no open view can reach, then drops the
+    // records no view needs; caller holds the lock. Moving the clock on
+    // first means a view that missed the registry scan reads at this
+    // version or later, and sees every record unlinked before.
+    void trim(BookingStore& bookings, const ReadViewRegistry& views) {
+        uint64_t now = bookings.advanceVersion();
+        atomic_thread_fence(memory_order_seq_cst);
+        uint64_t oldestOpen = views.getOldest();
+        
+        // Records dropped later are reusable from a later version
+        while(dropped) {
+            if(!dropped->reusableFrom) dropped->reusableFrom = now;
+            if(dropped->reusableFrom > oldestOpen) break;
+            Change* change = dropped;
+            dropped = change->spareLink;
+            change->spareLink = spare;
+            spare = change;
+        }
+        if(!dropped) droppedLast = nullptr;
+        
+        uint64_t oldest = min(now, oldestOpen);
+        while(last && canDrop(*last, bookings, oldest)) unlink(last);
+        trimmedFor = oldestOpen;
+        trimAt = max(2 * linked, MIN_TRIM);
+    }
+    
+    // Takes a record off the list; readers on it still find the rest
+    void unlink(Change* change) {
+        Change* next = change->next.load(memory_order_relaxed);
+        if(change->newer) change->newer->next.store(next, memory_order_release);
+        else head.store(next, memory_order_release);
+        if(next) next->newer = change->newer;
+        else last = change->newer;
+        linked--;
+        change->reusableFrom = 0;
+        change->spareLink = nullptr;
+        if(droppedLast) droppedLast->spareLink = change;
+        else dropped = change;
+        droppedLast = change;
+    }
+    
+    // Whether to trim before taking a record: always with no view open,
+    // since trimming stops at the first record still needed; with one
+    // open, once it has moved on or the log has doubled
+    bool shouldTrim(const ReadViewRegistry& views) const {
+        if(linked >= trimAt) return true;
+        uint64_t oldestOpen = views.getOldest();
+        return oldestOpen == ReadViewRegistry::NONE || oldestOpen != trimmedFor;
+    }
+    
+public:
+    SeatChangeLog()
+        : head(nullptr), last(nullptr), dropped(nullptr), droppedLast(nullptr), spare(nullptr),
+          linked(0), trimAt(MIN_TRIM), trimmedFor(ReadViewRegistry::NONE) {}
+    
+    SeatChangeLog(const SeatChangeLog&) = delete;
+    SeatChangeLog& operator=(const SeatChangeLog&) = delete;
+    
+    // Links a record of the seats the booking in a slot took, or is
+    // freeing. Records are reused once the show has some to spare, so
+    // steady booking allocates none.
+    Change* add(int slot, const SeatList& seats, bool freeing, BookingStore& bookings,
+                const ReadViewRegistry& views) {
+        lock_guard<mutex> guard(lock);
+        if(!spare && shouldTrim(views)) trim(bookings, views);
+        Change* change = spare;
+        if(change) {
+            spare = change->spareLink;
+        } else {
+            records.emplace_back();
+            change = &records.back();
+        }
+        change->slot = slot;
+        change->count = seats.size();
+        for(int k = 0; k < seats.size(); k++) {
+            change->rows[k] = uint16_t(seats[k].getRow());
+            change->cols[k] = uint16_t(seats[k].getCol());
+        }
+        change->cancellation = freeing;
+        change->freeing.store(freeing, memory_order_relaxed);
+        Change* first = head.load(memory_order_relaxed);
+        change->next.store(first, memory_order_relaxed);
+        change->newer = nullptr;
+        if(first) first->newer = change;
+        else last = change;
+        head.store(change, memory_order_release);
+        linked++;
+        return change;
+    }
+    
+    // Drops the record of a booking whose seats were given back before it
+    // committed; trim never drops a booking in flight, so it is still linked
+    void remove(Change* change) {
+        lock_guard<mutex> guard(lock);
+        unlink(change);
+    }
+    
+    // A cancellation's seats are free in the seat map now
+    void finishFreeing(Change* change) { change->freeing.store(false, memory_order_release); }
+    
+    template<typename Fn>
+    void forEach(Fn fn) const {
+        for(const Change* change = head.load(memory_order_acquire); change;
+            change = change->next.load(memory_order_acquire)) {
+            fn(*change);
+        }
+    }
+};
+
+// Customer directory: hands out collision-free customer ids and indexes
+// each customer's bookings by phone and by email. A customer is matched by
+// phone first, then by email. Keys are spread over lock-striped shards, so
+// registrations and lookups for different customers rarely share a lock.
+// The customers themselves live in the Catalog.
+//
+// A customer's bookings are chained through a table indexed by booking
+// slot, holding the same customer's previous slot, so indexing a booking
+// writes one int instead of growing a list per customer.
+class CustomerDirectory {
+private:
+    static const int SHARDS = 64;
+    static const int LINK_SEGMENT_BITS = 12;
+    static const int LINK_SEGMENT_SIZE = 1 << LINK_SEGMENT_BITS;
+    
+    struct Entry {
+        const Customer& customer;
+        mutex lock;
+        int lastSlot; // newest booking handle into the BookingStore, or -1
+        
+        explicit Entry(const Customer& c) : customer(c), lastSlot(-1) {}
+    };
+    
+    template<typename Key>
+    struct Shard {
+        mutex lock;
+        unordered_map<Key, Entry*> entries;
+    };
+    
+    Shard<string> phoneShards[SHARDS];
+    Shard<string> emailShards[SHARDS];
+    Shard<int> idShards[SHARDS];
+    Catalog& catalog;
+    mutex entriesLock;
+    deque<Entry> entries; // owns every entry; only grows
+    atomic<int> nextCustomerId;
+    int linkSegmentCount;
+    unique_ptr<atomic<int*>[]> linkSegments; // per slot: previous slot of the same customer
+    
+    // Customers of a loaded snapshot are indexed on first use, so startup
+    // does not pay for it
+    function<void()> backlog;
+    once_flag backlogOnce;
+    
+    template<typename Key>
+    static Shard<Key>& shardFor(Shard<Key>* shards, const Key& key) {
+        return shards[hash<Key>()(key) % SHARDS];
+    }
+    
+    template<typename Key>
+    static Entry* lookup(Shard<Key>* shards, const Key& key) {
+        Shard<Key>& shard = shardFor(shards, key);
+        lock_guard<mutex> guard(shard.lock);
+        auto it = shard.entries.find(key);
+        return it == shard.entries.end() ? nullptr : it->second;
+    }
+    
+    // Maps key to entry unless the key is taken; returns the entry that owns it
+    template<typename Key>
+    static Entry* insert(Shard<Key>* shards, const Key& key, Entry* entry) {
+        Shard<Key>& shard = shardFor(shards, key);
+        lock_guard<mutex> guard(shard.lock);
+        return shard.entries.emplace(key, entry).first->second;
+    }
+    
+    Entry* createEntry(const Customer& customer) {
+        const Customer& stored = catalog.addCustomer(customer);
+        lock_guard<mutex> guard(entriesLock);
+        entries.emplace_back(stored);
+        return &entries.back();
+    }
+    
+    // Returns the entry owning key, creating one for the customer if there
+    // is none. The check and the creation share the key's shard lock, so
+    // racing registrations of one customer end up with a single entry.
+    template<typename Key>
+    Entry* claim(Shard<Key>* shards, const Key& key, const Customer& customer) {
+        Shard<Key>& shard = shardFor(shards, key);
+        lock_guard<mutex> guard(shard.lock);
+        auto it = shard.entries.find(key);
+        if(it != shard.entries.end()) return it->second;
+        Entry* created = createEntry(customer);
+        shard.entries.emplace(key, created);
+        insert(idShards, customer.getCustomerId(), created);
+        return created;
+    }
+    
+    int* linkFor(int slot) {
+        atomic<int*>& segment = linkSegments[slot >> LINK_SEGMENT_BITS];
+        int* current = segment.load(memory_order_acquire);
+        if(!current) {
+            int* fresh = new int[LINK_SEGMENT_SIZE];
+            if(segment.compare_exchange_strong(current, fresh, memory_order_acq_rel)) {
+                current = fresh;
+            } else {
+                delete[] fresh;
+            }
+        }
+        return &current[slot & (LINK_SEGMENT_SIZE - 1)];
+    }
+    
+    void ensureBacklog() {
+        call_once(backlogOnce, [this] {
+            if(backlog) backlog();
+        });
+    }
+    
+    // Finds or creates the entry for a customer; a new entry keeps the
+    // given customer as is, including its id
+    Entry* findOrCreate(const Customer& customer) {
+        string email = normalizeEmail(customer.getEmail());
+        Entry* entry = nullptr;
+        if(!customer.getPhone().empty()) entry = lookup(phoneShards, customer.getPhone());
+        if(!entry && !email.empty()) entry = lookup(emailShards, email);
+        if(!entry) {
+            // The phone shard decides races between two new registrations,
+            // or the email shard for a customer without a phone
+            if(!customer.getPhone().empty()) {
+                entry = claim(phoneShards, customer.getPhone(), customer);
+            } else if(!email.empty()) {
+                return claim(emailShards, email, customer);
+            } else {
+                entry = createEntry(customer);
+                insert(idShards, customer.getCustomerId(), entry);
+                return entry;
+            }
+        }
+        if(!customer.getPhone().empty()) insert(phoneShards, customer.getPhone(), entry);
+        if(!email.empty()) insert(emailShards, email, entry);
+        return entry;
+    }
+    
+public:
+    static const int FIRST_CUSTOMER_ID = 1;
+    
+    explicit CustomerDirectory(Catalog& c)
+        : catalog(c), nextCustomerId(FIRST_CUSTOMER_ID),
+          linkSegmentCount(BookingStore::capacity() / LINK_SEGMENT_SIZE),
+          linkSegments(new atomic<int*>[linkSegmentCount]) {
+        for(int i = 0; i < linkSegmentCount; i++) {
+            linkSegments[i].store(nullptr, memory_order_relaxed);
+        }
+    }
+    
+    ~CustomerDirectory() {
+        for(int i = 0; i < linkSegmentCount; i++) {
+            delete[] linkSegments[i].load(memory_order_relaxed);
+        }
+    }
+    
+    CustomerDirectory(const CustomerDirectory&) = delete;
+    CustomerDirectory& operator=(const CustomerDirectory&) = delete;
+    
+    static string normalizeEmail(const string& email) {
+        string normalized = email;
+        transform(normalized.begin(), normalized.end(), normalized.begin(), ::tolower);
+        return normalized;
+    }
+    
+    void setBacklog(function<void()> loader) { backlog = loader; }
+    
+    // Allocates link space for booking slots [0, count) ahead of time
+    void preallocate(int count) {
+        count = min(count, BookingStore::capacity());
+        for(int slot = 0; slot < count; slot += LINK_SEGMENT_SIZE) linkFor(slot);
+    }
+    
+    // Returns the existing customer with this phone or email, or registers
+    // a new one with a fresh id
+    const Customer& registerCustomer(const string& name, const string& phone, const string& email) {
+        ensureBacklog();
+        string normalized = normalizeEmail(email);
+        Entry* entry = nullptr;
+        if(!phone.empty()) entry = lookup(phoneShards, phone);
+        if(!entry && !normalized.empty()) entry = lookup(emailShards, normalized);
+        if(!entry) {
+            int id = nextCustomerId.fetch_add(1, memory_order_relaxed);
+            entry = findOrCreate(Customer(name, phone, email, id));
+        } else if(!phone.empty()) {
+            insert(phoneShards, phone, entry); // known by email, new phone
+        }
+        return entry->customer;
+    }
+    
+    // Indexes a committed booking under its customer. Customers restored
+    // from disk keep their saved id and move the id counter past it.
+    void addBooking(const Customer& customer, int slot) {
+        ensureBacklog();
+        restoreCustomerBooking(customer, slot);
+    }
+    
+    // Same as addBooking without waiting for the snapshot backlog; used
+    // while the backlog itself is being indexed
+    void restoreCustomerBooking(const Customer& customer, int slot) {
+        int id = customer.getCustomerId();
+        int next = nextCustomerId.load(memory_order_relaxed);
+        while(id >= next && !nextCustomerId.compare_exchange_weak(next, id + 1, memory_order_relaxed)) {}
+        
+        Entry* entry = lookup(idShards, id);
+        if(!entry || entry->customer.getPhone() != customer.getPhone()) entry = findOrCreate(customer);
+        int* link = linkFor(slot);
+        lock_guard<mutex> guard(entry->lock);
+        *link = entry->lastSlot;
+        entry->lastSlot = slot;
+    }
+    
+    // Booking handles of the customer with this phone or email
+    vector<int> findBookingSlots(const string& phoneOrEmail) {
+        ensureBacklog();
+        Entry* entry = lookup(phoneShards, phoneOrEmail);
+        if(!entry) entry = lookup(emailShards, normalizeEmail(phoneOrEmail));
+        if(!entry) return {};
+        vector<int> slots;
+        lock_guard<mutex> guard(entry->lock);
+        for(int slot = entry->lastSlot; slot >= 0; slot = *linkFor(slot)) {
+            slots.push_back(slot);
+        }
+        reverse(slots.begin(), slots.end());
+        return slots;
+    }
+    
+    int getCustomerCount() {
+        lock_guard<mutex> guard(entriesLock);
+        return entries.size();
+    }
+};
+
+// A committed booking as stored in the journal, or the cancellation of
+// one (cancelledAt set, and only bookingId besides)
+struct JournalBooking {
+    struct SeatEntry {
+        int row, col;
+        Paise price;
+    };
+    
+    int bookingId;
+    int showId;
+    int customerId;
+    long long bookedAt;
+    long long cancelledAt;
+    string name, phone, email;
+    vector<SeatEntry> seats;
+};
+
+// Append-only booking journal (write-ahead log). Each record is
+//   [u32 payload length][u32 FNV-1a checksum][payload]
+// in host byte order after an 8-byte file header. Commits use group commit:
+// the first waiting thread writes and fsyncs everything appended so far, so
+// concurrent bookings share one fsync instead of paying one each.
+//
+// A snapshot rotates the journal: the current file is renamed to
+// "<path>.old" and a fresh one is started; once the snapshot is safely on
+// disk the old file is deleted.
+class BookingJournal {
+private:
+    static const char* const MAGIC;
+    static const size_t HEADER_SIZE = 8;
+    static const size_t RECORD_HEADER_SIZE = 8;
+    static const uint8_t RECORD_BOOKING = 1; // seat prices in paise
+    static const uint8_t RECORD_CANCEL = 2;
+    
+    int fd;
+    string path;
+    mutex lock;
+    condition_variable flushed;
+    string pending;   // encoded records not yet handed to a flush
+    string writing;   // batch currently being written by the leader
+    uint64_t appendedLsn, durableLsn;
+    bool flushing, failed;
+    int generation; // bumped on every rotation
+    atomic<int> inFlight[2]; // commits appended but not yet finished, by generation parity
+    atomic<uint64_t> fsyncCount, recordCount;
+    
+    static uint32_t checksum(const char* data, size_t len) {
+        uint32_t hash = 2166136261u;
+        for(size_t i = 0; i < len; i++) {
+            hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+        }
+        return hash;
+    }
+    
+    template<typename T>
+    static void put(string& out, T value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    
+    static void putString(string& out, const string& value) {
+        put<uint16_t>(out, uint16_t(min<size_t>(value.size(), UINT16_MAX)));
+        out.append(value, 0, min<size_t>(value.size(), UINT16_MAX));
+    }
+    
+    // Bounds-checked reader over one record payload
+    struct Reader {
+        const char* pos;
+        const char* end;
+        
+        template<typename T>
+        bool get(T& value) {
+            if(size_t(end - pos) < sizeof(T)) return false;
+            memcpy(&value, pos, sizeof(T));
+            pos += sizeof(T);
+            return true;
+        }
+        
+        bool getString(string& value) {
+            uint16_t len;
+            if(!get(len) || size_t(end - pos) < len) return false;
+            value.assign(pos, len);
+            pos += len;
+            return true;
+        }
+    };
+    
+    static bool decode(const char* data, size_t len, JournalBooking& entry) {
+        Reader in = {data, data + len};
+        uint8_t type, seatCount;
+        int32_t bookingId, showId, customerId;
+        int64_t bookedAt, cancelledAt;
+        if(!in.get(type)) return false;
+        if(type == RECORD_CANCEL) {
+            if(!in.get(bookingId) || !in.get(cancelledAt) || cancelledAt <= 0) return false;
+            entry = JournalBooking();
+            entry.bookingId = bookingId;
+            entry.cancelledAt = cancelledAt;
+            return in.pos == in.end;
+        }
+        if(type != RECORD_BOOKING) return false;
+        if(!in.get(bookingId) || !in.get(showId) || !in.get(customerId) || !in.get(bookedAt)) return false;
+        if(!in.getString(entry.name) || !in.getString(entry.phone) || !in.getString(entry.email)) return false;
+        if(!in.get(seatCount)) return false;
+        entry.bookingId = bookingId;
+        entry.showId = showId;
+        entry.customerId = customerId;
+        entry.bookedAt = bookedAt;
+        entry.cancelledAt = 0;
+        entry.seats.resize(seatCount);
+        for(auto& seat : entry.seats) {
+            uint16_t row, col;
+            int64_t paise;
+            if(!in.get(row) || !in.get(col) || !in.get(paise)) return false;
+            seat.price = paise;
+            seat.row = row;
+            seat.col = col;
+        }
+        return in.pos == in.end;
+    }
+    
+    static bool fileExists(const string& name) {
+        struct stat info;
+        return stat(name.c_str(), &info) == 0;
+    }
+    
+    bool openFile() {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_BINARY, 0644);
+        if(fd < 0) return false;
+        struct stat info;
+        if(fstat(fd, &info) != 0) return false;
+        if(info.st_size == 0) {
+            if(!writeAll(fd, string(MAGIC, HEADER_SIZE)) || fsync(fd) != 0) return false;
+        }
+        return true;
+    }
+    
+    static bool writeAll(int fd, const string& data) {
+        size_t done = 0;
+        while(done < data.size()) {
+            auto written = ::write(fd, data.data() + done, data.size() - done);
+            if(written <= 0) return false;
+            done += written;
+        }
+        return true;
+    }
+    
+public:
+    BookingJournal()
+        : fd(-1), appendedLsn(0), durableLsn(0), flushing(false), failed(false),
+          generation(0), fsyncCount(0), recordCount(0) {
+        inFlight[0].store(0, memory_order_relaxed);
+        inFlight[1].store(0, memory_order_relaxed);
+    }
+    
+    ~BookingJournal() { close(); }
+    
+    BookingJournal(const BookingJournal&) = delete;
+    BookingJournal& operator=(const BookingJournal&) = delete;
+    
+    struct ReplayStats {
+        long long records;
+        long long bytes;
+        long long discardedBytes; // torn or corrupt tail cut off the log
+    };
+    
+    // Reads every intact record of a journal file in order. A torn or
+    // corrupt tail (e.g. from a crash mid-write) is cut off the file so new
+    // appends continue from the last good record.
+    template<typename Fn>
+    static bool replay(const string& path, Fn apply, ReplayStats& stats) {
+        stats = {0, 0, 0};
+        int in = ::open(path.c_str(), O_RDWR | O_BINARY);
+        if(in < 0) return errno == ENOENT; // no journal yet is not an error
+        
+        const size_t CHUNK = 1 << 20;
+        string buffer;
+        vector<char> chunk(CHUNK);
+        size_t parsed = 0;       // bytes of buffer already consumed
+        long long goodEnd = 0;   // file offset after the last intact record
+        bool headerChecked = false, corrupt = false;
+        JournalBooking entry;
+        
+        while(!corrupt) {
+            auto got = ::read(in, chunk.data(), CHUNK);
+            if(got <= 0) break;
+            buffer.erase(0, parsed);
+            parsed = 0;
+            buffer.append(chunk.data(), got);
+            stats.bytes += got;
+            
+            if(!headerChecked) {
+                if(buffer.size() < HEADER_SIZE) continue;
+                if(buffer.compare(0, HEADER_SIZE, MAGIC) != 0) {
+                    ::close(in);
+                    return false;
+                }
+                parsed = HEADER_SIZE;
+                goodEnd = HEADER_SIZE;
+                headerChecked = true;
+            }
+            
+            while(buffer.size() - parsed >= RECORD_HEADER_SIZE) {
+                uint32_t len, sum;
+                memcpy(&len, buffer.data() + parsed, 4);
+                memcpy(&sum, buffer.data() + parsed + 4, 4);
+                if(buffer.size() - parsed - RECORD_HEADER_SIZE < len) break;
+                const char* payload = buffer.data() + parsed + RECORD_HEADER_SIZE;
+                if(checksum(payload, len) != sum || !decode(payload, len, entry)) {
+                    corrupt = true;
+                    break;
+                }
+                apply(entry);
+                stats.records++;
+                parsed += RECORD_HEADER_SIZE + len;
+                goodEnd += RECORD_HEADER_SIZE + len;
+            }
+        }
+        
+        if(headerChecked && goodEnd < stats.bytes) {
+            stats.discardedBytes = stats.bytes - goodEnd;
+            if(ftruncate(in, goodEnd) != 0) {
+                ::close(in);
+                return false;
+            }
+        }
+        ::close(in);
+        return true;
+    }
+    
+    static string getRotatedPath(const string& path) { return path + ".old"; }
+    
+    // Opens (or creates) the journal for appending
+    bool open(const string& journalPath) {
+        close();
+        path = journalPath;
+        failed = false;
+        return openFile();
+    }
+    
+    void close() {
+        if(fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    
+    static void encode(const JournalBooking& entry, string& payload) {
+        payload.clear();
+        put<uint8_t>(payload, RECORD_BOOKING);
+        put<int32_t>(payload, entry.bookingId);
+        put<int32_t>(payload, entry.showId);
+        put<int32_t>(payload, entry.customerId);
+        put<int64_t>(payload, entry.bookedAt);
+        putString(payload, entry.name);
+        putString(payload, entry.phone);
+        putString(payload, entry.email);
+        put<uint8_t>(payload, uint8_t(entry.seats.size()));
+        for(const auto& seat : entry.seats) {
+            put<uint16_t>(payload, uint16_t(seat.row));
+            put<uint16_t>(payload, uint16_t(seat.col));
+            put<int64_t>(payload, seat.price);
+        }
+    }
+    
+    // Same record, encoded straight from a booking so the commit path does
+    // not build a JournalBooking first
+    static void encode(const Booking& booking, int showId, const Customer& customer, string& payload) {
+        payload.clear();
+        put<uint8_t>(payload, RECORD_BOOKING);
+        put<int32_t>(payload, booking.getBookingId());
+        put<int32_t>(payload, showId);
+        put<int32_t>(payload, customer.getCustomerId());
+        put<int64_t>(payload, (long long)booking.getBookedAt());
+        putString(payload, customer.getName());
+        putString(payload, customer.getPhone());
+        putString(payload, customer.getEmail());
+        put<uint8_t>(payload, uint8_t(booking.getBookedSeats().size()));
+        for(const Seat& seat : booking.getBookedSeats()) {
+            put<uint16_t>(payload, uint16_t(seat.getRow()));
+            put<uint16_t>(payload, uint16_t(seat.getCol()));
+            put<int64_t>(payload, seat.getPrice());
+        }
+    }
+    
+    static void encodeCancellation(int bookingId, time_t cancelledAt, string& payload) {
+        payload.clear();
+        put<uint8_t>(payload, RECORD_CANCEL);
+        put<int32_t>(payload, bookingId);
+        put<int64_t>(payload, (long long)cancelledAt);
+    }
+    
+    // Queues an encoded record; returns its log sequence number. When
+    // commitGeneration is given the caller is counted as in flight until it
+    // calls finishCommit, so a snapshot can wait for it.
+    uint64_t append(const string& payload, int* commitGeneration = nullptr) {
+        lock_guard<mutex> guard(lock);
+        put<uint32_t>(pending, uint32_t(payload.size()));
+        put<uint32_t>(pending, checksum(payload.data(), payload.size()));
+        pending += payload;
+        recordCount.fetch_add(1, memory_order_relaxed);
+        if(commitGeneration) {
+            *commitGeneration = generation;
+            inFlight[generation & 1].fetch_add(1, memory_order_relaxed);
+        }
+        return ++appendedLsn;
+    }
+    
+    void finishCommit(int commitGeneration) {
+        inFlight[commitGeneration & 1].fetch_sub(1, memory_order_release);
+    }
+    
+    // Flushes everything appended so far, moves the file aside as
+    // "<path>.old" and starts a new one. Returns the generation that wrote
+    // the old file, or -1 if an earlier rotated file was never cleaned up.
+    int rotate() {
+        unique_lock<mutex> guard(lock);
+        flushed.wait(guard, [this] { return !flushing; });
+        if(failed || fileExists(getRotatedPath(path))) return -1;
+        if(!pending.empty()) {
+            if(!writeAll(fd, pending) || fsync(fd) != 0) {
+                failed = true;
+                flushed.notify_all();
+                return -1;
+            }
+            fsyncCount.fetch_add(1, memory_order_relaxed);
+            pending.clear();
+        }
+        durableLsn = appendedLsn;
+        flushed.notify_all();
+        
+        close();
+        if(rename(path.c_str(), getRotatedPath(path).c_str()) != 0 || !openFile()) {
+            failed = true;
+            return -1;
+        }
+        return generation++;
+    }
+    
+    // Waits until every commit appended under this generation has finished
+    void waitForCommits(int oldGeneration) const {
+        while(inFlight[oldGeneration & 1].load(memory_order_acquire) > 0) {
+            this_thread::yield();
+        }
+    }
+    
+    // Deletes the rotated file once a snapshot covers it
+    bool dropRotated() {
+        return remove(getRotatedPath(path).c_str()) == 0;
+    }
+    
+    // Blocks until the record with this sequence number is on disk.
+    // Returns false if the journal could not be written.
+    bool waitDurable(uint64_t lsn) {
+        unique_lock<mutex> guard(lock);
+        while(durableLsn < lsn && !failed) {
+            if(flushing) {
+                flushed.wait(guard);
+                continue;
+            }
+            // Become the leader and flush everything appended so far
+            flushing = true;
+            writing.swap(pending);
+            uint64_t batchLsn = appendedLsn;
+            guard.unlock();
+            bool ok = writeAll(fd, writing) && fsync(fd) == 0;
+            guard.lock();
+            fsyncCount.fetch_add(1, memory_order_relaxed);
+            writing.clear();
+            flushing = false;
+            if(ok) durableLsn = batchLsn;
+            else failed = true;
+            flushed.notify_all();
+        }
+        return durableLsn >= lsn;
+    }
+    
+    uint64_t getFsyncCount() const { return fsyncCount.load(memory_order_relaxed); }
+    uint64_t getRecordCount() const { return recordCount.load(memory_order_relaxed); }
+};
+
+const char* const BookingJournal::MAGIC = "CINEWAL1";
+
+// Booking counters kept up to date on every commit and cancellation, so
+// statistics never rescan seats or bookings. Revenue is what customers
+// paid, fees and GST included, less refunds; bookings and seats count only
+// bookings that are still live.
+class BookingCounters {
+public:
+    static const int TIER_COUNT = 3; // indexed by SeatType
+    
+private:
+    atomic<long long> bookings;
+    atomic<long long> seats[TIER_COUNT];
+    atomic<Paise> revenue[TIER_COUNT];
+    atomic<long long> cancellations;
+    atomic<Paise> refunds;
+    
+public:
+    BookingCounters() : bookings(0), cancellations(0), refunds(0) {
+        for(int t = 0; t < TIER_COUNT; t++) {
+            seats[t].store(0, memory_order_relaxed);
+            revenue[t].store(0, memory_order_relaxed);
+        }
+    }
+    
+    void addSeat(SeatType type, Paise price) {
+        seats[int(type)].fetch_add(1, memory_order_relaxed);
+        revenue[int(type)].fetch_add(Booking::getGrossPrice(price), memory_order_relaxed);
+    }
+    
+    void addBooking(const Booking& booking) {
+        bookings.fetch_add(1, memory_order_relaxed);
+        for(const Seat& seat : booking.getBookedSeats()) {
+            addSeat(seat.getType(), seat.getPrice());
+        }
+    }
+    
+    // A cancelled booking is refunded in full
+    void removeBooking(const Booking& booking) {
+        bookings.fetch_sub(1, memory_order_relaxed);
+        for(const Seat& seat : booking.getBookedSeats()) {
+            seats[int(seat.getType())].fetch_sub(1, memory_order_relaxed);
+            revenue[int(seat.getType())].fetch_sub(Booking::getGrossPrice(seat.getPrice()), memory_order_relaxed);
+        }
+        cancellations.fetch_add(1, memory_order_relaxed);
+        refunds.fetch_add(booking.getTotalAmount(), memory_order_relaxed);
+    }
+    
+    // Adds cancellations restored from a snapshot, whose bookings are
+    // already left out of the saved totals
+    void loadCancellations(long long count, Paise refunded) {
+        cancellations.fetch_add(count, memory_order_relaxed);
+        refunds.fetch_add(refunded, memory_order_relaxed);
+    }
+    
+    // Restores saved totals; only before booking starts
+    void load(long long bookingCount, const long long* tierSeats, const Paise* tierRevenue) {
+        bookings.store(bookingCount, memory_order_relaxed);
+        for(int t = 0; t < TIER_COUNT; t++) {
+            seats[t].store(tierSeats[t], memory_order_relaxed);
+            revenue[t].store(tierRevenue[t], memory_order_relaxed);
+        }
+    }
+    
+    long long getBookings() const { return bookings.load(memory_order_relaxed); }
+    long long getSeats(SeatType type) const { return seats[int(type)].load(memory_order_relaxed); }
+    Paise getRevenue(SeatType type) const { return revenue[int(type)].load(memory_order_relaxed); }
+    long long getCancellations() const { return cancellations.load(memory_order_relaxed); }
+    Paise getRefunds() const { return refunds.load(memory_order_relaxed); }
+    
+    long long getTotalSeats() const {
+        long long total = 0;
+        for(int t = 0; t < TIER_COUNT; t++) total += seats[t].load(memory_order_relaxed);
+        return total;
+    }
+    
+    Paise getTotalRevenue() const {
+        Paise total = 0;
+        for(int t = 0; t < TIER_COUNT; t++) total += revenue[t].load(memory_order_relaxed);
+        return total;
+    }
+};
+
+// Append-only columnar table of settlement lines, for end-of-day reports.
+// A booking adds one line per seat tier it has seats in; a cancellation
+// adds the same lines negated. Sums over any set of lines are therefore
+// net of refunds.
+//
+// Each column is a plain array in fixed-size segments that never move.
+// A line's tier is stored last, with release ordering, and marks the line
+// as written. Appends never wait for each other, and queries read without
+// a lock while bookings keep appending. Lines still being written are
+// skipped.
+class SettlementTable {
+public:
+    enum class Group {
+        SHOW,
+        MOVIE,
+        TIER,
+        HOUR   // hour of the day, 0-23
+    };
+    
+    // Sums of one group. Bookings and seats are net of cancellations;
+    // subtotal, fees and GST are net of refunds.
+    struct Totals {
+        long long lines = 0;
+        long long bookings = 0;
+        long long seats = 0;
+        long long cancellations = 0;
+        Paise subtotal = 0;
+        Paise serviceFee = 0;
+        Paise gst = 0;
+        Paise refunds = 0;
+        
+        Paise getNet() const { return subtotal + serviceFee + gst; }
+        
+        void add(const Totals& other) {
+            lines += other.lines;
+            bookings += other.bookings;
+            seats += other.seats;
+            cancellations += other.cancellations;
+            subtotal += other.subtotal;
+            serviceFee += other.serviceFee;
+            gst += other.gst;
+            refunds += other.refunds;
+        }
+    };
+    
+    // A booking's amounts split by tier, worked out per seat as Booking does
+    struct TierAmounts {
+        int seats[BookingCounters::TIER_COUNT] = {};
+        Paise subtotal[BookingCounters::TIER_COUNT] = {};
+        Paise serviceFee[BookingCounters::TIER_COUNT] = {};
+        Paise gst[BookingCounters::TIER_COUNT] = {};
+        
+        void addSeat(SeatType type, Paise price) {
+            int t = int(type);
+            seats[t]++;
+            subtotal[t] += price;
+            serviceFee[t] += Booking::percentOf(price, Booking::SERVICE_FEE_PERCENT);
+            gst[t] += Booking::percentOf(price, Booking::GST_PERCENT);
+        }
+    };
+    
+private:
+    static const int SEGMENT_BITS = 14;
+    static const int SEGMENT_SIZE = 1 << SEGMENT_BITS;
+    // Enough for a sale and a cancellation of every slot in a full
+    // BookingStore, with each booking spanning every tier
+    static const int MAX_SEGMENTS = 8192;
+    
+    struct Segment {
+        int32_t show[SEGMENT_SIZE];  // show index
+        int32_t hour[SEGMENT_SIZE];  // local hours since the epoch
+        atomic<int8_t> tier[SEGMENT_SIZE]; // tier + 1 once the line is written, 0 before
+        int8_t first[SEGMENT_SIZE];  // 1 on the first line of a booking or cancellation
+        int16_t seats[SEGMENT_SIZE]; // negative on cancellation lines
+        Paise subtotal[SEGMENT_SIZE];
+        Paise serviceFee[SEGMENT_SIZE];
+        Paise gst[SEGMENT_SIZE];
+        
+        Segment() {
+            for(auto& mark : tier) mark.store(0, memory_order_relaxed);
+        }
+    };
+    
+    unique_ptr<atomic<Segment*>[]> segments;
+    atomic<long long> reserved;
+    
+    Segment* ensureSegment(long long line) {
+        atomic<Segment*>& segment = segments[line >> SEGMENT_BITS];
+        Segment* current = segment.load(memory_order_acquire);
+        if(!current) {
+            Segment* fresh = new Segment;
+            if(segment.compare_exchange_strong(current, fresh, memory_order_acq_rel)) {
+                current = fresh;
+            } else {
+                delete fresh;
+            }
+        }
+        return current;
+    }
+    
+    static void addLine(Totals& totals, const Segment& segment, int i, bool countsBooking) {
+        bool cancellation = segment.seats[i] < 0;
+        int bookings = countsBooking ? 1 : 0;
+        totals.lines++;
+        totals.bookings += cancellation ? -bookings : bookings;
+        totals.cancellations += cancellation ? bookings : 0;
+        totals.seats += segment.seats[i];
+        totals.subtotal += segment.subtotal[i];
+        totals.serviceFee += segment.serviceFee[i];
+        totals.gst += segment.gst[i];
+        totals.refunds -= cancellation ? segment.subtotal[i] + segment.serviceFee[i] + segment.gst[i] : 0;
+    }
+    
+    // Sums the written lines among the first count of one segment into
+    // groups[keyOf(segment, i, tier)] and into total, where a booking
+    // always counts once
+    template<typename KeyFn>
+    static void sumLines(const Segment& segment, int count, int day, bool everyLineIsBooking, KeyFn keyOf,
+                         Totals* groups, Totals& total) {
+        for(int i = 0; i < count; i++) {
+            int tier = segment.tier[i].load(memory_order_acquire) - 1;
+            if(tier < 0 || (day >= 0 && segment.hour[i] / 24 != day)) continue;
+            addLine(groups[keyOf(segment, i, tier)], segment, i, everyLineIsBooking || segment.first[i]);
+            addLine(total, segment, i, segment.first[i]);
+        }
+    }
+    
+    static long long getLocalOffset() {
+        static const long long offset = [] {
+            time_t now = time(0);
+            struct tm utc;
+#ifdef _WIN32
+            gmtime_s(&utc, &now);
+#else
+            gmtime_r(&now, &utc);
+#endif
+            utc.tm_isdst = -1;
+            return (long long)difftime(now, mktime(&utc));
+        }();
+        return offset;
+    }
+    
+public:
+    SettlementTable() : segments(new atomic<Segment*>[MAX_SEGMENTS]), reserved(0) {
+        for(int i = 0; i < MAX_SEGMENTS; i++) {
+            segments[i].store(nullptr, memory_order_relaxed);
+        }
+    }
+    
+    ~SettlementTable() {
+        for(int i = 0; i < MAX_SEGMENTS; i++) delete segments[i].load(memory_order_relaxed);
+    }
+    
+    SettlementTable(const SettlementTable&) = delete;
+    SettlementTable& operator=(const SettlementTable&) = delete;
+    
+    // Local day number of a time, as used by day filters (UTC offset taken
+    // once at startup)
+    static int getDay(time_t at) {
+        return int(((long long)at + getLocalOffset()) / 3600 / 24);
+    }
+    
+    // Lines appended or being appended
+    long long size() const {
+        return min(reserved.load(memory_order_acquire), (long long)SEGMENT_SIZE * MAX_SEGMENTS);
+    }
+    
+    // Allocates the segments for lines [0, count) up front
+    void preallocate(long long count) {
+        count = min(count, (long long)SEGMENT_SIZE * MAX_SEGMENTS);
+        for(long long line = 0; line < count; line += SEGMENT_SIZE) ensureSegment(line);
+    }
+    
+    // Appends one line per tier with seats, negated for a cancellation
+    void append(int showIndex, time_t at, const TierAmounts& amounts, bool cancellation) {
+        int count = 0;
+        for(int t = 0; t < BookingCounters::TIER_COUNT; t++) count += amounts.seats[t] > 0;
+        if(count == 0) return;
+        long long start = reserved.fetch_add(count, memory_order_relaxed);
+        if(start + count > (long long)SEGMENT_SIZE * MAX_SEGMENTS) return;
+        int32_t hour = int32_t(((long long)at + getLocalOffset()) / 3600);
+        int sign = cancellation ? -1 : 1;
+        long long line = start;
+        for(int t = 0; t < BookingCounters::TIER_COUNT; t++) {
+            if(amounts.seats[t] == 0) continue;
+            Segment& segment = *ensureSegment(line);
+            int i = int(line & (SEGMENT_SIZE - 1));
+            segment.show[i] = showIndex;
+            segment.hour[i] = hour;
+            segment.first[i] = line == start;
+            segment.seats[i] = int16_t(sign * amounts.seats[t]);
+            segment.subtotal[i] = sign * amounts.subtotal[t];
+            segment.serviceFee[i] = sign * amounts.serviceFee[t];
+            segment.gst[i] = sign * amounts.gst[t];
+            segment.tier[i].store(int8_t(t + 1), memory_order_release);
+            line++;
+        }
+    }
+    
+    void append(const Booking& booking, time_t at, bool cancellation) {
+        TierAmounts amounts;
+        for(const Seat& seat : booking.getBookedSeats()) amounts.addSeat(seat.getType(), seat.getPrice());
+        append(booking.getShowIndex(), at, amounts, cancellation);
+    }
+    
+    // Adds the written lines of one local day (or every day, for day -1)
+    // to groups, which must have a slot for every key of the grouping, and
+    // to total.
+    // movieOfShow maps show indexes to movie keys for Group::MOVIE. Whole
+    // segments are handed out to up to `threads` threads, each summing into
+    // its own groups.
+    void aggregate(Group group, int day, const vector<int>& movieOfShow, vector<Totals>& groups, Totals& total,
+                   int threads) const {
+        long long count = size();
+        int segmentCount = int((count + SEGMENT_SIZE - 1) >> SEGMENT_BITS);
+        threads = max(1, min(threads, segmentCount));
+        vector<vector<Totals>> partial(threads, vector<Totals>(groups.size() + 1)); // total last
+        atomic<int> nextSegment(0);
+        
+        auto worker = [&](int t) {
+            Totals* out = partial[t].data();
+            Totals& outTotal = partial[t].back();
+            for(int s = nextSegment.fetch_add(1); s < segmentCount; s = nextSegment.fetch_add(1)) {
+                const Segment* segment = segments[s].load(memory_order_acquire);
+                if(!segment) continue; // reserved, but nothing written yet
+                int lines = int(min<long long>(SEGMENT_SIZE, count - (long long)s * SEGMENT_SIZE));
+                switch(group) {
+                    case Group::SHOW:
+                        sumLines(*segment, lines, day, false,
+                                 [](const Segment& seg, int i, int) { return seg.show[i]; }, out, outTotal);
+                        break;
+                    case Group::MOVIE:
+                        sumLines(*segment, lines, day, false,
+                                 [&](const Segment& seg, int i, int) { return movieOfShow[seg.show[i]]; },
+                                 out, outTotal);
+                        break;
+                    case Group::TIER:
+                        // A booking counts once in every tier it has seats in
+                        sumLines(*segment, lines, day, true,
+                                 [](const Segment&, int, int tier) { return tier; }, out, outTotal);
+                        break;
+                    case Group::HOUR:
+                        sumLines(*segment, lines, day, false,
+                                 [](const Segment& seg, int i, int) { return seg.hour[i] % 24; }, out, outTotal);
+                        break;
+                }
+            }
+        };
+        vector<thread> pool;
+        for(int t = 1; t < threads; t++) pool.emplace_back(worker, t);
+        worker(0);
+        for(thread& th : pool) th.join();
+        
+        for(const vector<Totals>& sums : partial) {
+            for(size_t k = 0; k < groups.size(); k++) groups[k].add(sums[k]);
+            total.add(sums.back());
+        }
+    }
+};
+
+// Demand pricing rules. Each tier is priced at a percentage of its base
+// price, from how full the tier is, how soon the show starts and how much
+// of the tier sold since the last repricing, kept within 80%-150%.
+struct PricingInputs {
+    int occupancyPermille;   // of the tier
+    int recentPermille;      // of the tier, sold since the last repricing
+    long long minutesToShow; // negative once started; LLONG_MAX if unknown
+};
+
+class PricingRules {
+public:
+    static constexpr int MIN_PERCENT = 80;
+    static constexpr int MAX_PERCENT = 150;
+    
+    static int getPercent(const PricingInputs& in) {
+        const long long EARLY_BIRD_MINUTES = 7 * 24 * 60;
+        const long long LAST_MINUTE_MINUTES = 3 * 60;
+        int percent = 100;
+        
+        if(in.occupancyPermille >= 900) percent += 25;
+        else if(in.occupancyPermille >= 700) percent += 15;
+        else if(in.occupancyPermille >= 500) percent += 5;
+        
+        if(in.minutesToShow >= 0 && in.minutesToShow != LLONG_MAX) {
+            if(in.minutesToShow > EARLY_BIRD_MINUTES) percent -= 5;
+            // Close to the show: discount a quiet tier, charge more for a busy one
+            else if(in.minutesToShow < LAST_MINUTE_MINUTES) percent += in.occupancyPermille < 300 ? -15 : 10;
+        }
+        
+        if(in.recentPermille >= 100) percent += 10;
+        else if(in.recentPermille >= 50) percent += 5;
+        return min(max(percent, MIN_PERCENT), MAX_PERCENT);
+    }
+};
+
+// Seat prices of one show, in paise. A repricing pass works out every
+// seat's price into a scratch table in one plain integer loop the compiler
+// can vectorize, then publishes it under a sequence lock: readers retry if
+// a pass published while they read, so the seats of one booking are
+// always priced by the same pass. Until the first pass every seat costs
+// its tier's base price.
+class ShowPricing {
+private:
+    static const int TIER_COUNT = BookingCounters::TIER_COUNT;
+    
+    shared_ptr<const SeatLayout> layout;
+    vector<int32_t> basePrices; // per seat; at most a few lakh paise, so base * percent fits
+    vector<int32_t> scratch;    // the next prices; repricer only
+    unique_ptr<atomic<int32_t>[]> prices;
+    atomic<uint32_t> sequence;  // odd while a pass is publishing
+    mutex repriceLock;
+    long long soldAtLastPass[TIER_COUNT];
+    atomic<int> tierPercent[TIER_COUNT];
+    
+public:
+    explicit ShowPricing(shared_ptr<const SeatLayout> l)
+        : layout(l), basePrices(size_t(l->getRows()) * l->getCols()), scratch(basePrices.size()),
+          prices(new atomic<int32_t>[basePrices.size()]), sequence(0) {
+        for(int i = 0; i < l->getRows(); i++) {
+            for(int j = 0; j < l->getCols(); j++) {
+                int seat = i * l->getCols() + j;
+                basePrices[seat] = int32_t(SeatLayout::getTierPrice(l->getRowType(i)));
+                prices[seat].store(basePrices[seat], memory_order_relaxed);
+            }
+        }
+        for(int t = 0; t < TIER_COUNT; t++) {
+            soldAtLastPass[t] = 0;
+            tierPercent[t].store(100, memory_order_relaxed);
+        }
+    }
+    
+    Paise getPrice(int row, int col) const {
+        return prices[row * layout->getCols() + col].load(memory_order_relaxed);
+    }
+    
+    int getTierPercent(SeatType tier) const { return tierPercent[int(tier)].load(memory_order_relaxed); }
+    
+    // Current price of a tier's seats
+    Paise getTierPrice(SeatType tier) const {
+        return applyPercent(int32_t(SeatLayout::getTierPrice(tier)), getTierPercent(tier));
+    }
+    
+    // Sets each seat's price, all from one pass
+    void priceSeats(SeatList& seats) const {
+        while(true) {
+            uint32_t before = sequence.load(memory_order_acquire);
+            if(before & 1) {
+                this_thread::yield();
+                continue;
+            }
+            for(int i = 0; i < seats.size(); i++) {
+                Seat seat = seats[i];
+                seats.setPrice(i, getPrice(seat.getRow(), seat.getCol()));
+            }
+            atomic_thread_fence(memory_order_acquire);
+            if(sequence.load(memory_order_relaxed) == before) return;
+        }
+    }
+    
+    // Reprices every seat from the tiers' sold seats and the time left
+    // before the show (LLONG_MAX if unknown)
+    void reprice(const long long* soldByTier, long long minutesToShow) {
+        lock_guard<mutex> guard(repriceLock);
+        int percent[TIER_COUNT];
+        for(int t = 0; t < TIER_COUNT; t++) {
+            long long tierSeats = max(layout->getTierSeatCount(SeatType(t)), 1);
+            PricingInputs inputs;
+            inputs.occupancyPermille = int(soldByTier[t] * 1000 / tierSeats);
+            inputs.recentPermille = int(max(soldByTier[t] - soldAtLastPass[t], 0LL) * 1000 / tierSeats);
+            inputs.minutesToShow = minutesToShow;
+            percent[t] = PricingRules::getPercent(inputs);
+            soldAtLastPass[t] = soldByTier[t];
+        }
+        
+        // The batch pass: one multiply-and-round per seat, a row at a time
+        int cols = layout->getCols();
+        for(int i = 0; i < layout->getRows(); i++) {
+            const int32_t rowPercent = percent[int(layout->getRowType(i))];
+            const int32_t* base = basePrices.data() + i * cols;
+            int32_t* next = scratch.data() + i * cols;
+            for(int j = 0; j < cols; j++) {
+                next[j] = applyPercent(base[j], rowPercent);
+            }
+        }
+        
+        sequence.fetch_add(1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        for(size_t k = 0; k < scratch.size(); k++) prices[k].store(scratch[k], memory_order_relaxed);
+        sequence.fetch_add(1, memory_order_release);
+        for(int t = 0; t < TIER_COUNT; t++) tierPercent[t].store(percent[t], memory_order_relaxed);
+    }
+    
+private:
+    // A percentage of a price, rounded to whole rupees
+    static int32_t applyPercent(int32_t price, int32_t percent) {
+        return (price * percent + 5000) / 10000 * 100;
+    }
+};
+
+// Read-only view of a whole file, memory-mapped where the platform allows
+class MappedFile {
+private:
+    const char* data;
+    size_t length;
+#ifdef _WIN32
+    vector<char> buffer;
+#endif
+    
+public:
+    MappedFile() : data(nullptr), length(0) {}
+    
+    ~MappedFile() {
+#ifndef _WIN32
+        if(data) munmap(const_cast<char*>(data), length);
+#endif
+    }
+    
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    bool open(const string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_BINARY);
+        if(fd < 0) return false;
+        struct stat info;
+        if(fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        length = info.st_size;
+#ifdef _WIN32
+        buffer.resize(length);
+        bool ok = ::read(fd, buffer.data(), length) == (int)length;
+        data = ok ? buffer.data() : nullptr;
+#else
+        void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        data = mapped == MAP_FAILED ? nullptr : static_cast<const char*>(mapped);
+#endif
+        ::close(fd);
+        return data != nullptr;
+    }
+    
+    const char* getData() const { return data; }
+    size_t size() const { return length; }
+};
+
+// Binary snapshot of a theater's booking state, laid out so a mapped file
+// can be used in place: fixed-size records at 8-byte aligned offsets, in
+// host byte order.
+//   header | show ids | seat words per show | booking table | seat table | string heap
+//   | counters per show | cancellations
+// The booking table has one record per booking slot (seatCount 0 for
+// slots that never committed), so a booking id indexes it directly.
+// Cancelled bookings keep their record and are listed in the cancellation
+// table; their seats are free in the seat words and left out of the counters.
+// Money fields hold paise.
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t rows, cols;
+    uint32_t showCount;
+    uint32_t wordsPerShow;
+    uint32_t bookingCount;
+    uint64_t showTableOffset;
+    uint64_t wordsOffset;
+    uint64_t bookingTableOffset;
+    uint64_t seatTableOffset;
+    uint64_t seatCount;
+    uint64_t stringHeapOffset;
+    uint64_t stringHeapSize;
+    uint64_t fileSize;
+    uint64_t countersOffset; // one SnapshotCounters per show
+    uint64_t cancellationsOffset;
+    uint64_t cancellationCount;
+};
+
+struct SnapshotCounters {
+    int64_t bookings;
+    int64_t seats[BookingCounters::TIER_COUNT];
+    int64_t revenue[BookingCounters::TIER_COUNT];
+};
+
+struct SnapshotBooking {
+    int32_t bookingId;
+    int32_t showId;
+    int32_t customerId;
+    uint32_t seatCount;
+    int64_t bookedAt;
+    uint64_t firstSeat;
+    uint64_t nameOffset, phoneOffset, emailOffset;
+    uint16_t nameLength, phoneLength, emailLength, unused;
+};
+
+struct SnapshotSeat {
+    uint16_t row, col;
+    uint32_t unused;
+    int64_t price;
+};
+
+struct SnapshotCancellation {
+    int32_t slot; // into the booking table
+    uint32_t unused;
+    int64_t cancelledAt;
+    int64_t refund;
+};
+
+const char SNAPSHOT_MAGIC[9] = "CINESNP1";
+const uint32_t SNAPSHOT_VERSION = 1;
+
+// Checkout holds: seats parked in RESERVED while payment runs, until the
+// hold is confirmed, released or its time runs out. Expiry is tracked on a
+// hashed timing wheel with one slot per tick, so a sweep only visits the
+// holds due in the ticks that have passed, however many are in flight.
+// Confirmed and released holds leave their wheel entry behind; it is
+// skipped when its slot comes round.
+class HoldTable {
+public:
+    static constexpr int TICK_MS = 100;
+    
+    struct Hold {
+        int showIndex;
+        SeatList seats;
+        chrono::steady_clock::time_point expiresAt;
+    };
+    
+    struct Counters {
+        long long placed, confirmed, released, expired, active;
+    };
+    
+private:
+    static const int WHEEL_SLOTS = 1024; // one turn covers 102.4 s
+    
+    struct WheelEntry {
+        long long holdId;
+        long long tick;
+    };
+    
+    mutable mutex lock;
+    unordered_map<long long, Hold> holds;
+    vector<vector<WheelEntry>> wheel;
+    long long nextTick; // first tick not yet swept
+    long long nextHoldId;
+    const chrono::steady_clock::time_point epoch;
+    atomic<long long> placed, confirmed, released, expired;
+    
+    long long tickOf(chrono::steady_clock::time_point time) const {
+        return chrono::duration_cast<chrono::milliseconds>(time - epoch).count() / TICK_MS;
+    }
+    
+    // Removes a hold that has not yet expired; caller holds the lock
+    bool take(long long holdId, Hold& hold) {
+        auto it = holds.find(holdId);
+        if(it == holds.end() || chrono::steady_clock::now() >= it->second.expiresAt) return false;
+        hold = move(it->second);
+        holds.erase(it);
+        return true;
+    }
+    
+public:
+    HoldTable()
+        : wheel(WHEEL_SLOTS), nextTick(0), nextHoldId(1), epoch(chrono::steady_clock::now()),
+          placed(0), confirmed(0), released(0), expired(0) {}
+    
+    long long add(int showIndex, const SeatList& seats, int ttlSeconds) {
+        auto expiresAt = chrono::steady_clock::now() + chrono::seconds(ttlSeconds);
+        lock_guard<mutex> guard(lock);
+        long long holdId = nextHoldId++;
+        holds.emplace(holdId, Hold{showIndex, seats, expiresAt});
+        // Round up so a hold never expires early
+        long long tick = max(tickOf(expiresAt) + 1, nextTick);
+        wheel[tick % WHEEL_SLOTS].push_back({holdId, tick});
+        placed.fetch_add(1, memory_order_relaxed);
+        return holdId;
+    }
+    
+    bool confirm(long long holdId, Hold& hold) {
+        lock_guard<mutex> guard(lock);
+        if(!take(holdId, hold)) return false;
+        confirmed.fetch_add(1, memory_order_relaxed);
+        return true;
+    }
+    
+    bool release(long long holdId, Hold& hold) {
+        lock_guard<mutex> guard(lock);
+        if(!take(holdId, hold)) return false;
+        released.fetch_add(1, memory_order_relaxed);
+        return true;
+    }
+    
+    // Removes every hold whose tick has passed and hands it to the caller,
+    // who returns its seats to AVAILABLE
+    void collectExpired(vector<Hold>& due) {
+        long long now = tickOf(chrono::steady_clock::now());
+        lock_guard<mutex> guard(lock);
+        // After a long pause one pass over the whole wheel is enough
+        for(long long tick = max(nextTick, now - WHEEL_SLOTS + 1); tick <= now; tick++) {
+            vector<WheelEntry>& slot = wheel[tick % WHEEL_SLOTS];
+            size_t kept = 0;
+            for(const WheelEntry& entry : slot) {
+                if(entry.tick > now) {
+                    slot[kept++] = entry; // due on a later turn
+                    continue;
+                }
+                auto it = holds.find(entry.holdId);
+                if(it == holds.end()) continue; // already confirmed or released
+                due.push_back(move(it->second));
+                holds.erase(it);
+                expired.fetch_add(1, memory_order_relaxed);
+            }
+            slot.resize(kept);
+        }
+        nextTick = max(nextTick, now + 1);
+    }
+    
+    Counters getCounters() const {
+        lock_guard<mutex> guard(lock);
+        return {placed.load(memory_order_relaxed), confirmed.load(memory_order_relaxed),
+                released.load(memory_order_relaxed), expired.load(memory_order_relaxed),
+                (long long)holds.size()};
+    }
+};
+
+// Outcome of a booking attempt through the booking engine
+enum class BookingStatus {
+    SUCCESS,
+    INVALID_SHOW,
+    INVALID_SEAT,
+    SEAT_UNAVAILABLE,
+    STORE_FULL,
+    JOURNAL_FAILED,
+    NO_ADJACENT_SEATS,
+    HOLD_NOT_FOUND,
+    TOO_MANY_SEATS,
+    BOOKING_NOT_FOUND,
+    ALREADY_CANCELLED,
+    DURABILITY_PENDING // journaled, not yet durable; see Theater::deferDurability
+};
+
+struct BookingResult {
+    BookingStatus status;
+    const Booking* booking; // set on success
+    int failedSeat;         // index into the requested seat ids, or -1
+};
+
+struct HoldResult {
+    BookingStatus status;
+    long long holdId;       // set on success
+    int failedSeat;         // index into the requested seat ids, or -1
+};
+
+struct CancelResult {
+    BookingStatus status;
+    const Booking* booking; // the booking, unless it was not found
+    Paise refund;           // set on success
+};
+
+string getBookingStatusString(BookingStatus status) {
+    switch(status) {
+        case BookingStatus::SUCCESS: return "SUCCESS";
+        case BookingStatus::INVALID_SHOW: return "INVALID_SHOW";
+        case BookingStatus::INVALID_SEAT: return "INVALID_SEAT";
+        case BookingStatus::SEAT_UNAVAILABLE: return "SEAT_UNAVAILABLE";
+        case BookingStatus::STORE_FULL: return "STORE_FULL";
+        case BookingStatus::JOURNAL_FAILED: return "JOURNAL_FAILED";
+        case BookingStatus::NO_ADJACENT_SEATS: return "NO_ADJACENT_SEATS";
+        case BookingStatus::HOLD_NOT_FOUND: return "HOLD_NOT_FOUND";
+        case BookingStatus::TOO_MANY_SEATS: return "TOO_MANY_SEATS";
+        case BookingStatus::BOOKING_NOT_FOUND: return "BOOKING_NOT_FOUND";
+        case BookingStatus::ALREADY_CANCELLED: return "ALREADY_CANCELLED";
+        case BookingStatus::DURABILITY_PENDING: return "DURABILITY_PENDING";
+        default: return "UNKNOWN";
+    }
+}
+
+// Booking engine metrics: a latency histogram and outcome counts per
+// operation, plus contention counters. Counts are spread over
+// cache-line-aligned stripes, one picked per thread, so threads recording
+// at once rarely write the same line; readers add the stripes up.
+// Latency buckets are log-scale, four per power of two nanoseconds.
+class BookingMetrics {
+public:
+    enum class Operation {
+        BOOK,
+        BOOK_BEST,
+        HOLD,
+        CONFIRM,
+        CANCEL,
+        FIND_SEAT,  // timed on one call in FIND_SEAT_SAMPLE per thread
+        SEARCH
+    };
+    static const int OPERATION_COUNT = 7;
+    static const int OUTCOME_COUNT = int(BookingStatus::ALREADY_CANCELLED) + 1;
+    static const int BUCKETS = 148; // below 2^38 ns, about 4.5 minutes
+    static const int FIND_SEAT_SAMPLE = 16;
+    
+    // Sums over every stripe for one operation
+    struct Summary {
+        uint64_t count;       // timed calls
+        uint64_t nanos;       // total time of the timed calls
+        uint64_t buckets[BUCKETS];
+        uint64_t outcomes[OUTCOME_COUNT];
+        
+        // Upper bound of the bucket holding quantile q, in nanoseconds
+        uint64_t getQuantile(double q) const {
+            uint64_t rank = uint64_t(ceil(q * count));
+            uint64_t seen = 0;
+            for(int i = 0; i < BUCKETS; i++) {
+                seen += buckets[i];
+                if(seen >= rank && seen > 0) return getBucketLimit(i);
+            }
+            return 0;
+        }
+    };
+    
+private:
+    static const int STRIPES = 16;
+    
+    struct alignas(64) Stripe {
+        atomic<uint64_t> buckets[OPERATION_COUNT][BUCKETS];
+        atomic<uint64_t> nanos[OPERATION_COUNT];
+        atomic<uint64_t> outcomes[OPERATION_COUNT][OUTCOME_COUNT];
+        atomic<uint64_t> bestSeatRetries;
+        
+        Stripe() {
+            for(int op = 0; op < OPERATION_COUNT; op++) {
+                for(auto& bucket : buckets[op]) bucket.store(0, memory_order_relaxed);
+                for(auto& outcome : outcomes[op]) outcome.store(0, memory_order_relaxed);
+                nanos[op].store(0, memory_order_relaxed);
+            }
+            bestSeatRetries.store(0, memory_order_relaxed);
+        }
+    };
+    
+    unique_ptr<Stripe[]> stripes;
+    
+    // This thread's stripe; threads are dealt stripes in turn
+    Stripe& getStripe() const {
+        static atomic<int> nextStripe(0);
+        thread_local int index = nextStripe.fetch_add(1, memory_order_relaxed) % STRIPES;
+        return stripes[index];
+    }
+    
+    static const char* getOperationName(int op) {
+        static const char* const NAMES[OPERATION_COUNT] = {
+            "book", "book_best", "hold", "confirm", "cancel", "find_seat", "search"};
+        return NAMES[op];
+    }
+    
+    static void appendLine(string& out, const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        char line[256];
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(line, sizeof(line), format, args);
+        va_end(args);
+        if(length > 0) out.append(line, min<size_t>(length, sizeof(line) - 1));
+    }
+    
+public:
+    BookingMetrics() : stripes(new Stripe[STRIPES]) {}
+    
+    BookingMetrics(const BookingMetrics&) = delete;
+    BookingMetrics& operator=(const BookingMetrics&) = delete;
+    
+    static uint64_t now() {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    
+    static int getBucket(uint64_t nanos) {
+        if(nanos < 4) return int(nanos);
+        int msb = 63 - __builtin_clzll(nanos);
+        return min((msb - 1) * 4 + int((nanos >> (msb - 2)) & 3), BUCKETS - 1);
+    }
+    
+    // Smallest time above every time in bucket i
+    static uint64_t getBucketLimit(int i) {
+        if(i < 4) return i + 1;
+        return uint64_t(5 + i % 4) << (i / 4 - 1);
+    }
+    
+    // Whether this call of the operation should be timed
+    static bool shouldTime(Operation op) {
+        if(op != Operation::FIND_SEAT) return true;
+        thread_local unsigned calls = 0;
+        return calls++ % FIND_SEAT_SAMPLE == 0;
+    }
+    
+    // Counts an outcome and, if start is not 0, the time since start
+    void record(Operation op, BookingStatus status, uint64_t start) {
+        Stripe& stripe = getStripe();
+        stripe.outcomes[int(op)][int(status)].fetch_add(1, memory_order_relaxed);
+        if(start == 0) return;
+        uint64_t nanos = now() - start;
+        stripe.buckets[int(op)][getBucket(nanos)].fetch_add(1, memory_order_relaxed);
+        stripe.nanos[int(op)].fetch_add(nanos, memory_order_relaxed);
+    }
+    
+    void addBestSeatRetry() {
+        getStripe().bestSeatRetries.fetch_add(1, memory_order_relaxed);
+    }
+    
+    Summary getSummary(Operation op) const {
+        Summary summary = {};
+        for(int s = 0; s < STRIPES; s++) {
+            const Stripe& stripe = stripes[s];
+            for(int i = 0; i < BUCKETS; i++) {
+                uint64_t count = stripe.buckets[int(op)][i].load(memory_order_relaxed);
+                summary.buckets[i] += count;
+                summary.count += count;
+            }
+            for(int k = 0; k < OUTCOME_COUNT; k++) {
+                summary.outcomes[k] += stripe.outcomes[int(op)][k].load(memory_order_relaxed);
+            }
+            summary.nanos += stripe.nanos[int(op)].load(memory_order_relaxed);
+        }
+        return summary;
+    }
+    
+    uint64_t getBestSeatRetries() const {
+        uint64_t total = 0;
+        for(int s = 0; s < STRIPES; s++) total += stripes[s].bestSeatRetries.load(memory_order_relaxed);
+        return total;
+    }
+    
+    static string getOperationString(Operation op) { return getOperationName(int(op)); }
+    
+    // Appends every metric in the Prometheus text format. Histogram
+    // buckets are reported at each power of two from 128 ns to about 17 s.
+    void appendPrometheus(string& out) const {
+        const int FIRST_REPORTED = 23; // bucket below 2^7 ns
+        const int LAST_REPORTED = 131; // bucket below 2^34 ns
+        const double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+        Summary summaries[OPERATION_COUNT];
+        for(int op = 0; op < OPERATION_COUNT; op++) summaries[op] = getSummary(Operation(op));
+        
+        out += "# HELP cinereserve_operation_seconds Booking engine operation latency.\n";
+        out += "# TYPE cinereserve_operation_seconds histogram\n";
+        for(int op = 0; op < OPERATION_COUNT; op++) {
+            const Summary& summary = summaries[op];
+            uint64_t cumulative = 0;
+            for(int i = 0; i <= LAST_REPORTED; i++) {
+                cumulative += summary.buckets[i];
+                if(i < FIRST_REPORTED || i % 4 != 3) continue;
+                appendLine(out, "cinereserve_operation_seconds_bucket{op=\"%s\",le=\"%.9g\"} %llu\n",
+                           getOperationName(op), getBucketLimit(i) / 1e9, (unsigned long long)cumulative);
+            }
+            appendLine(out, "cinereserve_operation_seconds_bucket{op=\"%s\",le=\"+Inf\"} %llu\n",
+                       getOperationName(op), (unsigned long long)summary.count);
+            appendLine(out, "cinereserve_operation_seconds_sum{op=\"%s\"} %.9f\n",
+                       getOperationName(op), summary.nanos / 1e9);
+            appendLine(out, "cinereserve_operation_seconds_count{op=\"%s\"} %llu\n",
+                       getOperationName(op), (unsigned long long)summary.count);
+        }
+        
+        out += "# HELP cinereserve_operation_latency_seconds Latency quantiles (bucket upper bounds).\n";
+        out += "# TYPE cinereserve_operation_latency_seconds gauge\n";
+        for(int op = 0; op < OPERATION_COUNT; op++) {
+            if(summaries[op].count == 0) continue;
+            for(double q : QUANTILES) {
+                appendLine(out, "cinereserve_operation_latency_seconds{op=\"%s\",quantile=\"%g\"} %.9g\n",
+                           getOperationName(op), q, summaries[op].getQuantile(q) / 1e9);
+            }
+        }
+        
+        out += "# HELP cinereserve_operations_total Booking engine operations by outcome.\n";
+        out += "# TYPE cinereserve_operations_total counter\n";
+        for(int op = 0; op < OPERATION_COUNT; op++) {
+            for(int k = 0; k < OUTCOME_COUNT; k++) {
+                if(summaries[op].outcomes[k] == 0) continue;
+                string outcome = getBookingStatusString(BookingStatus(k));
+                transform(outcome.begin(), outcome.end(), outcome.begin(), ::tolower);
+                appendLine(out, "cinereserve_operations_total{op=\"%s\",outcome=\"%s\"} %llu\n",
+                           getOperationName(op), outcome.c_str(), (unsigned long long)summaries[op].outcomes[k]);
+            }
+        }
+        
+        out += "# HELP cinereserve_best_seat_retries_total Best-seat searches repeated after losing a seat.\n";
+        out += "# TYPE cinereserve_best_seat_retries_total counter\n";
+        appendLine(out, "cinereserve_best_seat_retries_total %llu\n", (unsigned long long)getBestSeatRetries());
+    }
+};
+
+// Periodic metrics dump. Every interval the metrics text is rendered and
+// replaces the file, written to "<path>.tmp" and renamed so a reader
+// never sees half a file. Written once more when stopped.
+class MetricsExporter {
+private:
+    string path;
+    function<void(string&)> render;
+    thread worker;
+    mutex lock;
+    condition_variable wake;
+    bool stopping;
+    
+    bool writeFile() {
+        string text;
+        render(text);
+        string tempPath = path + ".tmp";
+        FILE* out = fopen(tempPath.c_str(), "wb");
+        if(!out) return false;
+        bool ok = fwrite(text.data(), 1, text.size(), out) == text.size();
+        ok = fclose(out) == 0 && ok;
+        if(!ok || rename(tempPath.c_str(), path.c_str()) != 0) {
+            remove(tempPath.c_str());
+            return false;
+        }
+        return true;
+    }
+    
+public:
+    MetricsExporter() : stopping(false) {}
+    ~MetricsExporter() { stop(); }
+    
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+    
+    // Writes the file once, then keeps rewriting it every intervalSeconds;
+    // false if the first write fails
+    bool start(const string& metricsPath, int intervalSeconds, function<void(string&)> renderer) {
+        path = metricsPath;
+        render = renderer;
+        if(!writeFile()) return false;
+        worker = thread([this, intervalSeconds] {
+            unique_lock<mutex> guard(lock);
+            while(!stopping) {
+                wake.wait_for(guard, chrono::seconds(intervalSeconds));
+                if(stopping) break;
+                guard.unlock();
+                if(!writeFile()) cerr << "Could not write metrics to " << path << endl;
+                guard.lock();
+            }
+        });
+        return true;
+    }
+    
+    void stop() {
+        if(!worker.joinable()) return;
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        worker.join();
+        writeFile();
+    }
+};
+
+// Point-in-time statistics for one show, or for the whole theater
+// (showId 0). Tier arrays are indexed by SeatType.
+struct ShowStats {
+    int showId;
+    long long totalSeats;
+    long long bookedSeats;
+    long long bookingCount;
+    Paise revenue;
+    long long cancellationCount;
+    Paise refunds;
+    long long tierSeats[BookingCounters::TIER_COUNT];
+    long long tierBookedSeats[BookingCounters::TIER_COUNT];
+    Paise tierRevenue[BookingCounters::TIER_COUNT];
+    
+    double getOccupancyRate() const {
+        return totalSeats > 0 ? double(bookedSeats) / totalSeats * 100 : 0.0;
+    }
+    
+    // Adds another hall's figures, for totals across screens
+    void add(const ShowStats& other) {
+        totalSeats += other.totalSeats;
+        bookedSeats += other.bookedSeats;
+        bookingCount += other.bookingCount;
+        revenue += other.revenue;
+        cancellationCount += other.cancellationCount;
+        refunds += other.refunds;
+        for(int t = 0; t < BookingCounters::TIER_COUNT; t++) {
+            tierSeats[t] += other.tierSeats[t];
+            tierBookedSeats[t] += other.tierBookedSeats[t];
+            tierRevenue[t] += other.tierRevenue[t];
+        }
+    }
+};
+
+// Settlement totals per group, labelled for display; groups with no lines
+// are kept, with zero totals
+struct SettlementReport {
+    vector<string> labels; // by group key
+    vector<SettlementTable::Totals> totals;
+    SettlementTable::Totals total;
+};
+
+// Theater class
+class Theater {
+private:
+    string name;
+    shared_ptr<const SeatLayout> layout;
+    Catalog catalog; // shows and customers that bookings refer to by id
+    ShowSchedule schedule; // this hall's shows by start time; they never overlap
+    deque<ShowOccupancy> occupancy; // one packed seat map per show
+    BookingStore bookings;
+    deque<SeatChangeLog> changeLogs; // per show: seat changes open read views may still need
+    mutable ReadViewRegistry views;
+    static const int FIRST_BOOKING_ID = 1001;
+    static const int BEST_SEAT_ATTEMPTS = 16;
+    
+    // Seating grid rows as last drawn, per show; a row is redrawn only
+    // when a booking has changed it since
+    struct SeatGridCache {
+        mutex lock;
+        static constexpr uint64_t REDRAW = UINT64_MAX; // row was drawn mid-change
+        vector<uint64_t> versions; // row version each row was drawn at
+        vector<string> rows;
+        bool drawn = false;
+    };
+    mutable deque<SeatGridCache> gridCaches;
+    string gridHeader; // column numbers, the same for every show
+    deque<BookingCounters> showCounters;
+    BookingCounters theaterCounters;
+    deque<ShowPricing> pricing; // current seat prices, per show
+    SettlementTable settlement; // every sale and cancellation since startup
+    // Sales and cancellations held in the loaded snapshot, added on the
+    // first settlement query so startup does not pay for them
+    mutable SettlementTable snapshotSettlement;
+    mutable once_flag snapshotSettled;
+    unordered_map<int, int> showIndexById;
+    unique_ptr<BookingJournal> journal; // null when running in memory only
+    CustomerDirectory customers;
+    
+    // Snapshot state: the mapping backs bookings that have not been read
+    // since startup, so it stays open for the theater's lifetime
+    string snapshotPath;
+    unique_ptr<MappedFile> snapshot;
+    mutex snapshotLock;          // one snapshot write at a time
+    uint64_t recordsAtLastSnapshot;
+    thread snapshotThread;
+    thread repriceThread;
+    
+    ReceiptPipeline* receipts; // optional; gets every new booking
+    BookingMetrics* metrics;   // optional; times every engine operation
+    
+    HoldTable holds;
+    thread holdSweeper;
+    once_flag holdSweeperStarted;
+    
+    mutex backgroundLock;        // wakes the snapshot and hold sweeper threads
+    condition_variable backgroundWake;
+    bool stopping;
+    
+    const SnapshotHeader* getSnapshotHeader() const {
+        return snapshot ? reinterpret_cast<const SnapshotHeader*>(snapshot->getData()) : nullptr;
+    }
+    
+    const SnapshotBooking* getSnapshotRecord(int index) const {
+        const SnapshotHeader* header = getSnapshotHeader();
+        if(!header || index < 0 || index >= (int)header->bookingCount) return nullptr;
+        const SnapshotBooking* table = reinterpret_cast<const SnapshotBooking*>(
+            snapshot->getData() + header->bookingTableOffset);
+        const SnapshotBooking* record = &table[index];
+        // Records are trusted only if everything they point at is inside the file
+        if(record->seatCount == 0 || record->seatCount > (uint32_t)SeatList::CAPACITY ||
+           record->seatCount > header->seatCount ||
+           record->firstSeat > header->seatCount - record->seatCount) return nullptr;
+        if(record->nameOffset + record->nameLength > header->stringHeapSize ||
+           record->phoneOffset + record->phoneLength > header->stringHeapSize ||
+           record->emailOffset + record->emailLength > header->stringHeapSize) return nullptr;
+        return record;
+    }
+    
+    const SnapshotSeat* getSnapshotSeats(const SnapshotBooking& record) const {
+        const SnapshotHeader* header = getSnapshotHeader();
+        return reinterpret_cast<const SnapshotSeat*>(snapshot->getData() + header->seatTableOffset) +
+               record.firstSeat;
+    }
+    
+    string getSnapshotString(uint64_t offset, uint16_t length) const {
+        return string(snapshot->getData() + getSnapshotHeader()->stringHeapOffset + offset, length);
+    }
+    
+    // Builds a booking straight from its mapped snapshot record, adding its
+    // customer to the catalog if the customer has not been seen yet
+    bool loadSnapshotBooking(int index, void* storage) {
+        const SnapshotBooking* record = getSnapshotRecord(index);
+        if(!record) return false;
+        int showIndex = findShowIndex(record->showId);
+        if(showIndex < 0) return false;
+        const SnapshotSeat* saved = getSnapshotSeats(*record);
+        for(uint32_t i = 0; i < record->seatCount; i++) {
+            if(!layout->isValid(saved[i].row, saved[i].col)) return false;
+        }
+        
+        if(!catalog.findCustomer(record->customerId)) {
+            catalog.addCustomer(Customer(getSnapshotString(record->nameOffset, record->nameLength),
+                                         getSnapshotString(record->phoneOffset, record->phoneLength),
+                                         getSnapshotString(record->emailOffset, record->emailLength),
+                                         record->customerId));
+        }
+        Booking* booking = new (storage) Booking(record->bookingId, showIndex, record->customerId,
+                                                 time_t(record->bookedAt));
+        for(uint32_t i = 0; i < record->seatCount; i++) {
+            Seat seat(saved[i].row, saved[i].col, layout->getRowType(saved[i].row), saved[i].price);
+            seat.setStatus(SeatStatus::BOOKED);
+            if(!booking->addSeat(seat)) {
+                booking->~Booking();
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    // Maps a snapshot file and installs its seat maps and booking table.
+    // Bookings are not decoded here; each is built on first read.
+    bool loadSnapshot(const string& path, long long& bookingCount) {
+        bookingCount = 0;
+        struct stat info;
+        if(stat(path.c_str(), &info) != 0) return true; // no snapshot yet
+        
+        unique_ptr<MappedFile> mapping(new MappedFile());
+        if(!mapping->open(path) || mapping->size() < sizeof(SnapshotHeader)) return false;
+        const SnapshotHeader* header = reinterpret_cast<const SnapshotHeader*>(mapping->getData());
+        uint64_t size = mapping->size();
+        if(memcmp(header->magic, SNAPSHOT_MAGIC, 8) != 0 || header->version != SNAPSHOT_VERSION ||
+           header->fileSize != size || header->rows != (uint32_t)layout->getRows() ||
+           header->cols != (uint32_t)layout->getCols()) return false;
+        if(header->showTableOffset + uint64_t(header->showCount) * sizeof(int32_t) > size ||
+           header->wordsOffset + uint64_t(header->showCount) * header->wordsPerShow * 8 > size ||
+           header->bookingTableOffset + uint64_t(header->bookingCount) * sizeof(SnapshotBooking) > size ||
+           header->seatTableOffset + header->seatCount * sizeof(SnapshotSeat) > size ||
+           header->stringHeapOffset + header->stringHeapSize > size) return false;
+        if(header->countersOffset + uint64_t(header->showCount) * sizeof(SnapshotCounters) > size ||
+           header->cancellationCount > header->bookingCount ||
+           header->cancellationsOffset + header->cancellationCount * sizeof(SnapshotCancellation) > size) return false;
+        
+        const int32_t* showIds = reinterpret_cast<const int32_t*>(mapping->getData() + header->showTableOffset);
+        const uint64_t* words = reinterpret_cast<const uint64_t*>(mapping->getData() + header->wordsOffset);
+        for(uint32_t s = 0; s < header->showCount; s++) {
+            int showIndex = findShowIndex(showIds[s]);
+            if(showIndex < 0 || occupancy[showIndex].getWordCount() != (int)header->wordsPerShow ||
+               !occupancy[showIndex].fitsLayout(words + uint64_t(s) * header->wordsPerShow)) return false;
+        }
+        for(uint32_t s = 0; s < header->showCount; s++) {
+            occupancy[findShowIndex(showIds[s])].loadWords(words + uint64_t(s) * header->wordsPerShow);
+        }
+        
+        const SnapshotCounters* counters = reinterpret_cast<const SnapshotCounters*>(
+            mapping->getData() + header->countersOffset);
+        long long totalBookings = 0;
+        long long totalSeats[BookingCounters::TIER_COUNT] = {};
+        Paise totalRevenue[BookingCounters::TIER_COUNT] = {};
+        for(uint32_t s = 0; s < header->showCount; s++) {
+            const SnapshotCounters& saved = counters[s];
+            long long seats[BookingCounters::TIER_COUNT];
+            Paise revenue[BookingCounters::TIER_COUNT];
+            for(int t = 0; t < BookingCounters::TIER_COUNT; t++) {
+                seats[t] = saved.seats[t];
+                revenue[t] = saved.revenue[t];
+                totalSeats[t] += seats[t];
+                totalRevenue[t] += revenue[t];
+            }
+            totalBookings += saved.bookings;
+            showCounters[findShowIndex(showIds[s])].load(saved.bookings, seats, revenue);
+        }
+        theaterCounters.load(totalBookings, totalSeats, totalRevenue);
+        
+        snapshot = move(mapping);
+        bookings.attachSnapshot(header->bookingCount, [this](int index, void* storage) {
+            return loadSnapshotBooking(index, storage);
+        });
+        
+        // Tombstones go straight onto their slots; the bookings stay undecoded
+        const SnapshotCancellation* cancelled = reinterpret_cast<const SnapshotCancellation*>(
+            snapshot->getData() + header->cancellationsOffset);
+        long long totalCancelled = 0;
+        Paise totalRefunded = 0;
+        for(uint64_t i = 0; i < header->cancellationCount; i++) {
+            const SnapshotBooking* record = getSnapshotRecord(cancelled[i].slot);
+            int showIndex = record ? findShowIndex(record->showId) : -1;
+            if(showIndex < 0 || cancelled[i].cancelledAt <= 0 || !bookings.beginCancel(cancelled[i].slot)) continue;
+            bookings.finishCancel(cancelled[i].slot, time_t(cancelled[i].cancelledAt));
+            Paise refund = cancelled[i].refund;
+            showCounters[showIndex].loadCancellations(1, refund);
+            totalCancelled++;
+            totalRefunded += refund;
+        }
+        theaterCounters.loadCancellations(totalCancelled, totalRefunded);
+        customers.setBacklog([this] { indexSnapshotCustomers(); });
+        bookingCount = header->bookingCount;
+        return true;
+    }
+    
+    // Indexes the customers of snapshot-backed bookings straight from the
+    // mapped records, without building the bookings
+    void indexSnapshotCustomers() {
+        int count = bookings.getSnapshotCount();
+        for(int i = 0; i < count; i++) {
+            bool fromSnapshot;
+            const Booking* booking = bookings.peek(i, fromSnapshot);
+            if(booking) {
+                customers.restoreCustomerBooking(catalog.getCustomer(booking->getCustomerId()), i);
+            } else if(const SnapshotBooking* record = fromSnapshot ? getSnapshotRecord(i) : nullptr) {
+                customers.restoreCustomerBooking(Customer(getSnapshotString(record->nameOffset, record->nameLength),
+                                                          getSnapshotString(record->phoneOffset, record->phoneLength),
+                                                          getSnapshotString(record->emailOffset, record->emailLength),
+                                                          record->customerId), i);
+            }
+        }
+    }
+    
+    static void appendSnapshotString(string& heap, const string& value, uint64_t& offset, uint16_t& length) {
+        offset = heap.size();
+        length = uint16_t(min<size_t>(value.size(), UINT16_MAX));
+        heap.append(value, 0, length);
+    }
+    
+    static bool writeFileData(FILE* out, const void* data, size_t size) {
+        return size == 0 || fwrite(data, 1, size, out) == size;
+    }
+    
+    void snapshotLoop(int intervalSeconds) {
+        unique_lock<mutex> guard(backgroundLock);
+        while(!stopping) {
+            backgroundWake.wait_for(guard, chrono::seconds(intervalSeconds));
+            if(stopping) break;
+            if(journal && journal->getRecordCount() > recordsAtLastSnapshot) {
+                guard.unlock();
+                if(!writeSnapshot()) cerr << "Periodic snapshot failed: " << snapshotPath << endl;
+                guard.lock();
+            }
+        }
+    }
+    
+    void repriceLoop(int intervalSeconds) {
+        unique_lock<mutex> guard(backgroundLock);
+        while(!stopping) {
+            backgroundWake.wait_for(guard, chrono::seconds(intervalSeconds));
+            if(stopping) break;
+            guard.unlock();
+            repriceAll();
+            guard.lock();
+        }
+    }
+    
+    void holdSweepLoop() {
+        unique_lock<mutex> guard(backgroundLock);
+        while(!stopping) {
+            backgroundWake.wait_for(guard, chrono::milliseconds(HoldTable::TICK_MS));
+            if(stopping) break;
+            guard.unlock();
+            expireHolds();
+            guard.lock();
+        }
+    }
+    
+    // Booking ids are handed out in slot order, so the id is the index;
+    // -1 for ids below the first, which no slot has
+    static int getSlotFor(int bookingId) {
+        return bookingId >= FIRST_BOOKING_ID ? bookingId - FIRST_BOOKING_ID : -1;
+    }
+    
+    bool isValidShow(int showIndex) const {
+        return showIndex >= 0 && showIndex < catalog.getShowCount();
+    }
+    
+    // A row of a show as of a commit version, into seats. The seat words
+    // are read with the change log records of the row, again if a change
+    // of the row was under way meanwhile. Holds and gaps read as they are
+    // now. Returns false if the row is about to differ from what was read:
+    // a booking or cancellation of one of its seats is under way.
+    bool getRowAt(int showIndex, int row, uint64_t version, vector<SeatStatus>& seats) const {
+        // What one record says about its seats at the version
+        enum : uint8_t { HELD = 1, FREED = 2, CHANGED = 4, FREEING = 8, READ = 16 };
+        const ShowOccupancy& seatMap = occupancy[showIndex];
+        int cols = layout->getCols();
+        seats.resize(cols);
+        vector<uint8_t> marks; // per seat, once a record has the row
+        while(true) {
+            uint32_t done = seatMap.getChangesDone(row);
+            uint32_t begun = seatMap.getChangesBegun(row);
+            if(begun != done) {
+                this_thread::yield();
+                continue;
+            }
+            for(int j = 0; j < cols; j++) seats[j] = seatMap.getStatus(row, j);
+            marks.clear();
+            changeLogs[showIndex].forEach([&](const SeatChangeLog::Change& change) {
+                uint8_t mark = 0;
+                for(int k = 0; k < change.count; k++) {
+                    if(change.rows[k] != row) continue;
+                    if(!mark) {
+                        bool freeing = change.freeing.load(memory_order_acquire);
+                        uint64_t booked = bookings.getBookedVersion(change.slot);
+                        uint64_t cancelled = bookings.getCancelledVersion(change.slot);
+                        mark = booked <= version && version < cancelled ? HELD :
+                               freeing && cancelled <= version ? FREED :
+                               booked > version ? CHANGED : 0;
+                        if(freeing) mark |= FREEING;
+                        mark |= READ;
+                    }
+                    if(marks.empty()) marks.assign(cols, 0);
+                    marks[change.cols[k]] |= mark;
+                }
+            });
+            if(seatMap.getChangesBegun(row) == begun) break;
+        }
+        
+        // A seat some record held at the version was booked; one a record
+        // took later, or had given back by then, was not. Any other seat
+        // reads as it is now.
+        bool settled = true;
+        for(int j = 0; j < (int)marks.size(); j++) {
+            SeatStatus now = seats[j];
+            if(marks[j] & HELD) {
+                seats[j] = SeatStatus::BOOKED;
+            } else if((marks[j] & (FREED | CHANGED)) && now == SeatStatus::BOOKED) {
+                seats[j] = SeatStatus::AVAILABLE;
+            }
+            settled = settled && seats[j] == now && !(marks[j] & FREEING);
+        }
+        return settled;
+    }
+    
+public:
+    // A consistent read of every show's seats and of the bookings at one
+    // point in time: it sees each booking and cancellation committed before
+    // it was opened and none after, however long it is kept. Writers never
+    // wait for it. A view holds an entry in the theater's registry until it
+    // is destroyed, so seat changes it may need are kept meanwhile.
+    class ReadView {
+    private:
+        const Theater& theater;
+        int entry;
+        uint64_t version;
+        int slotCount; // booking slots reserved when the view was opened
+        
+    public:
+        // The entry is taken before the version is read, so a writer
+        // dropping changes either sees the entry or dropped them before
+        // the version; the slot count is read last, so every slot the
+        // version covers is counted
+        explicit ReadView(const Theater& t) : theater(t), entry(t.views.open()) {
+            atomic_thread_fence(memory_order_seq_cst);
+            version = t.bookings.getVersion();
+            t.views.setVersion(entry, version);
+            slotCount = t.bookings.size();
+        }
+        
+        ~ReadView() { theater.views.close(entry); }
+        
+        ReadView(const ReadView&) = delete;
+        ReadView& operator=(const ReadView&) = delete;
+        
+        uint64_t getVersion() const { return version; }
+        
+        // One row of a show in this view; false if it is about to change
+        // from that, as for Theater::getRowAt
+        bool getRow(int showIndex, int row, vector<SeatStatus>& seats) const {
+            return theater.getRowAt(showIndex, row, version, seats);
+        }
+        
+        bool isCommitted(int slot) const {
+            return slot >= 0 && slot < slotCount && theater.bookings.getBookedVersion(slot) <= version;
+        }
+        
+        // When the booking in this slot was cancelled, or 0 if it was live
+        // in this view
+        time_t getCancelledAt(int slot) const {
+            return theater.bookings.getCancelledVersion(slot) <= version ? theater.bookings.getCancelledAt(slot) : 0;
+        }
+        
+        // Calls fn(booking, cancelledAt) for each booking in the view, by id
+        template<typename Fn>
+        void forEachBooking(Fn fn) const {
+            for(int slot = 0; slot < slotCount; slot++) {
+                if(!isCommitted(slot)) continue;
+                if(const Booking* booking = theater.bookings.get(slot)) fn(*booking, getCancelledAt(slot));
+            }
+        }
+    };
+    
+    ReadView openReadView() const { return ReadView(*this); }
+    
+private:
+    // One grid row: the row label, each seat's O/R/X (W for an open
+    // wheelchair space, blank for a gap), then the row's tier. Drawn as
+    // the view sees it; returns false if the row is about to change from
+    // that, so it must not be cached by its row version.
+    bool drawGridRow(const ReadView& view, int showIndex, int row, vector<SeatStatus>& seats, string& text) const {
+        bool settled = view.getRow(showIndex, row, seats);
+        char label[2];
+        int length = SeatCode::formatRow(row, label);
+        text.assign(label, length);
+        text.append(4 - length, ' ');
+        for(int j = 0; j < layout->getCols(); j++) {
+            char status = layout->makeSeat(row, j, seats[j]).getDisplayChar();
+            if(status == 'O' && layout->getSeatKind(row, j) == SeatKind::WHEELCHAIR) status = 'W';
+            text += "  ";
+            text += status;
+        }
+        text += "  (";
+        text += SeatLayout::getTierName(layout->getRowType(row));
+        if(layout->rowHasKind(row, SeatKind::RECLINER)) text += ", recliners";
+        text += ")\n";
+        return settled;
+    }
+    
+    ShowStats makeStats(int showId, int showCount, const BookingCounters& counters) const {
+        ShowStats stats;
+        stats.showId = showId;
+        stats.totalSeats = (long long)layout->getTotalSeats() * showCount;
+        stats.bookedSeats = counters.getTotalSeats();
+        stats.bookingCount = counters.getBookings();
+        stats.revenue = counters.getTotalRevenue();
+        stats.cancellationCount = counters.getCancellations();
+        stats.refunds = counters.getRefunds();
+        for(int t = 0; t < BookingCounters::TIER_COUNT; t++) {
+            SeatType type = SeatType(t);
+            stats.tierSeats[t] = (long long)layout->getTierSeatCount(type) * showCount;
+            stats.tierBookedSeats[t] = counters.getSeats(type);
+            stats.tierRevenue[t] = counters.getRevenue(type);
+        }
+        return stats;
+    }
+    
+    // Runs one engine operation, timing it and counting its outcome when
+    // metrics are attached
+    template<typename Fn>
+    auto measure(BookingMetrics::Operation op, Fn fn) const -> decltype(fn()) {
+        if(!metrics) return fn();
+        uint64_t start = BookingMetrics::shouldTime(op) ? BookingMetrics::now() : 0;
+        auto result = fn();
+        if(result.status == BookingStatus::DURABILITY_PENDING) {
+            // Recorded by finishDeferred, so the latency includes the fsync
+            deferredCommit->op = op;
+            deferredCommit->start = start;
+            return result;
+        }
+        metrics->record(op, result.status, start);
+        return result;
+    }
+    
+    // Bookkeeping shared by every path that makes a booking visible
+    void recordCommit(int showIndex, const Booking& booking, const Customer& customer, int slot) {
+        showCounters[showIndex].addBooking(booking);
+        theaterCounters.addBooking(booking);
+        customers.addBooking(customer, slot);
+        settlement.append(booking, booking.getBookedAt(), false);
+    }
+    
+    // A snapshot booking's amounts by tier, straight from its mapped record
+    bool getSnapshotAmounts(const SnapshotBooking& record, SettlementTable::TierAmounts& amounts) const {
+        const SnapshotSeat* saved = getSnapshotSeats(record);
+        for(uint32_t i = 0; i < record.seatCount; i++) {
+            if(!layout->isValid(saved[i].row, saved[i].col)) return false;
+            amounts.addSeat(layout->getRowType(saved[i].row), saved[i].price);
+        }
+        return true;
+    }
+    
+    // Adds the sales and cancellations of the loaded snapshot to the
+    // settlement lines without building the bookings. Cancellations
+    // replayed from the journal are already in the live table.
+    void settleSnapshotBookings() const {
+        const SnapshotHeader* header = getSnapshotHeader();
+        if(!header) return;
+        for(int i = 0; i < bookings.getSnapshotCount(); i++) {
+            const SnapshotBooking* record = getSnapshotRecord(i);
+            int showIndex = record ? findShowIndex(record->showId) : -1;
+            SettlementTable::TierAmounts amounts;
+            if(showIndex < 0 || !getSnapshotAmounts(*record, amounts)) continue;
+            snapshotSettlement.append(showIndex, time_t(record->bookedAt), amounts, false);
+        }
+        const SnapshotCancellation* cancelled = reinterpret_cast<const SnapshotCancellation*>(
+            snapshot->getData() + header->cancellationsOffset);
+        for(uint64_t i = 0; i < header->cancellationCount; i++) {
+            const SnapshotBooking* record = getSnapshotRecord(cancelled[i].slot);
+            int showIndex = record ? findShowIndex(record->showId) : -1;
+            SettlementTable::TierAmounts amounts;
+            if(showIndex < 0 || cancelled[i].cancelledAt <= 0 ||
+               bookings.getCancelledAt(cancelled[i].slot) != time_t(cancelled[i].cancelledAt) ||
+               !getSnapshotAmounts(*record, amounts)) continue;
+            snapshotSettlement.append(showIndex, time_t(cancelled[i].cancelledAt), amounts, true);
+        }
+    }
+    
+public:
+    Theater(string n, shared_ptr<const SeatLayout> l) 
+        : name(n), layout(l), customers(catalog), recordsAtLastSnapshot(0),
+          receipts(nullptr), metrics(nullptr), stopping(false) {
+        gridHeader = "\n    ";
+        for(int j = 0; j < layout->getCols(); j++) {
+            char number[16];
+            snprintf(number, sizeof(number), "%3d", j + 1);
+            gridHeader += number;
+        }
+        gridHeader += "\n";
+    }
+    
+    Theater(string n, int r, int c) : Theater(n, make_shared<SeatLayout>(r, c)) {}
+    
+    ~Theater() {
+        {
+            lock_guard<mutex> guard(backgroundLock);
+            stopping = true;
+        }
+        backgroundWake.notify_all();
+        if(snapshotThread.joinable()) snapshotThread.join();
+        if(repriceThread.joinable()) repriceThread.join();
+        if(holdSweeper.joinable()) holdSweeper.join();
+    }
+    
+    // Shows must all be added before booking threads start. Returns false,
+    // adding nothing, if the id is taken, the start cannot be read, or the
+    // show overlaps another one in this hall.
+    bool addShow(const Show& show) {
+        ShowSchedule::Entry entry = {show.getStartTime(), show.getEndTime(), 0, show.getShowId()};
+        if(findShowIndex(show.getShowId()) >= 0 || entry.start < 0) return false;
+        if(!schedule.add(entry, show.getMovie().getTitle())) return false;
+        showIndexById[show.getShowId()] = catalog.addShow(show);
+        occupancy.emplace_back(layout);
+        showCounters.emplace_back();
+        pricing.emplace_back(layout);
+        gridCaches.emplace_back();
+        changeLogs.emplace_back();
+        return true;
+    }
+    
+    // Get number of shows - FIXED: Added this method
+    int getShowCount() const {
+        return catalog.getShowCount();
+    }
+    
+    const string& getName() const { return name; }
+    const Show& getShow(int showIndex) const { return catalog.getShow(showIndex); }
+    const Catalog& getCatalog() const { return catalog; }
+    const ShowSchedule& getSchedule() const { return schedule; }
+    
+    // Show indexes from the earliest start to the latest
+    vector<int> getShowsByStart() const {
+        vector<int> order;
+        for(const auto& entry : schedule.getStarting(numeric_limits<time_t>::min(), numeric_limits<time_t>::max())) {
+            order.push_back(findShowIndex(entry.showId));
+        }
+        return order;
+    }
+    
+    // Returns the show's index, or -1 if no show has this id
+    int findShowIndex(int showId) const {
+        auto it = showIndexById.find(showId);
+        return it == showIndexById.end() ? -1 : it->second;
+    }
+    
+    void displaySeatingGrid(int showIndex) const {
+        if(!isValidShow(showIndex)) {
+            cout << "Invalid show selection! Available shows: 1-" << catalog.getShowCount() << endl;
+            return;
+        }
+        const ShowOccupancy& seatMap = occupancy[showIndex];
+        
+        cout << "\n=== SEATING ARRANGEMENT ===" << endl;
+        cout << "Show ID: " << catalog.getShow(showIndex).getShowId() << " | "
+             << catalog.getShow(showIndex).getMovie().getTitle() << endl;
+        cout << "Legend: O = Available, R = Reserved, X = Booked";
+        if(layout->hasKind(SeatKind::WHEELCHAIR)) cout << ", W = Wheelchair space";
+        cout << endl;
+        const ShowPricing& showPricing = pricing[showIndex];
+        cout << "VIP (Rs." << formatRupees(showPricing.getTierPrice(SeatType::VIP))
+             << ") | Premium (Rs." << formatRupees(showPricing.getTierPrice(SeatType::PREMIUM))
+             << ") | Regular (Rs." << formatRupees(showPricing.getTierPrice(SeatType::REGULAR)) << ")" << endl;
+        
+        SeatGridCache& cache = gridCaches[showIndex];
+        lock_guard<mutex> guard(cache.lock);
+        if(!cache.drawn) {
+            cache.versions.assign(layout->getRows(), SeatGridCache::REDRAW);
+            cache.rows.assign(layout->getRows(), string());
+            cache.drawn = true;
+        }
+        // Row versions are read after the view is opened: every change it
+        // sees has bumped them, and a cached row is kept only if it was
+        // drawn with nothing in flight
+        ReadView view = openReadView();
+        string grid = gridHeader;
+        vector<SeatStatus> seats;
+        for(int i = 0; i < layout->getRows(); i++) {
+            uint64_t rowVersion = seatMap.getRowVersion(i);
+            if(rowVersion != cache.versions[i]) {
+                bool settled = drawGridRow(view, showIndex, i, seats, cache.rows[i]);
+                cache.versions[i] = settled ? rowVersion : SeatGridCache::REDRAW;
+            }
+            grid += cache.rows[i];
+        }
+        cout << grid;
+        cout << "\n        SCREEN" << endl;
+        cout << "=========================" << endl;
+    }
+    
+    // Lists shows by start time; the numbers follow getShowsByStart
+    void displayShows() const {
+        cout << "\n=== AVAILABLE SHOWS ===" << endl;
+        vector<int> order = getShowsByStart();
+        for(size_t i = 0; i < order.size(); i++) {
+            cout << "\n" << (i + 1) << ". ";
+            catalog.getShow(order[i]).displayShowInfo();
+            cout << "------------------------" << endl;
+        }
+    }
+    
+    // Booking engine: safe to call from many threads at once. The seats are
+    // claimed together or not at all, and only words of the chosen show's
+    // seat map are touched, so bookings for other shows never contend.
+    BookingResult commitBooking(int showIndex, const SeatRequest& request, const Customer& customer) {
+        return measure(BookingMetrics::Operation::BOOK, [&]() -> BookingResult {
+            if(!isValidShow(showIndex)) {
+                return {BookingStatus::INVALID_SHOW, nullptr, -1};
+            }
+            
+            if(request.isTooLong()) {
+                return {BookingStatus::TOO_MANY_SEATS, nullptr, -1};
+            }
+            SeatList seatsToBook;
+            int invalidSeat = parseSeats(showIndex, request, seatsToBook);
+            if(invalidSeat >= 0) {
+                return {BookingStatus::INVALID_SEAT, nullptr, invalidSeat};
+            }
+            return commitSeats(showIndex, seatsToBook, customer, SeatStatus::AVAILABLE);
+        });
+    }
+    
+    BookingResult commitBooking(int showIndex, const vector<string>& seatIds, const Customer& customer) {
+        return commitBooking(showIndex, makeRequest(seatIds), customer);
+    }
+    
+    // Parks seats in RESERVED for checkout; they return to AVAILABLE unless
+    // the hold is confirmed within ttlSeconds
+    HoldResult holdSeats(int showIndex, const SeatRequest& request, int ttlSeconds) {
+        return measure(BookingMetrics::Operation::HOLD, [&]() -> HoldResult {
+            if(!isValidShow(showIndex)) {
+                return {BookingStatus::INVALID_SHOW, -1, -1};
+            }
+            
+            if(request.isTooLong()) {
+                return {BookingStatus::TOO_MANY_SEATS, -1, -1};
+            }
+            SeatList seatsToHold;
+            int invalidSeat = parseSeats(showIndex, request, seatsToHold);
+            if(invalidSeat >= 0) {
+                return {BookingStatus::INVALID_SEAT, -1, invalidSeat};
+            }
+            
+            call_once(holdSweeperStarted, [this]() { holdSweeper = thread(&Theater::holdSweepLoop, this); });
+            int failedSeat = occupancy[showIndex].transition(seatsToHold, SeatStatus::AVAILABLE, SeatStatus::RESERVED);
+            if(failedSeat >= 0) {
+                return {BookingStatus::SEAT_UNAVAILABLE, -1, failedSeat};
+            }
+            return {BookingStatus::SUCCESS, holds.add(showIndex, seatsToHold, max(ttlSeconds, 1)), -1};
+        });
+    }
+    
+    HoldResult holdSeats(int showIndex, const vector<string>& seatIds, int ttlSeconds) {
+        return holdSeats(showIndex, makeRequest(seatIds), ttlSeconds);
+    }
+    
+    // Books the seats of a hold that has not expired
+    BookingResult confirmHold(long long holdId, const Customer& customer) {
+        return measure(BookingMetrics::Operation::CONFIRM, [&]() -> BookingResult {
+            HoldTable::Hold hold;
+            if(!holds.confirm(holdId, hold)) {
+                return {BookingStatus::HOLD_NOT_FOUND, nullptr, -1};
+            }
+            return commitSeats(hold.showIndex, hold.seats, customer, SeatStatus::RESERVED);
+        });
+    }
+    
+    bool releaseHold(long long holdId) {
+        HoldTable::Hold hold;
+        if(!holds.release(holdId, hold)) return false;
+        occupancy[hold.showIndex].transition(hold.seats, SeatStatus::RESERVED, SeatStatus::AVAILABLE);
+        return true;
+    }
+    
+    // Returns the seats of every hold past its time to AVAILABLE
+    int expireHolds() {
+        vector<HoldTable::Hold> due;
+        holds.collectExpired(due);
+        for(const HoldTable::Hold& hold : due) {
+            occupancy[hold.showIndex].transition(hold.seats, SeatStatus::RESERVED, SeatStatus::AVAILABLE);
+        }
+        return due.size();
+    }
+    
+    HoldTable::Counters getHoldCounters() const { return holds.getCounters(); }
+    
+    // Sets aside room for this many more bookings, so committing them
+    // allocates no memory
+    void preallocateBookings(int count) {
+        int total = bookings.size() + count;
+        bookings.preallocate(total);
+        customers.preallocate(total);
+        settlement.preallocate(settlement.size() + (long long)count * BookingCounters::TIER_COUNT);
+    }
+    
+    // Books the best block of adjacent seats in one tier. The block is found
+    // on a lock-free read of the seat map, so a concurrent booking can take
+    // one of its seats first; the search then runs again on the newer map.
+    BookingResult commitBestSeats(int showIndex, SeatType tier, int count, const Customer& customer) {
+        return measure(BookingMetrics::Operation::BOOK_BEST, [&]() -> BookingResult {
+            if(!isValidShow(showIndex)) {
+                return {BookingStatus::INVALID_SHOW, nullptr, -1};
+            }
+            if(count < 1) {
+                return {BookingStatus::INVALID_SEAT, nullptr, -1}; // no seats asked for
+            }
+            if(count > SeatList::CAPACITY) {
+                return {BookingStatus::TOO_MANY_SEATS, nullptr, -1};
+            }
+            for(int attempt = 0; attempt < BEST_SEAT_ATTEMPTS; attempt++) {
+                int row, col;
+                if(!occupancy[showIndex].findBestBlock(tier, count, row, col)) {
+                    return {BookingStatus::NO_ADJACENT_SEATS, nullptr, -1};
+                }
+                SeatList seatsToBook;
+                for(int k = 0; k < count; k++) {
+                    seatsToBook.add(layout->makeSeat(row, col + k, SeatStatus::BOOKED));
+                }
+                pricing[showIndex].priceSeats(seatsToBook);
+                BookingResult result = commitSeats(showIndex, seatsToBook, customer, SeatStatus::AVAILABLE);
+                if(result.status != BookingStatus::SEAT_UNAVAILABLE) return result;
+                if(metrics) metrics->addBestSeatRetry();
+            }
+            return {BookingStatus::SEAT_UNAVAILABLE, nullptr, -1};
+        });
+    }
+    
+    // Cancels a booking and refunds what the customer paid. Its seats go
+    // back to AVAILABLE and it stays readable as a tombstone in its slot,
+    // so cancelling costs the same however many bookings exist. Safe to
+    // call from many threads; a booking is cancelled at most once.
+    CancelResult commitCancellation(int bookingId) {
+        return measure(BookingMetrics::Operation::CANCEL, [&]() -> CancelResult {
+            int slot = getSlotFor(bookingId);
+            const Booking* booking = bookings.get(slot);
+            if(!booking) {
+                return {BookingStatus::BOOKING_NOT_FOUND, nullptr, 0};
+            }
+            if(!bookings.beginCancel(slot)) {
+                return {BookingStatus::ALREADY_CANCELLED, booking, 0};
+            }
+            time_t cancelledAt = time(0);
+            
+            // Write ahead, as for bookings: the seats are freed only once the
+            // cancellation is durable
+            if(journal) {
+                static thread_local string payload;
+                BookingJournal::encodeCancellation(bookingId, cancelledAt, payload);
+                PendingCommit waited;
+                PendingCommit& commit = deferredCommit ? *deferredCommit : waited;
+                commit.cancellation = true;
+                commit.slot = slot;
+                commit.cancelledAt = cancelledAt;
+                commit.lsn = journal->append(payload, &commit.generation);
+                if(deferredCommit) return {BookingStatus::DURABILITY_PENDING, booking, 0};
+                completeCancellation(commit);
+                return {commit.status, booking, commit.refund};
+            } else {
+                applyCancellation(slot, *booking, cancelledAt);
+            }
+            return {BookingStatus::SUCCESS, booking, booking->getTotalAmount()};
+        });
+    }
+    
+    // A booking or cancellation whose journal record is queued but not yet
+    // durable, with what it takes to finish it
+    struct PendingCommit {
+        bool cancellation = false;
+        uint64_t lsn = 0;
+        int generation = 0;
+        int showIndex = -1, slot = -1;
+        time_t cancelledAt = 0;
+        optional<Booking> booking;   // to publish
+        optional<Customer> customer; // the caller's, copied when deferred
+        SeatList seats;
+        SeatChangeLog::Change* change = nullptr;
+        BookingMetrics::Operation op = BookingMetrics::Operation::BOOK;
+        uint64_t start = 0;
+        
+        // Set once finished
+        BookingStatus status = BookingStatus::DURABILITY_PENDING;
+        const Booking* committed = nullptr;
+        Paise refund = 0;
+    };
+    
+private:
+    static thread_local PendingCommit* deferredCommit; // see deferDurability
+    
+public:
+    // Until called again with null, a booking or cancellation this thread
+    // journals returns DURABILITY_PENDING as soon as its record is queued,
+    // leaving the rest of the commit in `pending` for finishDeferred. The
+    // seats stay claimed meanwhile. One commit per pending record.
+    static void deferDurability(PendingCommit* pending) { deferredCommit = pending; }
+    
+    // Finishes a deferred commit, first waiting for its record to be
+    // durable if it is not yet; any thread may call it. Sets the status,
+    // and the booking and refund on success.
+    void finishDeferred(PendingCommit& commit) {
+        if(commit.cancellation) completeCancellation(commit);
+        else completeBooking(commit, *commit.customer);
+        if(metrics) metrics->record(commit.op, commit.status, commit.start);
+    }
+    
+    // Reprices a show's seats from its sales so far and its start time.
+    // Bookings made meanwhile get either the old or the new prices.
+    void repriceShow(int showIndex, time_t now) {
+        long long sold[BookingCounters::TIER_COUNT];
+        for(int t = 0; t < BookingCounters::TIER_COUNT; t++) sold[t] = showCounters[showIndex].getSeats(SeatType(t));
+        time_t start = catalog.getShow(showIndex).getStartTime();
+        long long minutesToShow = start < 0 ? LLONG_MAX : (long long)difftime(start, now) / 60;
+        pricing[showIndex].reprice(sold, minutesToShow);
+    }
+    
+    void repriceAll() {
+        time_t now = time(0);
+        for(int s = 0; s < catalog.getShowCount(); s++) repriceShow(s, now);
+    }
+    
+    const ShowPricing& getPricing(int showIndex) const { return pricing[showIndex]; }
+    
+    // When the booking was cancelled, or 0 if it is live
+    time_t getCancelledAt(const Booking& booking) const {
+        return bookings.getCancelledAt(getSlotFor(booking.getBookingId()));
+    }
+    
+private:
+    // Tombstones a booking claimed with beginCancel, then frees its seats.
+    // The seats are logged as the booking's first, so views opened before
+    // the tombstone still find them booked, and views after it find them
+    // free while they are still BOOKED in the seat map.
+    void applyCancellation(int slot, const Booking& booking, time_t cancelledAt) {
+        ShowOccupancy& seatMap = occupancy[booking.getShowIndex()];
+        SeatChangeLog& log = changeLogs[booking.getShowIndex()];
+        SeatChangeLog::Change* change = log.add(slot, booking.getBookedSeats(), true, bookings, views);
+        seatMap.touch(booking.getBookedSeats());
+        bookings.finishCancel(slot, cancelledAt);
+        seatMap.beginChange(booking.getBookedSeats());
+        seatMap.transition(booking.getBookedSeats(), SeatStatus::BOOKED, SeatStatus::AVAILABLE);
+        log.finishFreeing(change);
+        seatMap.endChange(booking.getBookedSeats());
+        showCounters[booking.getShowIndex()].removeBooking(booking);
+        theaterCounters.removeBooking(booking);
+        settlement.append(booking, cancelledAt, true);
+    }
+    
+    static SeatRequest makeRequest(const vector<string>& seatIds) {
+        SeatRequest request;
+        for(const string& seatId : seatIds) request.add(seatId.data(), seatId.size());
+        return request;
+    }
+    
+    // Resolves requested seats to seats marked BOOKED; returns the index of
+    // the first invalid one, or -1. Callers reject requests that are too long.
+    int parseSeats(int showIndex, const SeatRequest& request, SeatList& seats) const {
+        for(int i = 0; i < request.size(); i++) {
+            optional<Seat> seat = findSeat(showIndex, request.getRow(i), request.getCol(i));
+            if(!seat) return i;
+            // At its tier's base price until priceSeats prices them together
+            seats.add(layout->makeSeat(seat->getRow(), seat->getCol(), SeatStatus::BOOKED));
+        }
+        pricing[showIndex].priceSeats(seats);
+        return -1;
+    }
+    
+    // Moves seats from `from` (AVAILABLE, or RESERVED under a hold we own)
+    // to BOOKED and publishes the booking. On failure the seats go back to
+    // AVAILABLE. The seats are logged under the booking's slot while they
+    // are claimed, so read views keep seeing them free until it commits.
+    BookingResult commitSeats(int showIndex, const SeatList& seatsToBook, const Customer& customer,
+                              SeatStatus from) {
+        ShowOccupancy& seatMap = occupancy[showIndex];
+        seatMap.beginChange(seatsToBook);
+        int failedSeat = seatMap.transition(seatsToBook, from, SeatStatus::BOOKED);
+        if(failedSeat >= 0) {
+            seatMap.endChange(seatsToBook);
+            return {BookingStatus::SEAT_UNAVAILABLE, nullptr, failedSeat};
+        }
+        
+        int slot = bookings.reserve();
+        if(slot < 0) {
+            seatMap.transition(seatsToBook, SeatStatus::BOOKED, SeatStatus::AVAILABLE);
+            seatMap.endChange(seatsToBook);
+            return {BookingStatus::STORE_FULL, nullptr, -1};
+        }
+        SeatChangeLog::Change* change = changeLogs[showIndex].add(slot, seatsToBook, false, bookings, views);
+        seatMap.endChange(seatsToBook);
+        
+        Booking booking(FIRST_BOOKING_ID + slot, showIndex, customer.getCustomerId());
+        for(const Seat& seat : seatsToBook) {
+            booking.addSeat(seat);
+        }
+        
+        // Write ahead: the booking only becomes visible once it is durable.
+        // Each thread encodes into its own buffer, reused from booking to booking.
+        if(journal) {
+            static thread_local string payload;
+            BookingJournal::encode(booking, catalog.getShow(showIndex).getShowId(), customer, payload);
+            PendingCommit waited;
+            PendingCommit& commit = deferredCommit ? *deferredCommit : waited;
+            commit.showIndex = showIndex;
+            commit.slot = slot;
+            commit.booking.emplace(move(booking));
+            commit.seats = seatsToBook;
+            commit.change = change;
+            commit.lsn = journal->append(payload, &commit.generation);
+            if(deferredCommit) {
+                commit.customer.emplace(customer);
+                return {BookingStatus::DURABILITY_PENDING, nullptr, -1};
+            }
+            completeBooking(commit, customer);
+            return {commit.status, commit.committed, -1};
+        }
+        const Booking& committed = bookings.publish(slot, move(booking));
+        recordCommit(showIndex, committed, customer, slot);
+        if(receipts) receipts->submit(committed, catalog);
+        return {BookingStatus::SUCCESS, &committed, -1};
+    }
+    
+    // Waits for a journaled booking to be durable, then publishes it; if
+    // the journal failed its seats go back to AVAILABLE
+    void completeBooking(PendingCommit& commit, const Customer& customer) {
+        ShowOccupancy& seatMap = occupancy[commit.showIndex];
+        if(!journal->waitDurable(commit.lsn)) {
+            seatMap.beginChange(commit.seats);
+            seatMap.transition(commit.seats, SeatStatus::BOOKED, SeatStatus::AVAILABLE);
+            changeLogs[commit.showIndex].remove(commit.change);
+            seatMap.endChange(commit.seats);
+            journal->finishCommit(commit.generation);
+            commit.status = BookingStatus::JOURNAL_FAILED;
+            return;
+        }
+        const Booking& committed = bookings.publish(commit.slot, move(*commit.booking));
+        journal->finishCommit(commit.generation);
+        recordCommit(commit.showIndex, committed, customer, commit.slot);
+        if(receipts) receipts->submit(committed, catalog);
+        commit.status = BookingStatus::SUCCESS;
+        commit.committed = &committed;
+    }
+    
+    // Waits for a journaled cancellation to be durable, then frees the
+    // seats; if the journal failed the booking stays live
+    void completeCancellation(PendingCommit& commit) {
+        const Booking* booking = bookings.get(commit.slot);
+        commit.committed = booking;
+        if(!journal->waitDurable(commit.lsn)) {
+            bookings.abortCancel(commit.slot);
+            journal->finishCommit(commit.generation);
+            commit.status = BookingStatus::JOURNAL_FAILED;
+            return;
+        }
+        applyCancellation(commit.slot, *booking, commit.cancelledAt);
+        journal->finishCommit(commit.generation);
+        commit.status = BookingStatus::SUCCESS;
+        commit.refund = booking->getTotalAmount();
+    }
+    
+public:
+    
+    // Re-applies one journaled booking; used only during single-threaded recovery
+    bool restoreBooking(const JournalBooking& entry) {
+        int showIndex = findShowIndex(entry.showId);
+        int slot = getSlotFor(entry.bookingId);
+        if(showIndex < 0 || entry.seats.empty() || entry.seats.size() > (size_t)SeatList::CAPACITY) return false;
+        
+        SeatList seatsToBook;
+        for(const auto& saved : entry.seats) {
+            if(!layout->isValid(saved.row, saved.col)) return false;
+            Seat seat(saved.row, saved.col, layout->getRowType(saved.row), saved.price);
+            seat.setStatus(SeatStatus::BOOKED);
+            if(!seatsToBook.add(seat)) return false;
+        }
+        if(!bookings.reserveAt(slot)) return false;
+        if(occupancy[showIndex].transition(seatsToBook, SeatStatus::AVAILABLE, SeatStatus::BOOKED) >= 0) {
+            return false;
+        }
+        
+        Customer customer(entry.name, entry.phone, entry.email, entry.customerId);
+        Booking booking(entry.bookingId, showIndex, entry.customerId, time_t(entry.bookedAt));
+        for(const Seat& seat : seatsToBook) {
+            booking.addSeat(seat);
+        }
+        recordCommit(showIndex, bookings.publish(slot, move(booking)), customer, slot);
+        return true;
+    }
+    
+    // Re-applies one journaled cancellation; used only during recovery
+    bool restoreCancellation(const JournalBooking& entry) {
+        int slot = getSlotFor(entry.bookingId);
+        const Booking* booking = bookings.get(slot);
+        if(!booking || !bookings.beginCancel(slot)) return false;
+        applyCancellation(slot, *booking, time_t(entry.cancelledAt));
+        return true;
+    }
+    
+    struct RecoveryStats {
+        long long snapshotBookings; // booking slots served from the snapshot
+        double snapshotSeconds;
+        BookingJournal::ReplayStats replay;
+        long long restored;
+        long long skipped;  // already covered by the snapshot
+        long long rejected;
+        double seconds;     // snapshot load plus journal replay
+    };
+    
+    // "cinereserve.journal" -> "cinereserve.snapshot"
+    static string getSnapshotPathFor(const string& journalPath) {
+        const string suffix = ".journal";
+        if(journalPath.size() > suffix.size() &&
+           journalPath.compare(journalPath.size() - suffix.size(), suffix.size(), suffix) == 0) {
+            return journalPath.substr(0, journalPath.size() - suffix.size()) + ".snapshot";
+        }
+        return journalPath + ".snapshot";
+    }
+    
+    // Restores state from the latest snapshot plus the journal written since,
+    // then keeps the journal open so every later booking is logged before it
+    // is confirmed. Must be called after all shows are added and before
+    // booking starts.
+    bool openJournal(const string& path, RecoveryStats& stats) {
+        stats = {0, 0.0, {0, 0, 0}, 0, 0, 0, 0.0};
+        snapshotPath = getSnapshotPathFor(path);
+        auto start = chrono::steady_clock::now();
+        if(!loadSnapshot(snapshotPath, stats.snapshotBookings)) {
+            cerr << "Snapshot " << snapshotPath << " is unreadable or does not match this theater" << endl;
+            return false;
+        }
+        stats.snapshotSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        
+        // A rotated journal is left behind if we stopped mid-snapshot
+        string rotatedPath = BookingJournal::getRotatedPath(path);
+        struct stat info;
+        bool hasRotated = stat(rotatedPath.c_str(), &info) == 0;
+        auto apply = [&](const JournalBooking& entry) {
+            const Booking* booking = bookings.get(getSlotFor(entry.bookingId));
+            if(entry.cancelledAt) {
+                if(booking && getCancelledAt(*booking)) stats.skipped++;
+                else if(restoreCancellation(entry)) stats.restored++;
+                else stats.rejected++;
+            } else {
+                if(booking) stats.skipped++;
+                else if(restoreBooking(entry)) stats.restored++;
+                else stats.rejected++;
+            }
+        };
+        BookingJournal::ReplayStats part;
+        if(hasRotated) {
+            if(!BookingJournal::replay(rotatedPath, apply, part)) return false;
+            stats.replay = part;
+        }
+        if(!BookingJournal::replay(path, apply, part)) return false;
+        stats.replay.records += part.records;
+        stats.replay.bytes += part.bytes;
+        stats.replay.discardedBytes += part.discardedBytes;
+        stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        
+        journal.reset(new BookingJournal());
+        if(!journal->open(path)) {
+            journal.reset();
+            return false;
+        }
+        // Fold the leftover rotated journal into a fresh snapshot before deleting it
+        if(hasRotated) {
+            lock_guard<mutex> guard(snapshotLock);
+            if(!writeSnapshotFile() || !journal->dropRotated()) return false;
+        }
+        return true;
+    }
+    
+    // Writes a snapshot of every committed booking and the seat maps they
+    // imply, then truncates the journal. Booking continues meanwhile: the
+    // journal is rotated first, so anything not captured is in the new file
+    // and is skipped on replay if the snapshot already has it.
+    bool writeSnapshot() {
+        if(snapshotPath.empty()) return false;
+        lock_guard<mutex> guard(snapshotLock);
+        
+        if(journal) {
+            uint64_t records = journal->getRecordCount();
+            int oldGeneration = journal->rotate();
+            if(oldGeneration < 0) return false;
+            journal->waitForCommits(oldGeneration);
+            recordsAtLastSnapshot = records;
+        }
+        if(!writeSnapshotFile()) return false;
+        
+        // The snapshot now covers the rotated journal
+        if(journal) journal->dropRotated();
+        return true;
+    }
+    
+    // Queues a receipt for every booking made from now on. The pipeline
+    // must be closed before the theater is destroyed.
+    void setReceiptPipeline(ReceiptPipeline* pipeline) { receipts = pipeline; }
+    void setMetrics(BookingMetrics* engineMetrics) { metrics = engineMetrics; }
+    BookingMetrics* getMetrics() const { return metrics; }
+    
+    // Appends the theater's own counters in the Prometheus text format:
+    // seat contention, journal group commit, holds and sales
+    void appendMetrics(string& out) const {
+        HoldTable::Counters holdCounters = holds.getCounters();
+        auto counter = [&out](const char* name, const char* help, const char* type, long long value) {
+            out += "# HELP ";
+            out += name;
+            out += ' ';
+            out += help;
+            out += "\n# TYPE ";
+            out += name;
+            out += ' ';
+            out += type;
+            out += '\n';
+            out += name;
+            out += ' ';
+            out += to_string(value);
+            out += '\n';
+        };
+        counter("cinereserve_seat_cas_retries_total", "Seat map compare-and-swap retries.", "counter",
+                (long long)getCasRetries());
+        if(journal) {
+            counter("cinereserve_journal_records_total", "Journal records written.", "counter",
+                    (long long)journal->getRecordCount());
+            counter("cinereserve_journal_fsyncs_total", "Journal fsyncs (one per commit group).", "counter",
+                    (long long)journal->getFsyncCount());
+        }
+        counter("cinereserve_holds_active", "Checkout holds in progress.", "gauge", holdCounters.active);
+        counter("cinereserve_holds_expired_total", "Checkout holds that timed out.", "counter", holdCounters.expired);
+        counter("cinereserve_bookings", "Live bookings.", "gauge", theaterCounters.getBookings());
+        counter("cinereserve_seats_booked", "Seats held by live bookings.", "gauge", theaterCounters.getTotalSeats());
+        counter("cinereserve_cancellations_total", "Bookings cancelled.", "counter", theaterCounters.getCancellations());
+    }
+    
+    // Reprices every show in the background
+    void startPeriodicRepricing(int intervalSeconds) {
+        if(repriceThread.joinable() || intervalSeconds <= 0) return;
+        repriceThread = thread(&Theater::repriceLoop, this, intervalSeconds);
+    }
+    
+    // Snapshots in the background whenever new bookings were journaled
+    void startPeriodicSnapshots(int intervalSeconds) {
+        if(snapshotThread.joinable() || intervalSeconds <= 0) return;
+        snapshotThread = thread(&Theater::snapshotLoop, this, intervalSeconds);
+    }
+    
+private:
+    // Captures the bookings in a read view and writes the snapshot file;
+    // caller holds snapshotLock. Commits are stamped before their journal
+    // generation is finished, so a view opened after the rotated journal's
+    // commits have drained covers all of it.
+    bool writeSnapshotFile() {
+        int wordsPerShow = occupancy.empty() ? 0 : occupancy[0].getWordCount();
+        ReadView view = openReadView();
+        int count = bookings.size();
+        vector<int32_t> showIds;
+        for(int s = 0; s < catalog.getShowCount(); s++) showIds.push_back(catalog.getShow(s).getShowId());
+        vector<uint64_t> words(catalog.getShowCount() * wordsPerShow, 0);
+        for(size_t i = 0; i < words.size(); i++) words[i] = occupancy[i / wordsPerShow].getGapBits(i % wordsPerShow);
+        vector<SnapshotBooking> table(count);
+        vector<SnapshotSeat> seatTable;
+        vector<SnapshotCounters> counters(catalog.getShowCount(), SnapshotCounters());
+        vector<SnapshotCancellation> cancellations;
+        string heap;
+        
+        // Counters are rebuilt from the captured bookings so they always
+        // agree with the seat words written alongside them
+        auto markBooked = [&](int showIndex, int row, int col, Paise price) {
+            const ShowOccupancy& seatMap = occupancy[showIndex];
+            words[size_t(showIndex) * wordsPerShow + seatMap.wordIndex(row, col)] |=
+                uint64_t(SeatStatus::BOOKED) << ShowOccupancy::shiftFor(col);
+            int tier = int(layout->getRowType(row));
+            counters[showIndex].seats[tier]++;
+            counters[showIndex].revenue[tier] += Booking::getGrossPrice(price);
+        };
+        
+        for(int i = 0; i < count; i++) {
+            SnapshotBooking& record = table[i];
+            memset(&record, 0, sizeof(record));
+            if(!view.isCommitted(i)) continue;
+            bool fromSnapshot;
+            const Booking* booking = bookings.peek(i, fromSnapshot);
+            time_t cancelledAt = view.getCancelledAt(i);
+            if(booking) {
+                const Customer& customer = catalog.getCustomer(booking->getCustomerId());
+                record.bookingId = booking->getBookingId();
+                record.showId = catalog.getShow(booking->getShowIndex()).getShowId();
+                record.customerId = customer.getCustomerId();
+                record.bookedAt = booking->getBookedAt();
+                record.firstSeat = seatTable.size();
+                appendSnapshotString(heap, customer.getName(), record.nameOffset, record.nameLength);
+                appendSnapshotString(heap, customer.getPhone(), record.phoneOffset, record.phoneLength);
+                appendSnapshotString(heap, customer.getEmail(), record.emailOffset, record.emailLength);
+                int showIndex = findShowIndex(record.showId);
+                for(const Seat& seat : booking->getBookedSeats()) {
+                    seatTable.push_back({uint16_t(seat.getRow()), uint16_t(seat.getCol()), 0, seat.getPrice()});
+                    if(!cancelledAt) markBooked(showIndex, seat.getRow(), seat.getCol(), seat.getPrice());
+                }
+                record.seatCount = booking->getBookedSeats().size();
+                if(cancelledAt) cancellations.push_back({i, 0, cancelledAt, booking->getTotalAmount()});
+                else counters[showIndex].bookings++;
+            } else if(fromSnapshot) {
+                // Never read since startup: copy the old record without decoding it
+                const SnapshotBooking* old = getSnapshotRecord(i);
+                int showIndex = old ? findShowIndex(old->showId) : -1;
+                if(showIndex < 0) continue;
+                record = *old;
+                record.firstSeat = seatTable.size();
+                appendSnapshotString(heap, getSnapshotString(old->nameOffset, old->nameLength),
+                                     record.nameOffset, record.nameLength);
+                appendSnapshotString(heap, getSnapshotString(old->phoneOffset, old->phoneLength),
+                                     record.phoneOffset, record.phoneLength);
+                appendSnapshotString(heap, getSnapshotString(old->emailOffset, old->emailLength),
+                                     record.emailOffset, record.emailLength);
+                const SnapshotSeat* seats = getSnapshotSeats(*old);
+                Paise refund = 0;
+                for(uint32_t k = 0; k < old->seatCount; k++) {
+                    Paise price = seats[k].price;
+                    seatTable.push_back({seats[k].row, seats[k].col, 0, price});
+                    if(!cancelledAt) markBooked(showIndex, seats[k].row, seats[k].col, price);
+                    refund += Booking::getGrossPrice(price);
+                }
+                if(cancelledAt) cancellations.push_back({i, 0, cancelledAt, refund});
+                else counters[showIndex].bookings++;
+            }
+        }
+        
+        auto align8 = [](uint64_t offset) { return (offset + 7) & ~uint64_t(7); };
+        SnapshotHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SNAPSHOT_MAGIC, 8);
+        header.version = SNAPSHOT_VERSION;
+        header.rows = layout->getRows();
+        header.cols = layout->getCols();
+        header.showCount = showIds.size();
+        header.wordsPerShow = wordsPerShow;
+        header.bookingCount = count;
+        header.showTableOffset = sizeof(SnapshotHeader);
+        header.wordsOffset = align8(header.showTableOffset + showIds.size() * sizeof(int32_t));
+        header.bookingTableOffset = header.wordsOffset + words.size() * sizeof(uint64_t);
+        header.seatTableOffset = header.bookingTableOffset + table.size() * sizeof(SnapshotBooking);
+        header.seatCount = seatTable.size();
+        header.stringHeapOffset = header.seatTableOffset + seatTable.size() * sizeof(SnapshotSeat);
+        header.stringHeapSize = heap.size();
+        header.countersOffset = align8(header.stringHeapOffset + heap.size());
+        header.cancellationsOffset = header.countersOffset + counters.size() * sizeof(SnapshotCounters);
+        header.cancellationCount = cancellations.size();
+        header.fileSize = header.cancellationsOffset + cancellations.size() * sizeof(SnapshotCancellation);
+        
+        // Write to a temporary file and rename, so a crash never leaves a partial snapshot
+        string tempPath = snapshotPath + ".tmp";
+        FILE* out = fopen(tempPath.c_str(), "wb");
+        if(!out) return false;
+        const uint64_t zero = 0;
+        bool ok = writeFileData(out, &header, sizeof(header)) &&
+                  writeFileData(out, showIds.data(), showIds.size() * sizeof(int32_t)) &&
+                  writeFileData(out, &zero, header.wordsOffset - header.showTableOffset - showIds.size() * sizeof(int32_t)) &&
+                  writeFileData(out, words.data(), words.size() * sizeof(uint64_t)) &&
+                  writeFileData(out, table.data(), table.size() * sizeof(SnapshotBooking)) &&
+                  writeFileData(out, seatTable.data(), seatTable.size() * sizeof(SnapshotSeat)) &&
+                  writeFileData(out, heap.data(), heap.size()) &&
+                  writeFileData(out, &zero, header.countersOffset - header.stringHeapOffset - heap.size()) &&
+                  writeFileData(out, counters.data(), counters.size() * sizeof(SnapshotCounters)) &&
+                  writeFileData(out, cancellations.data(), cancellations.size() * sizeof(SnapshotCancellation));
+        ok = fflush(out) == 0 && ok && fsync(fileno(out)) == 0;
+        ok = fclose(out) == 0 && ok;
+        if(!ok || rename(tempPath.c_str(), snapshotPath.c_str()) != 0) {
+            remove(tempPath.c_str());
+            return false;
+        }
+        return true;
+    }
+    
+public:
+    const BookingJournal* getJournal() const { return journal.get(); }
+    
+    bool bookSeats(int showIndex, const vector<string>& seatIds, const Customer& customer) {
+        return finishBooking(commitBooking(showIndex, seatIds, customer), seatIds);
+    }
+    
+    bool bookBestSeats(int showIndex, SeatType tier, int count, const Customer& customer) {
+        BookingResult result = commitBestSeats(showIndex, tier, count, customer);
+        if(result.status == BookingStatus::NO_ADJACENT_SEATS) {
+            cout << "No " << count << " adjacent " << SeatLayout::getTierName(tier)
+                 << " seats are available!" << endl;
+            return false;
+        }
+        return finishBooking(result, {});
+    }
+    
+    // Holds the chosen seats while the customer enters their details;
+    // returns the hold id, or -1 if the seats could not be held
+    long long holdForCheckout(int showIndex, const vector<string>& seatIds, int ttlSeconds) {
+        HoldResult hold = holdSeats(showIndex, seatIds, ttlSeconds);
+        if(hold.status == BookingStatus::SUCCESS) {
+            cout << "Seats held for " << ttlSeconds / 60 << " minutes while you check out." << endl;
+            return hold.holdId;
+        }
+        finishBooking({hold.status, nullptr, hold.failedSeat}, seatIds);
+        return -1;
+    }
+    
+    bool bookHeldSeats(long long holdId, const Customer& customer) {
+        return finishBooking(confirmHold(holdId, customer), {});
+    }
+    
+private:
+    // Reports a booking attempt and prints the receipt on success
+    bool finishBooking(const BookingResult& result, const vector<string>& seatIds) {
+        switch(result.status) {
+            case BookingStatus::INVALID_SHOW:
+                cout << "Invalid show selection! Available shows: 1-" << catalog.getShowCount() << endl;
+                return false;
+            case BookingStatus::INVALID_SEAT:
+                cout << "Invalid seat: " << seatIds[result.failedSeat] << endl;
+                return false;
+            case BookingStatus::SEAT_UNAVAILABLE:
+                if(result.failedSeat < 0) {
+                    cout << "Seats were taken by other bookings. Please try again." << endl;
+                } else {
+                    cout << "Seat " << seatIds[result.failedSeat] << " is not available!" << endl;
+                }
+                return false;
+            case BookingStatus::STORE_FULL:
+                cout << "Booking store is full!" << endl;
+                return false;
+            case BookingStatus::JOURNAL_FAILED:
+                cout << "Booking could not be saved. Please try again." << endl;
+                return false;
+            case BookingStatus::HOLD_NOT_FOUND:
+                cout << "Your seat hold has expired. Please choose your seats again." << endl;
+                return false;
+            case BookingStatus::TOO_MANY_SEATS:
+                cout << "At most " << SeatList::CAPACITY << " seats can be booked at once." << endl;
+                return false;
+            default:
+                break;
+        }
+        
+        // Print detailed receipt
+        cout << "\n🎫 PRINTING RECEIPT... 🎫" << endl;
+        result.booking->printReceipt(catalog);
+        
+        // Ask if user wants a copy
+        char choice;
+        cout << "Would you like to save this receipt? (y/n): ";
+        cin >> choice;
+        cin.ignore(); // FIXED: Clear the input buffer
+        if(choice == 'y' || choice == 'Y') {
+            string fileName = "receipt_" + to_string(result.booking->getBookingId()) + ".txt";
+            ofstream receipt(fileName);
+            result.booking->printReceipt(catalog, receipt);
+            if(receipt) cout << "Receipt saved to " << fileName << endl;
+            else cout << "Could not save receipt to " << fileName << endl;
+        }
+        
+        return true;
+    }
+    
+public:
+    
+    optional<Seat> findSeat(int showIndex, const string& seatId) const {
+        int row = -1, col = -1;
+        SeatCode::parse(seatId.data(), seatId.size(), row, col);
+        return findSeat(showIndex, row, col);
+    }
+    
+    optional<Seat> findSeat(int showIndex, int row, int col) const {
+        if(!metrics) return lookupSeat(showIndex, row, col);
+        uint64_t start = BookingMetrics::shouldTime(BookingMetrics::Operation::FIND_SEAT) ? BookingMetrics::now() : 0;
+        optional<Seat> seat = lookupSeat(showIndex, row, col);
+        metrics->record(BookingMetrics::Operation::FIND_SEAT,
+                        seat ? BookingStatus::SUCCESS : BookingStatus::INVALID_SEAT, start);
+        return seat;
+    }
+    
+private:
+    optional<Seat> lookupSeat(int showIndex, int row, int col) const {
+        if(!isValidShow(showIndex) || !layout->isValid(row, col)) {
+            return nullopt;
+        }
+        
+        Seat seat = occupancy[showIndex].getSeat(row, col);
+        seat.setPrice(pricing[showIndex].getPrice(row, col));
+        return seat;
+    }
+    
+public:
+    
+    void displayBookings() const {
+        cout << "\n=== ALL BOOKINGS ===" << endl;
+        if(bookings.size() == 0) {
+            cout << "No bookings found." << endl;
+            return;
+        }
+        
+        // Listed as of one moment, so a cancellation made while printing
+        // does not show against some bookings and not others
+        int count = 0;
+        openReadView().forEachBooking([this, &count](const Booking& booking, time_t cancelledAt) {
+            cout << "\n" << (++count) << ". ";
+            booking.displayBookingDetails(catalog);
+            displayCancellation(booking, cancelledAt);
+            cout << endl;
+        });
+    }
+    
+    // Notes the cancellation under a cancelled booking's details
+    void displayCancellation(const Booking& booking) const {
+        displayCancellation(booking, getCancelledAt(booking));
+    }
+    
+    void displayCancellation(const Booking& booking, time_t cancelledAt) const {
+        if(!cancelledAt) return;
+        cout << "Status: CANCELLED on " << Booking::formatTime(cancelledAt)
+             << " (Rs." << formatRupees(booking.getTotalAmount()) << " refunded)" << endl;
+    }
+    
+    // Returns nullptr if no committed booking has this id
+    const Booking* findBooking(int bookingId) const {
+        uint64_t start = metrics ? BookingMetrics::now() : 0;
+        const Booking* booking = bookings.get(getSlotFor(bookingId));
+        if(metrics) {
+            metrics->record(BookingMetrics::Operation::SEARCH,
+                            booking ? BookingStatus::SUCCESS : BookingStatus::BOOKING_NOT_FOUND, start);
+        }
+        return booking;
+    }
+    
+    // Returns the customer with this phone or email, registering a new
+    // customer with a unique id if there is none
+    const Customer& registerCustomer(const string& name, const string& phone, const string& email) {
+        return customers.registerCustomer(name, phone, email);
+    }
+    
+    // All bookings of the customer with this phone number or email
+    vector<const Booking*> findCustomerBookings(const string& phoneOrEmail) {
+        vector<const Booking*> found;
+        for(int slot : customers.findBookingSlots(phoneOrEmail)) {
+            if(const Booking* booking = bookings.get(slot)) found.push_back(booking);
+        }
+        return found;
+    }
+    
+    void searchCustomerBookings(const string& phoneOrEmail) {
+        vector<const Booking*> found = findCustomerBookings(phoneOrEmail);
+        if(found.empty()) {
+            cout << "❌ No bookings found for " << phoneOrEmail << endl;
+            return;
+        }
+        cout << "\n📋 " << found.size() << " booking(s) found for " << catalog.getCustomer(found[0]->getCustomerId()).getName() << endl;
+        for(const Booking* booking : found) {
+            booking->displayBookingDetails(catalog);
+            displayCancellation(*booking);
+        }
+    }
+    
+    void searchBooking(int bookingId) const {
+        const Booking* booking = findBooking(bookingId);
+        if(!booking) {
+            cout << "❌ Booking not found!" << endl;
+            return;
+        }
+        
+        cout << "\n📋 Booking Found!" << endl;
+        booking->displayBookingDetails(catalog);
+        if(getCancelledAt(*booking)) {
+            displayCancellation(*booking);
+            return; // a cancelled ticket gets no receipt
+        }
+        
+        // Ask if user wants to print receipt
+        char choice;
+        cout << "\nWould you like to print the receipt? (y/n): ";
+        cin >> choice;
+        cin.ignore(); // FIXED: Clear the input buffer
+        if(choice == 'y' || choice == 'Y') {
+            cout << "\n🎫 PRINTING RECEIPT... 🎫" << endl;
+            booking->printReceipt(catalog);
+        }
+    }
+    
+    // Shows the booking, asks for confirmation and cancels it
+    bool cancelBooking(int bookingId) {
+        const Booking* booking = findBooking(bookingId);
+        if(!booking) {
+            cout << "❌ Booking not found!" << endl;
+            return false;
+        }
+        booking->displayBookingDetails(catalog);
+        if(getCancelledAt(*booking)) {
+            displayCancellation(*booking);
+            return false;
+        }
+        
+        char choice;
+        cout << "\nCancel this booking? (y/n): ";
+        cin >> choice;
+        cin.ignore();
+        if(choice != 'y' && choice != 'Y') return false;
+        
+        CancelResult result = commitCancellation(bookingId);
+        switch(result.status) {
+            case BookingStatus::SUCCESS:
+                cout << "✅ Booking " << bookingId << " cancelled. Rs." << formatRupees(result.refund)
+                     << " will be refunded." << endl;
+                return true;
+            case BookingStatus::ALREADY_CANCELLED:
+                cout << "This booking has already been cancelled." << endl;
+                return false;
+            default:
+                cout << "Cancellation could not be saved. Please try again." << endl;
+                return false;
+        }
+    }
+    
+    // Checks that no seat of any show was sold twice and that the seat maps
+    // agree exactly with the live bookings
+    bool verifyIntegrity() const {
+        vector<vector<int>> soldCount(catalog.getShowCount(), vector<int>(layout->getRows() * layout->getCols(), 0));
+        bool ok = true;
+        long long published = 0; // a slot whose commit failed never publishes
+        bookings.forEach([&](const Booking& booking) {
+            published++;
+            if(getCancelledAt(booking)) return;
+            int showIndex = booking.getShowIndex();
+            for(const Seat& seat : booking.getBookedSeats()) {
+                int& count = soldCount[showIndex][seat.getRow() * layout->getCols() + seat.getCol()];
+                if(++count > 1) ok = false;
+            }
+        });
+        long long theaterSeats = 0;
+        for(int s = 0; s < catalog.getShowCount(); s++) {
+            for(int i = 0; i < layout->getRows(); i++) {
+                for(int j = 0; j < layout->getCols(); j++) {
+                    bool booked = occupancy[s].getStatus(i, j) == SeatStatus::BOOKED;
+                    if(booked != (soldCount[s][i * layout->getCols() + j] == 1)) ok = false;
+                }
+            }
+            // The running counters must agree with the seat map too
+            long long sold = occupancy[s].countStatus(SeatStatus::BOOKED);
+            if(showCounters[s].getTotalSeats() != sold) ok = false;
+            theaterSeats += sold;
+        }
+        if(theaterCounters.getTotalSeats() != theaterSeats ||
+           theaterCounters.getBookings() + theaterCounters.getCancellations() != published) ok = false;
+        
+        // Settlement lines must add up to the same totals
+        SettlementTable::Totals settled = settle(SettlementTable::Group::SHOW).total;
+        if(settled.bookings != theaterCounters.getBookings() || settled.seats != theaterSeats ||
+           settled.cancellations != theaterCounters.getCancellations() ||
+           settled.getNet() != theaterCounters.getTotalRevenue() ||
+           settled.refunds != theaterCounters.getRefunds()) ok = false;
+        return ok;
+    }
+    
+    int getBookingCount() const { return bookings.size(); }
+    
+    uint64_t getCasRetries() const {
+        uint64_t total = 0;
+        for(const auto& seatMap : occupancy) total += seatMap.getCasRetries();
+        return total;
+    }
+    
+    // Caller must pass a valid show index
+    ShowStats getShowStats(int showIndex) const {
+        return makeStats(catalog.getShow(showIndex).getShowId(), 1, showCounters[showIndex]);
+    }
+    
+    // Totals across every show of the theater
+    ShowStats getTheaterStats() const {
+        return makeStats(0, catalog.getShowCount(), theaterCounters);
+    }
+    
+    const ShowOccupancy& getSeatMap(int showIndex) const { return occupancy[showIndex]; }
+    
+    // Settlement totals for one local day (see SettlementTable::getDay), or
+    // every day for day -1, over every sale and cancellation including
+    // those recovered at startup. Runs on up to `threads` threads (all
+    // cores for 0) and never blocks bookings.
+    SettlementReport settle(SettlementTable::Group group, int day = -1, int threads = 0) const {
+        call_once(snapshotSettled, [this] { settleSnapshotBookings(); });
+        SettlementReport report;
+        vector<int> movieOfShow(catalog.getShowCount());
+        switch(group) {
+            case SettlementTable::Group::SHOW:
+                for(int s = 0; s < catalog.getShowCount(); s++) {
+                    report.labels.push_back(to_string(catalog.getShow(s).getShowId()));
+                }
+                break;
+            case SettlementTable::Group::MOVIE: {
+                unordered_map<const Movie*, int> keys; // movies are interned, so one pointer per title
+                for(int s = 0; s < catalog.getShowCount(); s++) {
+                    const Movie& movie = catalog.getShow(s).getMovie();
+                    auto it = keys.emplace(&movie, int(report.labels.size())).first;
+                    if(it->second == (int)report.labels.size()) report.labels.push_back(movie.getTitle());
+                    movieOfShow[s] = it->second;
+                }
+                break;
+            }
+            case SettlementTable::Group::TIER:
+                for(int t = 0; t < BookingCounters::TIER_COUNT; t++) {
+                    report.labels.push_back(SeatLayout::getTierName(SeatType(t)));
+                }
+                break;
+            case SettlementTable::Group::HOUR:
+                for(int h = 0; h < 24; h++) {
+                    char label[8];
+                    snprintf(label, sizeof(label), "%02d:00", h);
+                    report.labels.push_back(label);
+                }
+                break;
+        }
+        report.totals.assign(report.labels.size(), SettlementTable::Totals());
+        if(threads <= 0) threads = max(1u, thread::hardware_concurrency());
+        snapshotSettlement.aggregate(group, day, movieOfShow, report.totals, report.total, threads);
+        settlement.aggregate(group, day, movieOfShow, report.totals, report.total, threads);
+        return report;
+    }
+    
+    void displayStats(int showIndex) const {
+        if(!isValidShow(showIndex)) {
+            cout << "Invalid show selection! Available shows: 1-" << catalog.getShowCount() << endl;
+            return;
+        }
+        ShowStats stats = getShowStats(showIndex);
+        ShowStats totals = getTheaterStats();
+        
+        cout << "\n=== THEATER STATISTICS ===" << endl;
+        cout << "Theater: " << name << endl;
+        cout << "Show ID: " << stats.showId << " | " << catalog.getShow(showIndex).getMovie().getTitle() << endl;
+        cout << "Total Seats: " << stats.totalSeats << endl;
+        cout << "Booked Seats: " << stats.bookedSeats << endl;
+        cout << "Available Seats: " << (stats.totalSeats - stats.bookedSeats) << endl;
+        cout << "Occupancy Rate: " << fixed << setprecision(1) 
+             << stats.getOccupancyRate() << "%" << endl;
+        cout << "Total Revenue: Rs." << formatRupees(stats.revenue) << endl;
+        cout << "Total Bookings: " << stats.bookingCount << endl;
+        if(stats.cancellationCount > 0) {
+            cout << "Cancellations: " << stats.cancellationCount << " (Rs." << formatRupees(stats.refunds) << " refunded)" << endl;
+        }
+        cout << "\nBy tier:" << endl;
+        for(int t = BookingCounters::TIER_COUNT - 1; t >= 0; t--) {
+            cout << "  " << left << setw(8) << SeatLayout::getTierName(SeatType(t)) << right
+                 << setw(4) << stats.tierBookedSeats[t] << "/" << setw(4) << stats.tierSeats[t]
+                 << " seats   Rs." << formatRupees(stats.tierRevenue[t]) << endl;
+        }
+        cout << "\nAll shows: " << totals.bookedSeats << "/" << totals.totalSeats << " seats ("
+             << setprecision(1) << totals.getOccupancyRate() << "%), "
+             << totals.bookingCount << " bookings, Rs." << formatRupees(totals.revenue) << endl;
+        cout << "=========================" << endl;
+    }
+    
+    // Settlement for one local day (or every day, for -1); groups with no
+    // sales or cancellations are left out
+    void displaySettlement(SettlementTable::Group group, int day) const {
+        SettlementReport report = settle(group, day);
+        cout << "\n=== SETTLEMENT REPORT ===" << endl;
+        cout << "Theater: " << name << (day < 0 ? " | All days" : " | Today") << endl;
+        cout << left << setw(22) << "Group" << right << setw(9) << "Bookings" << setw(7) << "Seats"
+             << setw(13) << "Subtotal" << setw(10) << "Fees" << setw(11) << "GST"
+             << setw(12) << "Refunds" << setw(13) << "Net" << endl;
+        auto printLine = [](const string& label, const SettlementTable::Totals& totals) {
+            cout << left << setw(22) << label.substr(0, 21) << right << setw(9) << totals.bookings
+                 << setw(7) << totals.seats << setw(13) << formatRupees(totals.subtotal)
+                 << setw(10) << formatRupees(totals.serviceFee) << setw(11) << formatRupees(totals.gst)
+                 << setw(12) << formatRupees(totals.refunds) << setw(13) << formatRupees(totals.getNet()) << endl;
+        };
+        for(size_t k = 0; k < report.totals.size(); k++) {
+            if(report.totals[k].lines > 0) printLine(report.labels[k], report.totals[k]);
+        }
+        printLine("Total", report.total);
+        cout << "=========================" << endl;
+    }
+};
+
+thread_local Theater::PendingCommit* Theater::deferredCommit = nullptr;
+
+// One worker thread that runs every request for the screens it owns, in
+// arrival order, so a screen's seat maps and counters stay on one core.
+// Requests are queued under a short lock and taken a batch at a time.
+class ShardWorker {
+private:
+    mutex lock;
+    condition_variable wake;
+    vector<function<void()>> queue;
+    bool stopping;
+    atomic<long long> executed;
+    thread worker;
+    
+    void run(int core) {
+#ifdef __linux__
+        if(core >= 0) {
+            cpu_set_t cores;
+            CPU_ZERO(&cores);
+            CPU_SET(core, &cores);
+            pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores); // best effort
+        }
+#else
+        (void)core;
+#endif
+        vector<function<void()>> batch;
+        while(true) {
+            {
+                unique_lock<mutex> guard(lock);
+                wake.wait(guard, [this] { return stopping || !queue.empty(); });
+                if(queue.empty()) return; // stopping, and everything queued has run
+                batch.swap(queue);
+            }
+            for(auto& task : batch) task();
+            executed.fetch_add(batch.size(), memory_order_relaxed);
+            batch.clear();
+        }
+    }
+    
+public:
+    // Pins the worker to a core when core >= 0 and the platform allows it
+    explicit ShardWorker(int core) : stopping(false), executed(0), worker(&ShardWorker::run, this, core) {}
+    
+    ~ShardWorker() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+    
+    ShardWorker(const ShardWorker&) = delete;
+    ShardWorker& operator=(const ShardWorker&) = delete;
+    
+    void post(function<void()> task) {
+        {
+            lock_guard<mutex> guard(lock);
+            queue.push_back(move(task));
+        }
+        wake.notify_one();
+    }
+    
+    long long getExecuted() const { return executed.load(memory_order_relaxed); }
+};
+
+// A chain of venues, each with several screens. Every screen is a Theater
+// owned by one shard worker; requests are routed by show id to the shard
+// of the screen showing it, so a busy screen never holds up the others.
+// Chain-wide and venue-wide statistics are summed from each screen's
+// running counters, which are read without involving the shards.
+class Multiplex {
+public:
+    typedef function<void(const BookingResult&)> BookingCallback;
+    
+private:
+    struct Screen {
+        int venue;
+        int shard;
+        unique_ptr<Theater> theater;
+    };
+    
+    struct ShowRoute {
+        int screen;
+        int showIndex; // within the screen's theater
+    };
+    
+    string name;
+    vector<string> venues;
+    deque<Screen> screens;
+    unordered_map<int, ShowRoute> routes; // by show id
+    ShowSchedule schedule; // every screen's shows
+    vector<unique_ptr<ShardWorker>> shards;
+    
+public:
+    // One shard per core unless a count is given; shards are pinned to cores
+    Multiplex(string n, int shardCount = 0) : name(n) {
+        int cores = max(int(thread::hardware_concurrency()), 1);
+        if(shardCount <= 0) shardCount = cores;
+        for(int s = 0; s < shardCount; s++) {
+            shards.emplace_back(new ShardWorker(shardCount <= cores ? s : -1));
+        }
+    }
+    
+    // Venues, screens and shows must all be added before requests are submitted
+    int addVenue(const string& venueName) {
+        venues.push_back(venueName);
+        return venues.size() - 1;
+    }
+    
+    int addScreen(int venue, const string& screenName, int rows, int cols) {
+        int index = screens.size();
+        screens.push_back({venue, index % int(shards.size()),
+                           unique_ptr<Theater>(new Theater(venues[venue] + " " + screenName, rows, cols))});
+        return index;
+    }
+    
+    // Returns false if the show id is already used anywhere in the chain,
+    // or the show overlaps another one on its screen
+    bool addShow(int screen, const Show& show) {
+        if(routes.count(show.getShowId())) return false;
+        Theater& theater = *screens[screen].theater;
+        if(!theater.addShow(show)) return false;
+        schedule.add({show.getStartTime(), show.getEndTime(), screen, show.getShowId()}, show.getMovie().getTitle());
+        routes[show.getShowId()] = {screen, theater.getShowCount() - 1};
+        return true;
+    }
+    
+    const string& getName() const { return name; }
+    int getVenueCount() const { return venues.size(); }
+    int getScreenCount() const { return screens.size(); }
+    int getShardCount() const { return shards.size(); }
+    int getShowCount() const { return routes.size(); }
+    const ShowSchedule& getSchedule() const { return schedule; }
+    const Theater& getScreen(int screen) const { return *screens[screen].theater; }
+    long long getShardExecuted(int shard) const { return shards[shard]->getExecuted(); }
+    
+    // Queues a booking on the shard that owns the show; done runs on that
+    // shard once the booking is committed or rejected
+    void submitBooking(int showId, vector<string> seatIds, Customer customer, BookingCallback done) {
+        auto it = routes.find(showId);
+        if(it == routes.end()) {
+            done({BookingStatus::INVALID_SHOW, nullptr, -1});
+            return;
+        }
+        Theater* theater = screens[it->second.screen].theater.get();
+        int showIndex = it->second.showIndex;
+        shards[screens[it->second.screen].shard]->post(
+            [theater, showIndex, seatIds = move(seatIds), customer = move(customer), done = move(done)]() {
+                done(theater->commitBooking(showIndex, seatIds, customer));
+            });
+    }
+    
+    // Books on the owning shard and waits for the result
+    BookingResult book(int showId, const vector<string>& seatIds, const Customer& customer) {
+        promise<BookingResult> result;
+        future<BookingResult> ready = result.get_future();
+        submitBooking(showId, seatIds, customer, [&result](const BookingResult& r) { result.set_value(r); });
+        return ready.get();
+    }
+    
+    // Sums the screens of one venue, or of the whole chain for venue -1
+    ShowStats getStats(int venue = -1) const {
+        ShowStats total = {};
+        for(const Screen& screen : screens) {
+            if(venue < 0 || screen.venue == venue) total.add(screen.theater->getTheaterStats());
+        }
+        return total;
+    }
+    
+    // Only meaningful once every submitted request has completed
+    bool verifyIntegrity() const {
+        for(const Screen& screen : screens) {
+            if(!screen.theater->verifyIntegrity()) return false;
+        }
+        return true;
+    }
+};
+
+// Streaming importer for a chain's show schedule, one show per line of a
+// CSV (or tab-separated) export:
+//   showId,date,time,title,genre,durationMinutes,rating[,screen]
+//   101,2024-01-15,10:00 AM,"Crouching Tiger, Hidden Dragon",Action,120,PG-13,3
+// Fields may be quoted, with "" standing for a quote, but a quoted field
+// cannot span lines. A first line that does not start with a digit is a
+// header; blank lines and lines starting with '#' are skipped.
+//
+// The file is read in large chunks cut at their last newline, and each
+// chunk is split into one slice per thread. Workers parse their slices
+// into rows that point into the chunk rather than copying fields, read
+// each distinct date and time once, and hash titles so movies are
+// deduplicated without building strings. Rows are then handed to the sink
+// in start order, which keeps every schedule index appending at its end.
+class ScheduleImporter {
+public:
+    // Receives each show with its screen (0 if the file has no screen
+    // column); returns false to refuse the show
+    typedef function<bool(int screen, const Show& show)> ShowSink;
+    
+    struct Stats {
+        long long bytes, lines, shows, movies;
+        long long badLines; // could not be parsed
+        long long refused; // parsed, but refused by the sink
+        long long firstBadLine; // 0 if none
+        double parseSeconds, loadSeconds;
+        
+        double getSeconds() const { return parseSeconds + loadSeconds; }
+        double getMegabytesPerSecond() const {
+            return getSeconds() > 0 ? bytes / 1e6 / getSeconds() : 0;
+        }
+    };
+    
+private:
+    static const size_t CHUNK_SIZE = 4 << 20;
+    static constexpr size_t MIN_SLICE_SIZE = 64 << 10; // smaller slices are not worth a thread
+    static const size_t MAX_DATE_TIME_LENGTH = 15;
+    
+    struct Field {
+        uint32_t offset, length; // within the chunk
+        bool escaped; // quoted, with "" inside
+    };
+    
+    struct Row {
+        time_t start;
+        uint64_t titleHash;
+        int chunk;
+        int showId, duration, screen;
+        Field date, time, title, genre, rating;
+    };
+    
+    struct Slice {
+        size_t begin, end;
+        vector<Row> rows;
+        long long lines, badLines;
+        long long firstBadLine; // within the slice; 0 if none
+    };
+    
+    int threads;
+    
+    static uint64_t hashText(const char* data, size_t len) {
+        uint64_t hash = 14695981039346656037ull;
+        for(size_t i = 0; i < len; i++) {
+            hash = (hash ^ (unsigned char)data[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+    
+    static string getText(const char* data, const Field& field) {
+        string text(data + field.offset, field.length);
+        if(field.escaped) {
+            size_t out = 0;
+            for(size_t i = 0; i < text.size(); i++, out++) {
+                text[out] = text[i];
+                if(text[i] == '"') i++; // keep one quote of each ""
+            }
+            text.resize(out);
+        }
+        return text;
+    }
+    
+    static bool hasText(const string& text, const char* data, const Field& field) {
+        if(field.escaped) return text == getText(data, field);
+        return text.size() == field.length && memcmp(text.data(), data + field.offset, field.length) == 0;
+    }
+    
+    // Cuts the field starting at `pos` off a line ending at `end`, leaving
+    // `pos` on the delimiter after it; false if a quote is left open or
+    // anything follows the closing quote
+    static bool cutField(const char* data, size_t& pos, size_t end, char delimiter, Field& field) {
+        field.escaped = false;
+        if(pos < end && data[pos] == '"') {
+            size_t start = ++pos;
+            while(true) {
+                const char* quote = (const char*)memchr(data + pos, '"', end - pos);
+                if(!quote) return false;
+                pos = quote - data + 1;
+                if(pos < end && data[pos] == '"') {
+                    field.escaped = true;
+                    pos++;
+                    continue;
+                }
+                field.offset = start;
+                field.length = quote - data - start;
+                return pos == end || data[pos] == delimiter;
+            }
+        }
+        const char* next = (const char*)memchr(data + pos, delimiter, end - pos);
+        size_t stop = next ? next - data : end;
+        field.offset = pos;
+        field.length = stop - pos;
+        pos = stop;
+        return true;
+    }
+    
+    static bool readNumber(const char* data, const Field& field, int& value) {
+        if(field.length == 0 || field.length > 9) return false;
+        value = 0;
+        for(uint32_t i = 0; i < field.length; i++) {
+            char c = data[field.offset + i];
+            if(c < '0' || c > '9') return false;
+            value = value * 10 + (c - '0');
+        }
+        return true;
+    }
+    
+    // Local start time of a row, through a cache of the times already seen
+    // by this worker: a week's schedule has few distinct dates and times,
+    // and mktime is the slowest step of a row
+    static time_t readStart(const char* data, const Field& date, const Field& time,
+                            unordered_map<long long, time_t>& starts) {
+        if(date.length > MAX_DATE_TIME_LENGTH || time.length > MAX_DATE_TIME_LENGTH) return -1;
+        char dateText[MAX_DATE_TIME_LENGTH + 1], timeText[MAX_DATE_TIME_LENGTH + 1];
+        memcpy(dateText, data + date.offset, date.length);
+        dateText[date.length] = '\0';
+        memcpy(timeText, data + time.offset, time.length);
+        timeText[time.length] = '\0';
+        struct tm local;
+        if(!Show::readStartTime(dateText, timeText, local)) return -1;
+        long long key = (((((long long)local.tm_year * 12 + local.tm_mon) * 31 + local.tm_mday) * 24 +
+                          local.tm_hour) * 60 + local.tm_min);
+        auto found = starts.find(key);
+        if(found != starts.end()) return found->second;
+        time_t start = mktime(&local);
+        starts.emplace(key, start);
+        return start;
+    }
+    
+    static bool parseRow(const char* data, size_t pos, size_t end, char delimiter,
+                         unordered_map<long long, time_t>& starts, Row& row) {
+        Field id, duration, screen;
+        Field* fields[] = {&id, &row.date, &row.time, &row.title, &row.genre, &duration, &row.rating, &screen};
+        int count = 0;
+        for(Field* field : fields) {
+            if(count > 0) {
+                if(pos == end) break; // the screen column is optional
+                pos++; // past the delimiter
+            }
+            if(!cutField(data, pos, end, delimiter, *field)) return false;
+            count++;
+        }
+        if(count < 7 || pos != end) return false;
+        row.screen = 0;
+        if(!readNumber(data, id, row.showId) || !readNumber(data, duration, row.duration) ||
+           (count == 8 && !readNumber(data, screen, row.screen))) return false;
+        if(row.title.length == 0 || row.duration == 0) return false;
+        row.start = readStart(data, row.date, row.time, starts);
+        row.titleHash = hashText(data + row.title.offset, row.title.length);
+        return row.start >= 0;
+    }
+    
+    static void parseSlice(const char* data, char delimiter, int chunk, Slice& slice) {
+        unordered_map<long long, time_t> starts;
+        slice.lines = slice.badLines = slice.firstBadLine = 0;
+        for(size_t pos = slice.begin; pos < slice.end; ) {
+            const char* newline = (const char*)memchr(data + pos, '\n', slice.end - pos);
+            size_t next = newline ? newline - data + 1 : slice.end;
+            size_t end = newline ? newline - data : slice.end;
+            if(end > pos && data[end - 1] == '\r') end--;
+            slice.lines++;
+            if(end > pos && data[pos] != '#') {
+                Row row;
+                row.chunk = chunk;
+                if(parseRow(data, pos, end, delimiter, starts, row)) {
+                    slice.rows.push_back(row);
+                } else if(slice.badLines++ == 0) {
+                    slice.firstBadLine = slice.lines;
+                }
+            }
+            pos = next;
+        }
+    }
+    
+    // Parses the lines in data[begin, end) on up to `threads` threads and
+    // appends the rows in file order
+    void parseChunk(const char* data, size_t begin, size_t end, char delimiter, int chunk,
+                    vector<Row>& rows, Stats& stats) const {
+        vector<Slice> slices;
+        size_t sliceSize = max((end - begin) / threads + 1, MIN_SLICE_SIZE);
+        while(begin < end) {
+            size_t cut = min(begin + sliceSize, end);
+            const char* newline = cut < end ? (const char*)memchr(data + cut, '\n', end - cut) : nullptr;
+            cut = newline ? newline - data + 1 : end;
+            slices.push_back({begin, cut, {}, 0, 0, 0});
+            begin = cut;
+        }
+        vector<thread> workers;
+        for(size_t s = 1; s < slices.size(); s++) {
+            workers.emplace_back(parseSlice, data, delimiter, chunk, ref(slices[s]));
+        }
+        if(!slices.empty()) parseSlice(data, delimiter, chunk, slices[0]);
+        for(thread& worker : workers) worker.join();
+        
+        for(Slice& slice : slices) {
+            if(slice.badLines > 0 && stats.badLines == 0) stats.firstBadLine = stats.lines + slice.firstBadLine;
+            stats.lines += slice.lines;
+            stats.badLines += slice.badLines;
+            rows.insert(rows.end(), slice.rows.begin(), slice.rows.end());
+        }
+    }
+    
+public:
+    // One thread per core unless a count is given
+    explicit ScheduleImporter(int threadCount = 0)
+        : threads(threadCount > 0 ? threadCount : max(int(thread::hardware_concurrency()), 1)) {}
+    
+    // Returns false if the file cannot be read
+    bool import(const string& path, const ShowSink& sink, Stats& stats) const {
+        stats = {};
+        ifstream in(path, ios::binary);
+        if(!in) return false;
+        auto started = chrono::steady_clock::now();
+        
+        // Chunks stay alive until the rows pointing into them are loaded.
+        // A chunk holds the unfinished line of the one before it, and grows
+        // if a single line does not fit.
+        vector<unique_ptr<char[]>> chunks;
+        vector<Row> rows;
+        unique_ptr<char[]> partial; // a chunk with no complete line yet
+        const char* carried = nullptr;
+        size_t carriedSize = 0, capacity = CHUNK_SIZE;
+        char delimiter = 0;
+        while(true) {
+            unique_ptr<char[]> chunk(new char[capacity]);
+            if(carriedSize > 0) memcpy(chunk.get(), carried, carriedSize);
+            in.read(chunk.get() + carriedSize, capacity - carriedSize);
+            size_t size = carriedSize + in.gcount();
+            stats.bytes += in.gcount();
+            bool last = size < capacity;
+            const char* data = chunk.get();
+            
+            size_t end = size;
+            if(!last) {
+                while(end > 0 && data[end - 1] != '\n') end--;
+                if(end == 0) {
+                    capacity *= 2;
+                    carried = data;
+                    carriedSize = size;
+                    partial = move(chunk);
+                    continue;
+                }
+            }
+            size_t begin = 0;
+            if(!delimiter) {
+                const char* newline = (const char*)memchr(data, '\n', end);
+                size_t firstEnd = newline ? newline - data : end;
+                delimiter = memchr(data, '\t', firstEnd) ? '\t' : ',';
+                if(firstEnd > 0 && !isdigit((unsigned char)data[0]) && data[0] != '#') {
+                    begin = newline ? firstEnd + 1 : end; // a header
+                    stats.lines++;
+                }
+            }
+            parseChunk(data, begin, end, delimiter, chunks.size(), rows, stats);
+            carried = data + end;
+            carriedSize = size - end;
+            chunks.push_back(move(chunk));
+            partial.reset();
+            if(last) break;
+        }
+        auto parsed = chrono::steady_clock::now();
+        stats.parseSeconds = chrono::duration<double>(parsed - started).count();
+        
+        // Equal starts keep their file order, so of two clashing shows the
+        // one listed first wins
+        stable_sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) { return a.start < b.start; });
+        unordered_map<uint64_t, shared_ptr<const Movie>> movies;
+        for(const Row& row : rows) {
+            const char* data = chunks[row.chunk].get();
+            auto found = movies.find(row.titleHash);
+            shared_ptr<const Movie> movie;
+            if(found != movies.end() && hasText(found->second->getTitle(), data, row.title)) {
+                movie = found->second;
+            } else {
+                movie = make_shared<const Movie>(getText(data, row.title), getText(data, row.genre),
+                                                 row.duration, getText(data, row.rating));
+                if(found == movies.end()) movies.emplace(row.titleHash, movie);
+                stats.movies++;
+            }
+            if(sink(row.screen, Show(movie, getText(data, row.time), getText(data, row.date), row.showId, row.start))) {
+                stats.shows++;
+            } else {
+                stats.refused++;
+            }
+        }
+        stats.loadSeconds = chrono::duration<double>(chrono::steady_clock::now() - parsed).count();
+        return true;
+    }
+};
+
+// Headless command processor: executes one text command per line against a
+// theater and writes one JSON result per line. Commands:
+//   BOOK <showId> <seat,seat,...> <phone> <email> <name...>
+//   BEST <showId> <vip|premium|regular> <count> <phone> <email> <name...>
+//   HOLD <showId> <seat,seat,...> [ttlSeconds]
+//   CONFIRM <holdId> <phone> <email> <name...>
+//   RELEASE <holdId>
+//   CANCEL <bookingId>
+//   HOLDS
+//   SEARCH <bookingId>
+//   FIND <phone|email>
+//   STATS [showId]
+//   SEATS <showId>
+//   SHOWS
+//   STARTING <YYYY-MM-DD> <HH:MM> [minutes]
+//   NEXT <YYYY-MM-DD> <HH:MM> <count> <title...>
+//   SEATMAP <showId> [sinceVersion]
+//   PRICES <showId>
+//   REPRICE [showId]
+//   SETTLE <show|movie|tier|hour> [YYYY-MM-DD]
+//   METRICS
+//   SNAPSHOT            (only when journaling)
+// Blank lines and lines starting with '#' are ignored.
+class CommandProcessor {
+public:
+    // A command waiting for its journal record to be durable; see execute
+    struct Deferred {
+        string command; // empty unless one is waiting
+        Theater::PendingCommit commit;
+        
+        bool isWaiting() const { return !command.empty(); }
+    };
+    
+private:
+    Theater& theater;
+    string result; // reused output buffer
+    Deferred* deferred; // where the running command may wait, or null
+    static const int DEFAULT_HOLD_SECONDS = 300;
+    
+    static string nextToken(const string& line, size_t& pos) {
+        while(pos < line.size() && isspace((unsigned char)line[pos])) pos++;
+        size_t start = pos;
+        while(pos < line.size() && !isspace((unsigned char)line[pos])) pos++;
+        return line.substr(start, pos - start);
+    }
+    
+    static string restOfLine(const string& line, size_t pos) {
+        while(pos < line.size() && isspace((unsigned char)line[pos])) pos++;
+        size_t end = line.size();
+        while(end > pos && isspace((unsigned char)line[end - 1])) end--;
+        return line.substr(pos, end - pos);
+    }
+    
+    // Parses a whole token as an int; returns false on junk or overflow
+    static bool parseInt(const string& token, int& value) {
+        if(token.empty()) return false;
+        char* end = nullptr;
+        long parsed = strtol(token.c_str(), &end, 10);
+        if(*end != '\0' || parsed < INT32_MIN || parsed > INT32_MAX) return false;
+        value = int(parsed);
+        return true;
+    }
+    
+    void appendString(const string& value) {
+        result += '"';
+        for(char c : value) {
+            switch(c) {
+                case '"': result += "\\\""; break;
+                case '\\': result += "\\\\"; break;
+                case '\n': result += "\\n"; break;
+                case '\t': result += "\\t"; break;
+                default:
+                    if((unsigned char)c < 0x20) {
+                        char buf[8];
+                        snprintf(buf, sizeof(buf), "\\u%04x", c);
+                        result += buf;
+                    } else {
+                        result += c;
+                    }
+            }
+        }
+        result += '"';
+    }
+    
+    void appendField(const char* key, const string& value) {
+        result += ",\"";
+        result += key;
+        result += "\":";
+        appendString(value);
+    }
+    
+    void appendField(const char* key, long long value) {
+        result += ",\"";
+        result += key;
+        result += "\":";
+        result += to_string(value);
+    }
+    
+    // Rupees with exactly two decimals, straight from the paise
+    void appendMoney(const char* key, Paise value) {
+        result += ",\"";
+        result += key;
+        result += "\":";
+        result += formatRupees(value);
+    }
+    
+    void appendDecimal(const char* key, double value) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), ",\"%s\":%.2f", key, value);
+        result += buf;
+    }
+    
+    void begin(const string& command, bool ok) {
+        result += "{\"cmd\":";
+        appendString(command);
+        result += ok ? ",\"ok\":true" : ",\"ok\":false";
+    }
+    
+    void fail(const string& command, const string& error) {
+        begin(command, false);
+        appendField("error", error);
+    }
+    
+    void appendSeats(const SeatList& seats) {
+        result += ",\"seats\":[";
+        for(int i = 0; i < seats.size(); i++) {
+            if(i > 0) result += ',';
+            char seatId[SeatCode::MAX_LENGTH];
+            result += '"'; // seat ids never need escaping
+            result.append(seatId, seats[i].formatSeatId(seatId));
+            result += '"';
+        }
+        result += ']';
+    }
+    
+    void appendBooking(const Booking& booking) {
+        appendField("bookingId", booking.getBookingId());
+        appendField("showId", theater.getShow(booking.getShowIndex()).getShowId());
+        appendSeats(booking.getBookedSeats());
+        appendMoney("total", booking.getTotalAmount());
+        if(theater.getCancelledAt(booking)) result += ",\"cancelled\":true";
+    }
+    
+    // Resolves a show id token; writes the error result itself on failure
+    int resolveShow(const string& command, const string& token) {
+        int showId, showIndex = -1;
+        if(parseInt(token, showId)) showIndex = theater.findShowIndex(showId);
+        if(showIndex < 0) fail(command, "INVALID_SHOW");
+        return showIndex;
+    }
+    
+    void book(const string& line, size_t pos) {
+        int showIndex = resolveShow("BOOK", nextToken(line, pos));
+        if(showIndex < 0) return;
+        
+        string seatList = nextToken(line, pos);
+        string phone = nextToken(line, pos);
+        string email = nextToken(line, pos);
+        string name = restOfLine(line, pos);
+        if(seatList.empty() || name.empty()) {
+            fail("BOOK", "BAD_ARGUMENTS");
+            return;
+        }
+        
+        SeatRequest request;
+        request.parseList(seatList.data(), seatList.size());
+        Customer customer = theater.registerCustomer(name, phone, email);
+        BookingResult booking = theater.commitBooking(showIndex, request, customer);
+        if(booking.failedSeat >= 0) {
+            fail("BOOK", getBookingStatusString(booking.status));
+            appendField("seat", getListItem(seatList, booking.failedSeat));
+            return;
+        }
+        answerBooking("BOOK", booking.status, booking.booking);
+    }
+    
+    // Answers BOOK, BEST or CONFIRM; one still waiting on the journal is
+    // answered by finish
+    void answerBooking(const char* command, BookingStatus status, const Booking* booking) {
+        if(status == BookingStatus::DURABILITY_PENDING) {
+            deferred->command = command;
+            return;
+        }
+        if(status != BookingStatus::SUCCESS) {
+            fail(command, getBookingStatusString(status));
+            return;
+        }
+        begin(command, true);
+        appendBooking(*booking);
+    }
+    
+    void bookBest(const string& line, size_t pos) {
+        int showIndex = resolveShow("BEST", nextToken(line, pos));
+        if(showIndex < 0) return;
+        
+        string tierName = nextToken(line, pos);
+        int count = 0;
+        bool countOk = parseInt(nextToken(line, pos), count);
+        string phone = nextToken(line, pos);
+        string email = nextToken(line, pos);
+        string name = restOfLine(line, pos);
+        SeatType tier;
+        if(!parseTier(tierName, tier) || !countOk || count < 1 || name.empty()) {
+            fail("BEST", "BAD_ARGUMENTS");
+            return;
+        }
+        
+        Customer customer = theater.registerCustomer(name, phone, email);
+        BookingResult booking = theater.commitBestSeats(showIndex, tier, count, customer);
+        answerBooking("BEST", booking.status, booking.booking);
+    }
+    
+    void hold(const string& line, size_t pos) {
+        int showIndex = resolveShow("HOLD", nextToken(line, pos));
+        if(showIndex < 0) return;
+        
+        string seatList = nextToken(line, pos);
+        SeatRequest request;
+        request.parseList(seatList.data(), seatList.size());
+        string ttlToken = nextToken(line, pos);
+        int ttlSeconds = DEFAULT_HOLD_SECONDS;
+        if(request.empty() || (!ttlToken.empty() && !parseInt(ttlToken, ttlSeconds))) {
+            fail("HOLD", "BAD_ARGUMENTS");
+            return;
+        }
+        
+        HoldResult hold = theater.holdSeats(showIndex, request, ttlSeconds);
+        if(hold.status != BookingStatus::SUCCESS) {
+            fail("HOLD", getBookingStatusString(hold.status));
+            if(hold.failedSeat >= 0) appendField("seat", getListItem(seatList, hold.failedSeat));
+            return;
+        }
+        begin("HOLD", true);
+        appendField("holdId", hold.holdId);
+        appendField("showId", theater.getShow(showIndex).getShowId());
+        appendField("ttl", max(ttlSeconds, 1));
+    }
+    
+    void confirm(const string& line, size_t pos) {
+        int holdId = 0;
+        bool idOk = parseInt(nextToken(line, pos), holdId);
+        string phone = nextToken(line, pos);
+        string email = nextToken(line, pos);
+        string name = restOfLine(line, pos);
+        if(!idOk || name.empty()) {
+            fail("CONFIRM", "BAD_ARGUMENTS");
+            return;
+        }
+        
+        Customer customer = theater.registerCustomer(name, phone, email);
+        BookingResult booking = theater.confirmHold(holdId, customer);
+        answerBooking("CONFIRM", booking.status, booking.booking);
+    }
+    
+    void release(const string& line, size_t pos) {
+        int holdId = 0;
+        if(!parseInt(nextToken(line, pos), holdId) || !theater.releaseHold(holdId)) {
+            fail("RELEASE", getBookingStatusString(BookingStatus::HOLD_NOT_FOUND));
+            return;
+        }
+        begin("RELEASE", true);
+        appendField("holdId", holdId);
+    }
+    
+    void cancel(const string& line, size_t pos) {
+        int bookingId;
+        if(!parseInt(nextToken(line, pos), bookingId)) {
+            fail("CANCEL", "BAD_ARGUMENTS");
+            return;
+        }
+        CancelResult cancelled = theater.commitCancellation(bookingId);
+        answerCancel(cancelled.status, cancelled.booking, cancelled.refund);
+    }
+    
+    void answerCancel(BookingStatus status, const Booking* booking, Paise refund) {
+        if(status == BookingStatus::DURABILITY_PENDING) {
+            deferred->command = "CANCEL";
+            return;
+        }
+        if(status != BookingStatus::SUCCESS) {
+            fail("CANCEL", getBookingStatusString(status));
+            return;
+        }
+        begin("CANCEL", true);
+        appendField("bookingId", booking->getBookingId());
+        appendField("showId", theater.getShow(booking->getShowIndex()).getShowId());
+        appendSeats(booking->getBookedSeats());
+        appendMoney("refund", refund);
+    }
+    
+    void holdCounters() {
+        HoldTable::Counters counters = theater.getHoldCounters();
+        begin("HOLDS", true);
+        appendField("placed", counters.placed);
+        appendField("confirmed", counters.confirmed);
+        appendField("released", counters.released);
+        appendField("expired", counters.expired);
+        appendField("active", counters.active);
+    }
+    
+    // The index-th id of "a1,A2", upper-cased; only for error replies
+    static string getListItem(const string& seatList, int index) {
+        size_t start = 0;
+        for(int i = 0; i < index && start <= seatList.size(); i++) {
+            size_t comma = seatList.find(',', start);
+            start = comma == string::npos ? seatList.size() + 1 : comma + 1;
+        }
+        if(start > seatList.size()) return "";
+        string seatId = seatList.substr(start, seatList.find(',', start) - start);
+        transform(seatId.begin(), seatId.end(), seatId.begin(), ::toupper);
+        return seatId;
+    }
+    
+    static bool parseTier(const string& token, SeatType& tier) {
+        for(int t = 0; t < BookingCounters::TIER_COUNT; t++) {
+            string name = SeatLayout::getTierName(SeatType(t));
+            if(token.size() == name.size() &&
+               equal(token.begin(), token.end(), name.begin(),
+                     [](char a, char b) { return tolower((unsigned char)a) == tolower((unsigned char)b); })) {
+                tier = SeatType(t);
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    void search(const string& line, size_t pos) {
+        int bookingId;
+        const Booking* booking = nullptr;
+        if(parseInt(nextToken(line, pos), bookingId)) booking = theater.findBooking(bookingId);
+        if(!booking) {
+            fail("SEARCH", "NOT_FOUND");
+            return;
+        }
+        begin("SEARCH", true);
+        appendBooking(*booking);
+        const Customer& customer = theater.getCatalog().getCustomer(booking->getCustomerId());
+        appendField("customerId", customer.getCustomerId());
+        appendField("name", customer.getName());
+        appendField("phone", customer.getPhone());
+        appendField("email", customer.getEmail());
+        appendField("bookingTime", booking->getBookingTime());
+    }
+    
+    void findCustomer(const string& line, size_t pos) {
+        string key = nextToken(line, pos);
+        vector<const Booking*> found = theater.findCustomerBookings(key);
+        if(found.empty()) {
+            fail("FIND", "NOT_FOUND");
+            return;
+        }
+        begin("FIND", true);
+        const Customer& customer = theater.getCatalog().getCustomer(found[0]->getCustomerId());
+        appendField("customerId", customer.getCustomerId());
+        appendField("name", customer.getName());
+        result += ",\"bookings\":[";
+        for(size_t i = 0; i < found.size(); i++) {
+            if(i > 0) result += ',';
+            result += "{\"bookingId\":" + to_string(found[i]->getBookingId());
+            appendField("showId", theater.getShow(found[i]->getShowIndex()).getShowId());
+            appendSeats(found[i]->getBookedSeats());
+            appendMoney("total", found[i]->getTotalAmount());
+            if(theater.getCancelledAt(*found[i])) result += ",\"cancelled\":true";
+            result += '}';
+        }
+        result += ']';
+    }
+    
+    // Without a show id, reports totals across the whole theater
+    void stats(const string& line, size_t pos) {
+        string token = nextToken(line, pos);
+        ShowStats stats;
+        if(token.empty()) {
+            stats = theater.getTheaterStats();
+        } else {
+            int showIndex = resolveShow("STATS", token);
+            if(showIndex < 0) return;
+            stats = theater.getShowStats(showIndex);
+        }
+        
+        begin("STATS", true);
+        appendField("showId", stats.showId);
+        appendField("totalSeats", stats.totalSeats);
+        appendField("bookedSeats", stats.bookedSeats);
+        appendField("bookings", stats.bookingCount);
+        appendDecimal("occupancy", stats.getOccupancyRate());
+        appendMoney("revenue", stats.revenue);
+        appendField("cancellations", stats.cancellationCount);
+        appendMoney("refunds", stats.refunds);
+        for(int t = BookingCounters::TIER_COUNT - 1; t >= 0; t--) {
+            string tier = SeatLayout::getTierName(SeatType(t));
+            transform(tier.begin(), tier.end(), tier.begin(), ::tolower);
+            appendField((tier + "Seats").c_str(), stats.tierBookedSeats[t]);
+            appendMoney((tier + "Revenue").c_str(), stats.tierRevenue[t]);
+        }
+    }
+    
+    void seats(const string& line, size_t pos) {
+        int showIndex = resolveShow("SEATS", nextToken(line, pos));
+        if(showIndex < 0) return;
+        
+        // Every row as of one moment, unlike SEATMAP's live rows
+        Theater::ReadView view = theater.openReadView();
+        const SeatLayout& layout = theater.getSeatMap(showIndex).getLayout();
+        begin("SEATS", true);
+        appendField("showId", theater.getShow(showIndex).getShowId());
+        result += ",\"rows\":[";
+        vector<SeatStatus> seats;
+        for(int i = 0; i < layout.getRows(); i++) {
+            if(i > 0) result += ',';
+            result += '"';
+            view.getRow(showIndex, i, seats);
+            for(int j = 0; j < layout.getCols(); j++) {
+                result += layout.isValid(i, j) ? layout.makeSeat(i, j, seats[j]).getDisplayChar() : '_';
+            }
+            result += '"';
+        }
+        result += ']';
+    }
+    
+    // Compact seat map for polling clients: each row as runs like "O3X2O5".
+    // With the version from an earlier reply, only rows changed since then
+    // are sent; a missing, zero or unknown version gets the whole map.
+    void seatMap(const string& line, size_t pos) {
+        int showIndex = resolveShow("SEATMAP", nextToken(line, pos));
+        if(showIndex < 0) return;
+        string sinceToken = nextToken(line, pos);
+        uint64_t since = sinceToken.empty() ? 0 : strtoull(sinceToken.c_str(), nullptr, 10);
+        
+        const ShowOccupancy& seatMap = theater.getSeatMap(showIndex);
+        uint64_t version = seatMap.getVersion(); // every change up to here is in the seat words
+        bool full = since == 0 || since > version;
+        begin("SEATMAP", true);
+        appendField("showId", theater.getShow(showIndex).getShowId());
+        appendField("version", (long long)version);
+        result += full ? ",\"full\":true" : ",\"full\":false";
+        appendField("cols", seatMap.getLayout().getCols());
+        result += ",\"rows\":{";
+        bool first = true;
+        for(int i = 0; i < seatMap.getLayout().getRows(); i++) {
+            // A row still being stamped may hold a change up to version
+            if(!full && !seatMap.isStamping(i) && seatMap.getRowVersion(i) <= since) continue;
+            if(!first) result += ',';
+            first = false;
+            char label[2];
+            result += '"';
+            result.append(label, SeatCode::formatRow(i, label));
+            result += "\":\"";
+            seatMap.appendRowRuns(i, result);
+            result += '"';
+        }
+        result += '}';
+    }
+    
+    // Current price of each tier and the percentage of its base price
+    void appendPrices(int showIndex) {
+        const ShowPricing& prices = theater.getPricing(showIndex);
+        appendField("showId", theater.getShow(showIndex).getShowId());
+        for(int t = BookingCounters::TIER_COUNT - 1; t >= 0; t--) {
+            string tier = SeatLayout::getTierName(SeatType(t));
+            transform(tier.begin(), tier.end(), tier.begin(), ::tolower);
+            appendMoney((tier + "Price").c_str(), prices.getTierPrice(SeatType(t)));
+            appendField((tier + "Percent").c_str(), prices.getTierPercent(SeatType(t)));
+        }
+    }
+    
+    void prices(const string& line, size_t pos) {
+        int showIndex = resolveShow("PRICES", nextToken(line, pos));
+        if(showIndex < 0) return;
+        begin("PRICES", true);
+        appendPrices(showIndex);
+    }
+    
+    // Without a show id, reprices every show
+    void reprice(const string& line, size_t pos) {
+        string token = nextToken(line, pos);
+        if(token.empty()) {
+            theater.repriceAll();
+            begin("REPRICE", true);
+            appendField("shows", theater.getShowCount());
+            return;
+        }
+        int showIndex = resolveShow("REPRICE", token);
+        if(showIndex < 0) return;
+        theater.repriceShow(showIndex, time(0));
+        begin("REPRICE", true);
+        appendPrices(showIndex);
+    }
+    
+    void appendTotals(const SettlementTable::Totals& totals) {
+        appendField("bookings", totals.bookings);
+        appendField("seats", totals.seats);
+        appendField("cancellations", totals.cancellations);
+        appendMoney("subtotal", totals.subtotal);
+        appendMoney("serviceFee", totals.serviceFee);
+        appendMoney("gst", totals.gst);
+        appendMoney("refunds", totals.refunds);
+        appendMoney("net", totals.getNet());
+    }
+    
+    // Settlement for one local day of sales, or every day without a date.
+    // Groups with no sales or cancellations are left out.
+    void settle(const string& line, size_t pos) {
+        static const char* const GROUP_NAMES[] = {"show", "movie", "tier", "hour"};
+        string groupName = nextToken(line, pos);
+        transform(groupName.begin(), groupName.end(), groupName.begin(), ::tolower);
+        int group = 0;
+        while(group < 4 && groupName != GROUP_NAMES[group]) group++;
+        if(group == 4) {
+            fail("SETTLE", "INVALID_GROUP");
+            return;
+        }
+        string date = nextToken(line, pos);
+        int day = -1;
+        if(!date.empty()) {
+            struct tm local = {};
+            if(sscanf(date.c_str(), "%d-%d-%d", &local.tm_year, &local.tm_mon, &local.tm_mday) != 3) {
+                fail("SETTLE", "INVALID_DATE");
+                return;
+            }
+            local.tm_year -= 1900;
+            local.tm_mon -= 1;
+            local.tm_hour = 12;
+            local.tm_isdst = -1;
+            day = SettlementTable::getDay(mktime(&local));
+        }
+        
+        SettlementReport report = theater.settle(SettlementTable::Group(group), day);
+        begin("SETTLE", true);
+        appendField("by", string(GROUP_NAMES[group]));
+        if(!date.empty()) appendField("date", date);
+        appendField("lines", report.total.lines);
+        result += ",\"groups\":[";
+        bool first = true;
+        for(size_t k = 0; k < report.totals.size(); k++) {
+            if(report.totals[k].lines == 0) continue;
+            result += first ? "{\"key\":" : ",{\"key\":";
+            first = false;
+            appendString(report.labels[k]);
+            appendTotals(report.totals[k]);
+            result += '}';
+        }
+        result += "],\"total\":{\"key\":\"total\"";
+        appendTotals(report.total);
+        result += '}';
+    }
+    
+    // Calls, latency quantiles and outcomes of each engine operation seen so far
+    void engineMetrics() {
+        const BookingMetrics* metrics = theater.getMetrics();
+        if(!metrics) {
+            fail("METRICS", "METRICS_DISABLED");
+            return;
+        }
+        begin("METRICS", true);
+        result += ",\"operations\":[";
+        bool first = true;
+        for(int op = 0; op < BookingMetrics::OPERATION_COUNT; op++) {
+            BookingMetrics::Summary summary = metrics->getSummary(BookingMetrics::Operation(op));
+            long long calls = 0;
+            for(uint64_t count : summary.outcomes) calls += count;
+            if(calls == 0) continue;
+            result += first ? "{\"op\":" : ",{\"op\":";
+            first = false;
+            appendString(BookingMetrics::getOperationString(BookingMetrics::Operation(op)));
+            appendField("calls", calls);
+            appendField("timed", (long long)summary.count);
+            appendDecimal("meanUs", summary.count ? summary.nanos / 1000.0 / summary.count : 0.0);
+            appendDecimal("p50Us", summary.getQuantile(0.5) / 1000.0);
+            appendDecimal("p99Us", summary.getQuantile(0.99) / 1000.0);
+            appendDecimal("p999Us", summary.getQuantile(0.999) / 1000.0);
+            result += ",\"outcomes\":{";
+            bool firstOutcome = true;
+            for(int k = 0; k < BookingMetrics::OUTCOME_COUNT; k++) {
+                if(summary.outcomes[k] == 0) continue;
+                if(!firstOutcome) result += ',';
+                firstOutcome = false;
+                appendString(getBookingStatusString(BookingStatus(k)));
+                result += ':';
+                result += to_string(summary.outcomes[k]);
+            }
+            result += "}}";
+        }
+        result += ']';
+        appendField("bestSeatRetries", (long long)metrics->getBestSeatRetries());
+        appendField("casRetries", (long long)theater.getCasRetries());
+    }
+    
+    void appendShow(int showIndex) {
+        const Show& show = theater.getShow(showIndex);
+        const SeatLayout& layout = theater.getSeatMap(showIndex).getLayout();
+        ShowStats stats = theater.getShowStats(showIndex);
+        result += "{\"showId\":" + to_string(show.getShowId());
+        appendField("title", show.getMovie().getTitle());
+        appendField("date", show.getShowDate());
+        appendField("time", show.getShowTime());
+        appendField("rows", layout.getRows());
+        appendField("cols", layout.getCols());
+        appendField("available", stats.totalSeats - stats.bookedSeats);
+        result += '}';
+    }
+    
+    void shows() {
+        begin("SHOWS", true);
+        result += ",\"shows\":[";
+        for(int i = 0; i < theater.getShowCount(); i++) {
+            if(i > 0) result += ',';
+            appendShow(i);
+        }
+        result += ']';
+    }
+    
+    void appendSchedule(const vector<ShowSchedule::Entry>& entries) {
+        result += ",\"shows\":[";
+        for(size_t i = 0; i < entries.size(); i++) {
+            if(i > 0) result += ',';
+            appendShow(theater.findShowIndex(entries[i].showId));
+        }
+        result += ']';
+    }
+    
+    // "2024-01-15 18:00" as two tokens; -1 if they are not a date and time
+    static time_t parseWhen(const string& line, size_t& pos) {
+        string date = nextToken(line, pos);
+        string time = nextToken(line, pos);
+        return Show::parseStartTime(date, time);
+    }
+    
+    // Shows starting within the next few minutes (an hour by default)
+    void starting(const string& line, size_t pos) {
+        time_t from = parseWhen(line, pos);
+        string minutesToken = nextToken(line, pos);
+        int minutes = 60;
+        if(from < 0 || (!minutesToken.empty() && (!parseInt(minutesToken, minutes) || minutes < 0))) {
+            fail("STARTING", "BAD_ARGUMENTS");
+            return;
+        }
+        begin("STARTING", true);
+        appendSchedule(theater.getSchedule().getStarting(from, from + time_t(minutes) * 60));
+    }
+    
+    // The next shows of a movie from a time on
+    void nextShows(const string& line, size_t pos) {
+        time_t from = parseWhen(line, pos);
+        int count = 0;
+        bool countOk = parseInt(nextToken(line, pos), count);
+        string title = restOfLine(line, pos);
+        if(from < 0 || !countOk || count < 1 || title.empty()) {
+            fail("NEXT", "BAD_ARGUMENTS");
+            return;
+        }
+        begin("NEXT", true);
+        appendSchedule(theater.getSchedule().getStarting(title, from, numeric_limits<time_t>::max(), count));
+    }
+    
+public:
+    explicit CommandProcessor(Theater& t) : theater(t), deferred(nullptr) {}
+    
+    // Executes one command line; returns the JSON result, or an empty
+    // string for blank and comment lines
+    // With a `waitIn`, a booking or cancellation does not wait for its
+    // journal fsync: it answers nothing and leaves the command waiting in
+    // `waitIn`; finish answers it once Theater::finishDeferred has run.
+    const string& execute(const string& line, Deferred* waitIn = nullptr) {
+        result.clear();
+        size_t pos = 0;
+        string command = nextToken(line, pos);
+        if(command.empty() || command[0] == '#') return result;
+        transform(command.begin(), command.end(), command.begin(), ::toupper);
+        
+        deferred = waitIn;
+        Theater::deferDurability(waitIn ? &waitIn->commit : nullptr);
+        if(command == "BOOK") book(line, pos);
+        else if(command == "BEST") bookBest(line, pos);
+        else if(command == "HOLD") hold(line, pos);
+        else if(command == "CONFIRM") confirm(line, pos);
+        else if(command == "RELEASE") release(line, pos);
+        else if(command == "CANCEL") cancel(line, pos);
+        else if(command == "HOLDS") holdCounters();
+        else if(command == "SEARCH") search(line, pos);
+        else if(command == "FIND") findCustomer(line, pos);
+        else if(command == "STATS") stats(line, pos);
+        else if(command == "SEATS") seats(line, pos);
+        else if(command == "SHOWS") shows();
+        else if(command == "STARTING") starting(line, pos);
+        else if(command == "NEXT") nextShows(line, pos);
+        else if(command == "SEATMAP") seatMap(line, pos);
+        else if(command == "PRICES") prices(line, pos);
+        else if(command == "REPRICE") reprice(line, pos);
+        else if(command == "SETTLE") settle(line, pos);
+        else if(command == "METRICS") engineMetrics();
+        else if(command == "SNAPSHOT") {
+            if(theater.getJournal() && theater.writeSnapshot()) begin(command, true);
+            else fail(command, "SNAPSHOT_FAILED");
+        }
+        else fail(command, "UNKNOWN_COMMAND");
+        Theater::deferDurability(nullptr);
+        if(waitIn && waitIn->isWaiting()) return result; // nothing written yet
+        result += '}';
+        return result;
+    }
+    
+    // The answer to a command left waiting by execute, once finished
+    const string& finish(Deferred& waiting) {
+        result.clear();
+        const Theater::PendingCommit& commit = waiting.commit;
+        if(commit.cancellation) answerCancel(commit.status, commit.committed, commit.refund);
+        else answerBooking(waiting.command.c_str(), commit.status, commit.committed);
+        result += '}';
+        waiting.command.clear();
+        waiting.commit = Theater::PendingCommit();
+        return result;
+    }
+    
+    // Runs every command of a stream; returns the number of commands executed
+    long long run(istream& in, ostream& out) {
+        string line;
+        long long commands = 0;
+        while(getline(in, line)) {
+            const string& response = execute(line);
+            if(response.empty()) continue;
+            out.write(response.data(), response.size());
+            out.put('\n');
+            commands++;
+        }
+        out.flush();
+        return commands;
+    }
+};
+
+#ifdef __linux__
+// Non-blocking booking server. One epoll event loop serves every client
+// connection with the batch protocol: one command per line in, one JSON
+// line out, answered in order. Commands run on the loop itself; each is a
+// short, non-blocking Theater call. With a journal, a booking or
+// cancellation parks its connection instead of waiting for the fsync: a
+// durability thread finishes it once its record is on disk and wakes the
+// loop to answer it. A parked connection reads nothing more until then;
+// the others carry on.
+class BookingServer {
+private:
+    static const size_t MAX_LINE = 4096;
+    static const int MAX_EVENTS = 256;
+    static const size_t READ_CHUNK = 16384;
+    
+    struct Connection {
+        int fd;
+        string in;        // bytes received, not yet answered
+        string out;       // responses not yet sent
+        size_t sent;      // bytes of out already sent
+        uint32_t events;  // what epoll reports for it
+        bool parked;      // a command is waiting for the journal
+        bool hungUp;      // the client is gone or done sending
+        CommandProcessor::Deferred waiting;
+    };
+    
+    Theater& theater;
+    CommandProcessor processor;
+    int listenFd, epollFd, wakeFd;
+    unordered_map<int, unique_ptr<Connection>> connections;
+    atomic<bool> stopping;
+    long long accepted, served;
+    
+    // Parked commands: the loop adds them to `parked`, the durability
+    // thread moves them to `finished` and writes wakeFd
+    mutex parkLock;
+    condition_variable parkedMore;
+    vector<Connection*> parked, finished;
+    bool loopDone;
+    thread durabilityThread;
+    
+    static void setNonBlocking(int fd) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+    
+    void acceptAll() {
+        while(true) {
+            int fd = accept(listenFd, nullptr, nullptr);
+            if(fd < 0) return; // EAGAIN, or out of descriptors until some close
+            setNonBlocking(fd);
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.fd = fd;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+            connections[fd].reset(new Connection{fd, "", "", 0, EPOLLIN, false, false, {}});
+            accepted++;
+        }
+    }
+    
+    void closeConnection(Connection& connection) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, connection.fd, nullptr);
+        close(connection.fd);
+        connections.erase(connection.fd); // destroys connection
+    }
+    
+    // Closes a connection that is done, or once its parked command is
+    // answered, since the durability thread may be finishing it. Until then
+    // epoll would keep reporting the hang-up, so it stops watching.
+    void drop(Connection& connection) {
+        if(!connection.parked) {
+            closeConnection(connection);
+            return;
+        }
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, connection.fd, nullptr);
+        connection.hungUp = true;
+    }
+    
+    // Asks epoll for input unless the connection is parked, and for room
+    // to write while output is pending
+    void watch(Connection& connection) {
+        uint32_t events = (connection.parked ? 0 : uint32_t(EPOLLIN)) | (connection.out.empty() ? 0 : uint32_t(EPOLLOUT));
+        if(events == connection.events) return;
+        epoll_event event = {};
+        event.events = events;
+        event.data.fd = connection.fd;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+        connection.events = events;
+    }
+    
+    // Sends as much pending output as the socket takes. Returns false if
+    // the connection failed.
+    bool flush(Connection& connection) {
+        while(connection.sent < connection.out.size()) {
+            ssize_t n = send(connection.fd, connection.out.data() + connection.sent,
+                             connection.out.size() - connection.sent, MSG_NOSIGNAL);
+            if(n < 0 && errno == EINTR) continue;
+            if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if(n <= 0) return false;
+            connection.sent += n;
+        }
+        if(connection.sent == connection.out.size()) {
+            connection.out.clear();
+            connection.sent = 0;
+        }
+        watch(connection);
+        return true;
+    }
+    
+    // Answers every complete line received, in order, until one parks the
+    // connection
+    void answerLines(Connection& connection) {
+        size_t start = 0, end;
+        while(!connection.parked && (end = connection.in.find('\n', start)) != string::npos) {
+            string line = connection.in.substr(start, end - start);
+            if(!line.empty() && line.back() == '\r') line.pop_back();
+            const string& response = processor.execute(line, &connection.waiting);
+            if(connection.waiting.isWaiting()) {
+                park(connection);
+            } else if(!response.empty()) {
+                connection.out += response;
+                connection.out += '\n';
+                served++;
+            }
+            start = end + 1;
+        }
+        connection.in.erase(0, start);
+    }
+    
+    void park(Connection& connection) {
+        connection.parked = true;
+        lock_guard<mutex> guard(parkLock);
+        parked.push_back(&connection);
+        parkedMore.notify_one();
+    }
+    
+    // Reads what has arrived and answers every complete line. Returns
+    // false once the client has gone or broken the protocol.
+    bool receive(Connection& connection) {
+        char buffer[READ_CHUNK];
+        bool open = true;
+        while(true) {
+            ssize_t n = recv(connection.fd, buffer, sizeof(buffer), 0);
+            if(n < 0 && errno == EINTR) continue;
+            if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if(n <= 0) {
+                open = false; // answer what was sent before the close
+                break;
+            }
+            connection.in.append(buffer, n);
+            if(size_t(n) < sizeof(buffer)) break;
+        }
+        
+        answerLines(connection);
+        if(!connection.parked && connection.in.size() > MAX_LINE) {
+            connection.out += "{\"cmd\":\"\",\"ok\":false,\"error\":\"LINE_TOO_LONG\"}\n";
+            open = false;
+        }
+        return flush(connection) && open;
+    }
+    
+    // Answers a parked command the durability thread finished, then the
+    // lines queued behind it. Returns false if the connection is done.
+    bool resume(Connection& connection) {
+        connection.parked = false;
+        const string& response = processor.finish(connection.waiting);
+        connection.out += response;
+        connection.out += '\n';
+        served++;
+        answerLines(connection);
+        return flush(connection) && !connection.hungUp;
+    }
+    
+    void answerFinished() {
+        uint64_t count;
+        ssize_t ignored = read(wakeFd, &count, sizeof(count));
+        (void)ignored;
+        vector<Connection*> ready;
+        {
+            lock_guard<mutex> guard(parkLock);
+            ready.swap(finished);
+        }
+        for(Connection* connection : ready) {
+            if(!resume(*connection)) drop(*connection);
+        }
+    }
+    
+    // Finishes parked commands in batches: the first of a batch flushes
+    // the journal for all of them, so they share one fsync
+    void finishParked() {
+        unique_lock<mutex> guard(parkLock);
+        while(true) {
+            parkedMore.wait(guard, [this] { return !parked.empty() || loopDone; });
+            if(parked.empty()) return;
+            vector<Connection*> batch;
+            batch.swap(parked);
+            guard.unlock();
+            for(Connection* connection : batch) theater.finishDeferred(connection->waiting.commit);
+            guard.lock();
+            finished.insert(finished.end(), batch.begin(), batch.end());
+            uint64_t one = 1;
+            ssize_t ignored = write(wakeFd, &one, sizeof(one));
+            (void)ignored;
+        }
+    }
+    
+public:
+    explicit BookingServer(Theater& t)
+        : theater(t), processor(t), listenFd(-1), epollFd(epoll_create1(0)), wakeFd(eventfd(0, EFD_NONBLOCK)),
+          stopping(false), accepted(0), served(0), loopDone(false) {
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = wakeFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+    }
+    
+    ~BookingServer() {
+        for(auto& entry : connections) close(entry.first);
+        if(listenFd >= 0) close(listenFd);
+        close(wakeFd);
+        close(epollFd);
+    }
+    
+    BookingServer(const BookingServer&) = delete;
+    BookingServer& operator=(const BookingServer&) = delete;
+    
+    // Listens on the loopback interface; port 0 picks a free port
+    bool listen(int port) {
+        listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if(listenFd < 0) return false;
+        int on = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        if(bind(listenFd, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(listenFd, SOMAXCONN) != 0) {
+            return false;
+        }
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = listenFd;
+        return epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event) == 0;
+    }
+    
+    int getPort() const {
+        sockaddr_in address = {};
+        socklen_t length = sizeof(address);
+        if(getsockname(listenFd, (sockaddr*)&address, &length) != 0) return -1;
+        return ntohs(address.sin_port);
+    }
+    
+    // Serves until stop() is called. Commands parked by then are still
+    // finished, but not answered.
+    void run() {
+        if(theater.getJournal()) durabilityThread = thread(&BookingServer::finishParked, this);
+        epoll_event events[MAX_EVENTS];
+        while(!stopping.load(memory_order_acquire)) {
+            int ready = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+            for(int i = 0; i < ready; i++) {
+                int fd = events[i].data.fd;
+                if(fd == listenFd) {
+                    acceptAll();
+                    continue;
+                }
+                if(fd == wakeFd) {
+                    answerFinished();
+                    continue;
+                }
+                auto it = connections.find(fd);
+                if(it == connections.end()) continue;
+                Connection& connection = *it->second;
+                bool ok = true;
+                if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) ok = receive(connection);
+                else if(events[i].events & EPOLLOUT) ok = flush(connection);
+                if(!ok) drop(connection);
+            }
+        }
+        if(durabilityThread.joinable()) {
+            {
+                lock_guard<mutex> guard(parkLock);
+                loopDone = true;
+            }
+            parkedMore.notify_one();
+            durabilityThread.join();
+        }
+    }
+    
+    // Safe to call from another thread or a signal handler
+    void stop() {
+        stopping.store(true, memory_order_release);
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeFd, &one, sizeof(one));
+        (void)ignored;
+    }
+    
+    long long getAccepted() const { return accepted; }
+    long long getServed() const { return served; }
+    int getConnectionCount() const { return connections.size(); }
+    
+    // Each connection is a descriptor, so allow as many as the hard limit
+    static void raiseDescriptorLimit() {
+        rlimit limit;
+        if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+            limit.rlim_cur = limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+    }
+};
+
+// The server a SIGINT or SIGTERM stops
+BookingServer* signalledServer = nullptr;
+
+void stopSignalledServer(int) {
+    if(signalledServer) signalledServer->stop();
+}
+#endif
+
+// Main application class
+class MovieBookingSystem {
+private:
+    static const int SNAPSHOT_INTERVAL_SECONDS = 60;
+    static const int CHECKOUT_HOLD_SECONDS = 300;
+    static const int REPRICE_INTERVAL_SECONDS = 60;
+    static const int METRICS_INTERVAL_SECONDS = 10;
+    BookingMetrics metrics;
+    Theater theater;
+    ReceiptPipeline receipts; // declared after theater so it drains first
+    MetricsExporter metricsExporter; // stops before the theater goes
+    
+    void displayMenu() const {
+        cout << "\n===== MOVIE BOOKING SYSTEM =====" << endl;
+        cout << "1. View Shows" << endl;
+        cout << "2. View Seating Arrangement" << endl;
+        cout << "3. Book Tickets" << endl;
+        cout << "4. View All Bookings" << endl;
+        cout << "5. Search Booking & Print Receipt" << endl;
+        cout << "6. Find Bookings by Phone/Email" << endl;
+        cout << "7. Theater Statistics" << endl;
+        cout << "8. Cancel Booking" << endl;
+        cout << "9. Settlement Report" << endl;
+        cout << "10. Exit" << endl;
+        cout << "=================================" << endl;
+        cout << "Enter your choice: ";
+    }
+    
+    // FIXED: Added input validation helper
+    int getValidatedInput(int min, int max) {
+        int input;
+        while(true) {
+            if(cin >> input) {
+                if(input >= min && input <= max) {
+                    return input;
+                } else {
+                    cout << "Please enter a number between " << min << " and " << max << ": ";
+                }
+            } else {
+                cout << "Invalid input! Please enter a number: ";
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            }
+        }
+    }
+    
+    // Lists the shows and returns the chosen show's index
+    int selectShow() {
+        theater.displayShows();
+        int showCount = theater.getShowCount(); // FIXED: Dynamic show count
+        cout << "\nSelect show number (1-" << showCount << "): ";
+        return theater.getShowsByStart()[getValidatedInput(1, showCount) - 1]; // FIXED: Use validated input
+    }
+    
+    Customer getCustomerDetails() {
+        string name, phone, email;
+        cout << "\nEnter customer details:" << endl;
+        cout << "Name: ";
+        cin.ignore(); // FIXED: Clear input buffer before getline
+        getline(cin, name);
+        cout << "Phone: ";
+        getline(cin, phone);
+        cout << "Email: ";
+        getline(cin, email);
+        
+        return theater.registerCustomer(name, phone, email);
+    }
+    
+public:
+    // Shows are added with addSampleShows or importSchedule before the
+    // journal is opened
+    explicit MovieBookingSystem(shared_ptr<const SeatLayout> layout)
+        : theater("Cineplex Theater", layout) {
+        theater.setMetrics(&metrics);
+    }
+    
+    void addSampleShows() {
+        Movie movie1("Avengers: Endgame", "Action/Adventure", 181, "PG-13");
+        Movie movie2("The Lion King", "Animation/Family", 118, "PG");
+        Movie movie3("Joker", "Crime/Drama", 122, "R");
+        
+        theater.addShow(Show(movie1, "10:00 AM", "2024-01-15", 101));
+        theater.addShow(Show(movie1, "02:00 PM", "2024-01-15", 102));
+        theater.addShow(Show(movie2, "05:15 PM", "2024-01-15", 103));
+        theater.addShow(Show(movie3, "08:00 PM", "2024-01-15", 104));
+    }
+    
+    // Loads the hall's shows from a schedule export; the screen column,
+    // if any, is ignored since there is only one hall
+    bool importSchedule(const string& path) {
+        ScheduleImporter::Stats stats;
+        ScheduleImporter importer;
+        if(!importer.import(path, [this](int, const Show& show) { return theater.addShow(show); }, stats)) {
+            cerr << "Cannot open show schedule: " << path << endl;
+            return false;
+        }
+        cerr << "Imported " << stats.shows << " shows of " << stats.movies << " movies from " << path << " in "
+             << fixed << setprecision(1) << stats.getSeconds() * 1000 << " ms ("
+             << stats.getMegabytesPerSecond() << " MB/s)";
+        if(stats.refused > 0) cerr << " (" << stats.refused << " duplicate or overlapping shows refused)";
+        if(stats.badLines > 0) cerr << " (" << stats.badLines << " bad lines, first at line " << stats.firstBadLine << ")";
+        cerr << endl;
+        if(stats.shows == 0) {
+            cerr << "No shows in " << path << endl;
+            return false;
+        }
+        return true;
+    }
+    
+    // Restores earlier bookings from the journal and logs new ones to it
+    bool openJournal(const string& path) {
+        Theater::RecoveryStats stats;
+        if(!theater.openJournal(path, stats)) {
+            cerr << "Cannot open booking journal: " << path << endl;
+            return false;
+        }
+        if(stats.snapshotBookings > 0 || stats.replay.records > 0 || stats.replay.discardedBytes > 0) {
+            cerr << "Recovered " << stats.snapshotBookings << " bookings from snapshot and "
+                 << stats.restored << " from " << path << " in "
+                 << fixed << setprecision(1) << stats.seconds * 1000 << " ms";
+            if(stats.rejected > 0) cerr << " (" << stats.rejected << " records rejected)";
+            if(stats.replay.discardedBytes > 0) cerr << " (discarded " << stats.replay.discardedBytes << " byte torn tail)";
+            cerr << endl;
+        }
+        theater.startPeriodicSnapshots(SNAPSHOT_INTERVAL_SECONDS);
+        return true;
+    }
+    
+    // Writes a receipt for every new booking to a file, or stdout for "-"
+    bool openReceipts(const string& path) {
+        if(!receipts.open(path)) {
+            cerr << "Cannot open receipts file: " << path << endl;
+            return false;
+        }
+        theater.setReceiptPipeline(&receipts);
+        return true;
+    }
+    
+    // Dumps the engine metrics to a file every METRICS_INTERVAL_SECONDS
+    bool openMetrics(const string& path) {
+        bool started = metricsExporter.start(path, METRICS_INTERVAL_SECONDS, [this](string& out) {
+            metrics.appendPrometheus(out);
+            theater.appendMetrics(out);
+        });
+        if(!started) cerr << "Cannot write metrics file: " << path << endl;
+        return started;
+    }
+    
+    // Headless mode: replays a command stream and reports throughput on stderr
+    void runBatch(istream& in, ostream& out) {
+        srand(time(nullptr));
+        CommandProcessor processor(theater);
+        auto start = chrono::steady_clock::now();
+        long long commands = processor.run(in, out);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cerr << "Processed " << commands << " commands in " << fixed << setprecision(3)
+             << seconds << " s (" << setprecision(0) << (seconds > 0 ? commands / seconds : 0.0)
+             << " commands/sec)" << endl;
+    }
+    
+#ifdef __linux__
+    // Serves the batch protocol over loopback TCP until interrupted
+    bool serve(int port) {
+        BookingServer::raiseDescriptorLimit();
+        BookingServer server(theater);
+        if(!server.listen(port)) {
+            cerr << "Cannot listen on 127.0.0.1:" << port << ": " << strerror(errno) << endl;
+            return false;
+        }
+        cerr << "Listening on 127.0.0.1:" << server.getPort() << " (Ctrl+C to stop)" << endl;
+        theater.startPeriodicRepricing(REPRICE_INTERVAL_SECONDS);
+        signalledServer = &server;
+        signal(SIGINT, stopSignalledServer);
+        signal(SIGTERM, stopSignalledServer);
+        server.run();
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        signalledServer = nullptr;
+        cerr << "Served " << server.getServed() << " requests on " << server.getAccepted() << " connections" << endl;
+        return true;
+    }
+#endif
+    
+    void run() {
+        srand(time(nullptr));
+        int choice;
+        
+        cout << "Welcome to Movie Booking System!" << endl;
+        theater.startPeriodicRepricing(REPRICE_INTERVAL_SECONDS);
+        
+        while(true) {
+            displayMenu();
+            choice = getValidatedInput(1, 10); // FIXED: Use validated input
+            
+            switch(choice) {
+                case 1:
+                    theater.displayShows();
+                    break;
+                    
+                case 2:
+                    theater.displaySeatingGrid(selectShow());
+                    break;
+                    
+                case 3: {
+                    int showIndex = selectShow();
+                    
+                    theater.displaySeatingGrid(showIndex);
+                    
+                    cout << "\nHow many seats do you want to book? ";
+                    int numSeats = getValidatedInput(1, SeatList::CAPACITY);
+                    
+                    cout << "1. Choose seats  2. Best available seats together: ";
+                    if(getValidatedInput(1, 2) == 2) {
+                        cout << "Seat type (1. VIP  2. Premium  3. Regular): ";
+                        const SeatType tiers[] = {SeatType::VIP, SeatType::PREMIUM, SeatType::REGULAR};
+                        SeatType tier = tiers[getValidatedInput(1, 3) - 1];
+                        Customer customer = getCustomerDetails();
+                        theater.bookBestSeats(showIndex, tier, numSeats, customer);
+                        break;
+                    }
+                    
+                    vector<string> seatIds;
+                    cout << "Enter seat IDs (e.g., A1, B5): ";
+                    cin.ignore(); // FIXED: Clear input buffer
+                    for(int i = 0; i < numSeats; i++) {
+                        string seatId;
+                        cin >> seatId;
+                        transform(seatId.begin(), seatId.end(), seatId.begin(), ::toupper);
+                        seatIds.push_back(seatId);
+                    }
+                    
+                    // Nobody else can take the seats while details are entered
+                    long long holdId = theater.holdForCheckout(showIndex, seatIds, CHECKOUT_HOLD_SECONDS);
+                    if(holdId < 0) break;
+                    Customer customer = getCustomerDetails();
+                    theater.bookHeldSeats(holdId, customer);
+                    break;
+                }
+                
+                case 4:
+                    theater.displayBookings();
+                    break;
+                    
+                case 5: {
+                    cout << "Enter booking ID: ";
+                    int bookingId = getValidatedInput(1000, 9999); // FIXED: Use validated input
+                    theater.searchBooking(bookingId);
+                    break;
+                }
+                
+                case 6: {
+                    string key;
+                    cout << "Enter phone or email: ";
+                    cin >> key;
+                    theater.searchCustomerBookings(key);
+                    break;
+                }
+                
+                case 7:
+                    theater.displayStats(selectShow());
+                    break;
+                    
+                case 8: {
+                    cout << "Enter booking ID: ";
+                    int bookingId = getValidatedInput(1000, 9999);
+                    theater.cancelBooking(bookingId);
+                    break;
+                }
+                
+                case 9: {
+                    cout << "Group by (1. Show  2. Movie  3. Seat type  4. Hour): ";
+                    const SettlementTable::Group groups[] = {SettlementTable::Group::SHOW, SettlementTable::Group::MOVIE,
+                                                             SettlementTable::Group::TIER, SettlementTable::Group::HOUR};
+                    SettlementTable::Group group = groups[getValidatedInput(1, 4) - 1];
+                    cout << "1. Today  2. All days: ";
+                    int day = getValidatedInput(1, 2) == 1 ? SettlementTable::getDay(time(0)) : -1;
+                    theater.displaySettlement(group, day);
+                    break;
+                }
+                
+                case 10:
+                    // Leave a fresh snapshot so the next start is instant
+                    if(theater.getJournal() && !theater.writeSnapshot()) {
+                        cout << "Could not write snapshot; bookings remain in the journal." << endl;
+                    }
+                    cout << "Thank you for using Movie Booking System!" << endl;
+                    return;
+                    
+                default:
+                    cout << "Invalid choice! Please try again." << endl;
+            }
+        }
+    }
+};
+
+// Start of the n-th show of a synthetic schedule for one hall: one every
+// three hours from 10:00 AM on 2024-01-15, so no two overlap
+time_t getBenchShowStart(int n) {
+    static const time_t FIRST = Show::parseStartTime("2024-01-15", "10:00 AM");
+    return FIRST + time_t(n) * 3 * 3600;
+}
+
+// Concurrent booking stress test. Threads race for the same hot shows and
+// front rows, and now and then cancel a random booking, possibly one another
+// thread is cancelling too; afterwards every seat is checked to have been
+// sold at most once and the seat maps to match the live bookings.
+void runStressTest(int maxThreads) {
+    const int ROWS = 26, COLS = 64, SHOWS = 128;
+    const int ATTEMPTS = 400000;
+    const int CANCEL_EVERY = 16; // attempts per cancellation attempt
+    
+    cout << "=== CONCURRENT BOOKING STRESS TEST ===" << endl;
+    cout << "Hall: " << ROWS << "x" << COLS << ", shows: " << SHOWS
+         << ", attempts per run: " << ATTEMPTS << endl;
+    cout << left << setw(9) << "Threads" << setw(11) << "Bookings" << setw(11) << "Rejected"
+         << setw(11) << "Cancelled" << setw(15) << "Bookings/sec" << setw(15) << "Attempts/sec"
+         << setw(13) << "CAS retries" << "Integrity" << endl;
+    
+    bool allOk = true;
+    for(int threads = 1; threads <= maxThreads; threads *= 2) {
+        Theater theater("Stress Theater", ROWS, COLS);
+        Movie movie("Stress Test", "Benchmark", 120, "U");
+        for(int s = 0; s < SHOWS; s++) {
+            theater.addShow(Show(movie, getBenchShowStart(s), 101 + s));
+        }
+        
+        atomic<int> booked(0), rejected(0), cancelled(0);
+        auto worker = [&](int seed, int attempts) {
+            mt19937 rng(seed);
+            uniform_real_distribution<double> unit(0.0, 1.0);
+            Customer customer("Stress Buyer", to_string(9000000000LL + seed), "stress@example.com", seed);
+            vector<string> seatIds;
+            int ok = 0, failed = 0, cancels = 0;
+            for(int a = 0; a < attempts; a++) {
+                int made = theater.getBookingCount();
+                if(a % CANCEL_EVERY == CANCEL_EVERY - 1 && made > 0) {
+                    int bookingId = 1001 + int(rng() % made);
+                    if(theater.commitCancellation(bookingId).status == BookingStatus::SUCCESS) cancels++;
+                    continue;
+                }
+                // Skew towards the first shows and rows, like an opening-night rush
+                double u = unit(rng), v = unit(rng);
+                int showIndex = int(SHOWS * u * u);
+                int row = int(ROWS * v * v);
+                int count = 1 + rng() % 4;
+                int col = rng() % (COLS - count + 1);
+                seatIds.clear();
+                for(int k = 0; k < count; k++) {
+                    seatIds.push_back(SeatCode::toString(row, col + k));
+                }
+                if(theater.commitBooking(showIndex, seatIds, customer).status == BookingStatus::SUCCESS) ok++;
+                else failed++;
+            }
+            booked += ok;
+            rejected += failed;
+            cancelled += cancels;
+        };
+        
+        auto start = chrono::steady_clock::now();
+        vector<thread> pool;
+        for(int t = 0; t < threads; t++) {
+            pool.emplace_back(worker, t + 1, ATTEMPTS / threads);
+        }
+        for(auto& t : pool) t.join();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        
+        bool ok = theater.verifyIntegrity() && theater.getBookingCount() == booked.load();
+        allOk = allOk && ok;
+        cout << left << setw(9) << threads << setw(11) << booked.load() << setw(11) << rejected.load()
+             << setw(11) << cancelled.load() << setw(15) << fixed << setprecision(0) << booked / seconds
+             << setw(15) << (booked + rejected) / seconds
+             << setw(13) << theater.getCasRetries() << (ok ? "OK" : "FAILED") << endl;
+    }
+    cout << (allOk ? "No seat was sold twice." : "DOUBLE BOOKING DETECTED!") << endl;
+}
+
+// Read view benchmark: booking and cancelling threads run alone, then
+// alongside readers that each take a show's seat grid and booking list as
+// of one read view, then alongside readers that take both live, then with
+// one view held open for the whole run and read at its end. A read is
+// inconsistent if the grid's booked seats are not the seats of the live
+// bookings for that show.
+bool runViewBenchmark(double seconds, int writers, int readers) {
+    const int ROWS = 10, COLS = 20, SHOWS = 4;
+    
+    cout << "=== READ VIEW BENCHMARK ===" << endl;
+    cout << "Hall: " << ROWS << "x" << COLS << ", shows: " << SHOWS << ", writers: " << writers
+         << ", " << fixed << setprecision(1) << seconds << "s per run" << endl;
+    cout << left << setw(16) << "Readers" << setw(14) << "Commits/sec" << setw(12) << "Reads/sec"
+         << "Inconsistent reads" << endl;
+    
+    enum class ReadMode { NONE, VIEW, LIVE, HELD };
+    long long viewViolations = 0;
+    for(ReadMode mode : {ReadMode::NONE, ReadMode::VIEW, ReadMode::LIVE, ReadMode::HELD}) {
+        Theater theater("View Bench", ROWS, COLS);
+        Movie movie("View Bench", "Benchmark", 120, "U");
+        for(int s = 0; s < SHOWS; s++) {
+            theater.addShow(Show(movie, getBenchShowStart(s), 101 + s));
+        }
+        
+        atomic<bool> stop(false);
+        atomic<long long> commits(0), reads(0), violations(0);
+        auto writer = [&](int seed) {
+            mt19937 rng(seed);
+            Customer customer("View Buyer", to_string(9000000000LL + seed), "view@example.com", seed);
+            vector<string> seatIds;
+            vector<int> mine; // this thread's live bookings
+            long long made = 0;
+            while(!stop.load(memory_order_relaxed)) {
+                // Cancel about as often as booking, so seats keep changing hands
+                if(!mine.empty() && rng() % 2) {
+                    size_t k = rng() % mine.size();
+                    if(theater.commitCancellation(mine[k]).status == BookingStatus::SUCCESS) made++;
+                    mine[k] = mine.back();
+                    mine.pop_back();
+                    continue;
+                }
+                int count = 1 + rng() % 3;
+                int row = rng() % ROWS, col = rng() % (COLS - count + 1);
+                seatIds.clear();
+                for(int k = 0; k < count; k++) seatIds.push_back(SeatCode::toString(row, col + k));
+                BookingResult result = theater.commitBooking(rng() % SHOWS, seatIds, customer);
+                if(result.status == BookingStatus::SUCCESS) {
+                    mine.push_back(result.booking->getBookingId());
+                    made++;
+                }
+            }
+            commits += made;
+        };
+        // Whether a view's grid of a show matches its live bookings
+        auto readView = [&](const Theater::ReadView& view, int showIndex, vector<SeatStatus>& seats) {
+            long long gridSeats = 0, bookedSeats = 0;
+            for(int i = 0; i < ROWS; i++) {
+                view.getRow(showIndex, i, seats);
+                for(int j = 0; j < COLS; j++) gridSeats += seats[j] == SeatStatus::BOOKED;
+            }
+            view.forEachBooking([&](const Booking& booking, time_t cancelledAt) {
+                if(booking.getShowIndex() == showIndex && !cancelledAt) bookedSeats += booking.getBookedSeats().size();
+            });
+            return gridSeats == bookedSeats;
+        };
+        auto reader = [&](int seed) {
+            mt19937 rng(seed);
+            long long done = 0, bad = 0;
+            vector<SeatStatus> seats;
+            while(!stop.load(memory_order_relaxed)) {
+                int showIndex = rng() % SHOWS;
+                bool consistent;
+                if(mode == ReadMode::VIEW) {
+                    Theater::ReadView view = theater.openReadView();
+                    consistent = readView(view, showIndex, seats);
+                } else {
+                    long long gridSeats = 0, bookedSeats = 0;
+                    const ShowOccupancy& seatMap = theater.getSeatMap(showIndex);
+                    for(int i = 0; i < ROWS; i++) {
+                        for(int j = 0; j < COLS; j++) gridSeats += seatMap.getStatus(i, j) == SeatStatus::BOOKED;
+                    }
+                    int count = theater.getBookingCount();
+                    for(int id = 1001; id < 1001 + count; id++) {
+                        const Booking* booking = theater.findBooking(id);
+                        if(booking && booking->getShowIndex() == showIndex && !theater.getCancelledAt(*booking)) {
+                            bookedSeats += booking->getBookedSeats().size();
+                        }
+                    }
+                    consistent = gridSeats == bookedSeats;
+                }
+                done++;
+                if(!consistent) bad++;
+            }
+            reads += done;
+            violations += bad;
+        };
+        
+        // A held view keeps every seat change since it opened in the logs,
+        // which writers must not pay for per booking
+        optional<Theater::ReadView> held;
+        if(mode == ReadMode::HELD) held.emplace(theater);
+        int readerCount = mode == ReadMode::VIEW || mode == ReadMode::LIVE ? readers : 0;
+        auto start = chrono::steady_clock::now();
+        vector<thread> pool;
+        for(int t = 0; t < writers; t++) pool.emplace_back(writer, t + 1);
+        for(int t = 0; t < readerCount; t++) pool.emplace_back(reader, 1000 + t);
+        this_thread::sleep_for(chrono::duration<double>(seconds));
+        stop = true;
+        for(auto& t : pool) t.join();
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if(held) {
+            vector<SeatStatus> seats;
+            for(int s = 0; s < SHOWS; s++) {
+                if(!readView(*held, s, seats)) violations++;
+            }
+        }
+        
+        if(mode == ReadMode::VIEW || mode == ReadMode::HELD) viewViolations += violations;
+        string label = mode == ReadMode::NONE ? "none" : mode == ReadMode::HELD ? "1 held" :
+                       to_string(readers) + (mode == ReadMode::VIEW ? " view" : " live");
+        cout << left << setw(16) << label << setw(14) << fixed << setprecision(0) << commits / elapsed;
+        if(mode == ReadMode::NONE || mode == ReadMode::HELD) cout << setw(12) << "-";
+        else cout << setw(12) << reads / elapsed;
+        if(mode == ReadMode::NONE) cout << "-" << endl;
+        else cout << violations.load() << endl;
+    }
+    cout << (viewViolations == 0 ? "Every read view was consistent." : "INCONSISTENT READ VIEW!") << endl;
+    return viewViolations == 0;
+}
+
+// Writes a journal of synthetic two-seat bookings that fill shows 101, 102,
+// ... in order; returns the number of shows used, or -1 on error
+int writeSyntheticJournal(const string& path, long long records, int rows, int cols) {
+    const int SEATS_PER_BOOKING = 2;
+    int bookingsPerShow = rows * cols / SEATS_PER_BOOKING;
+    BookingJournal writer;
+    if(!writer.open(path)) return -1;
+    
+    JournalBooking entry = {0, 0, 0, (long long)time(0), 0, "Bench Buyer", "0000000000",
+                            "bench@example.com", {}};
+    entry.seats.resize(SEATS_PER_BOOKING);
+    string payload;
+    uint64_t lsn = 0;
+    for(long long k = 0; k < records; k++) {
+        int seat = int(k % bookingsPerShow) * SEATS_PER_BOOKING;
+        entry.bookingId = 1001 + int(k);
+        entry.showId = 101 + int(k / bookingsPerShow);
+        entry.customerId = 1000 + int(k % 9000);
+        for(int i = 0; i < SEATS_PER_BOOKING; i++) {
+            entry.seats[i] = {(seat + i) / cols, (seat + i) % cols, SeatLayout::getTierPrice(SeatType::REGULAR)};
+        }
+        BookingJournal::encode(entry, payload);
+        lsn = writer.append(payload);
+        if(k % 65536 == 65535 && !writer.waitDurable(lsn)) return -1;
+    }
+    if(!writer.waitDurable(lsn)) return -1;
+    return int((records + bookingsPerShow - 1) / bookingsPerShow);
+}
+
+// Journal benchmark: fsyncs per booking under group commit as booking
+// threads are added, then recovery time for a log of many records.
+void runJournalBenchmark(long long records, int maxThreads) {
+    const int ROWS = 26, COLS = 64;
+    const int COMMITS = 1600;
+    const string path = "cinereserve_bench.journal";
+    Movie movie("Journal Bench", "Benchmark", 120, "U");
+    
+    cout << "=== JOURNAL GROUP COMMIT ===" << endl;
+    cout << left << setw(9) << "Threads" << setw(11) << "Bookings" << setw(9) << "Fsyncs"
+         << setw(16) << "Fsyncs/booking" << "Bookings/sec" << endl;
+    for(int threads = 1; threads <= maxThreads; threads *= 2) {
+        remove(path.c_str());
+        Theater theater("Journal Bench", ROWS, COLS);
+        for(int s = 0; s < threads; s++) {
+            theater.addShow(Show(movie, getBenchShowStart(s), 101 + s));
+        }
+        Theater::RecoveryStats recovery;
+        if(!theater.openJournal(path, recovery)) {
+            cout << "Cannot open " << path << endl;
+            return;
+        }
+        
+        // Each thread books its own show so only the journal is shared
+        auto worker = [&](int showIndex, int count) {
+            Customer customer("Bench Buyer", to_string(9000000000LL + showIndex), "bench@example.com", 1 + showIndex);
+            for(int k = 0; k < count; k++) {
+                int seat = k % (ROWS * COLS);
+                vector<string> seatIds = {SeatCode::toString(seat / COLS, seat % COLS)};
+                theater.commitBooking(showIndex, seatIds, customer);
+            }
+        };
+        auto start = chrono::steady_clock::now();
+        vector<thread> pool;
+        for(int t = 0; t < threads; t++) {
+            pool.emplace_back(worker, t, min(COMMITS / threads, ROWS * COLS));
+        }
+        for(auto& t : pool) t.join();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        
+        int booked = theater.getBookingCount();
+        uint64_t fsyncs = theater.getJournal()->getFsyncCount();
+        cout << left << setw(9) << threads << setw(11) << booked << setw(9) << fsyncs
+             << setw(16) << fixed << setprecision(3) << double(fsyncs) / max(booked, 1)
+             << setprecision(0) << booked / seconds << endl;
+    }
+    
+    // Write a large journal directly, then time a full replay
+    remove(path.c_str());
+    int showCount = writeSyntheticJournal(path, records, ROWS, COLS);
+    if(showCount < 0) {
+        cout << "Cannot write " << path << endl;
+        return;
+    }
+    
+    Theater theater("Journal Bench", ROWS, COLS);
+    for(int s = 0; s < showCount; s++) {
+        theater.addShow(Show(movie, getBenchShowStart(s), 101 + s));
+    }
+    Theater::RecoveryStats recovery;
+    bool ok = theater.openJournal(path, recovery);
+    cout << "\n=== JOURNAL RECOVERY ===" << endl;
+    cout << "Records: " << recovery.replay.records << " (" << fixed << setprecision(1)
+         << recovery.replay.bytes / 1048576.0 << " MB)" << endl;
+    cout << "Restored bookings: " << recovery.restored << (ok ? "" : " (replay failed)") << endl;
+    cout << "Recovery time: " << setprecision(3) << recovery.seconds << " s ("
+         << setprecision(0) << recovery.replay.records / max(recovery.seconds, 1e-9) << " records/sec)" << endl;
+    remove(path.c_str());
+}
+
+// Booking latency with receipts written on the booking thread versus
+// queued to the receipt pipeline. Both write to a temporary file.
+void runReceiptBenchmark(long long bookings, int threads) {
+    const int ROWS = 26, COLS = 64;
+    const int SEATS = ROWS * COLS;
+    int showCount = int((bookings + SEATS - 1) / SEATS);
+    showCount = (showCount + threads - 1) / threads * threads; // whole shows per thread
+    Movie movie("Receipt Bench", "Benchmark", 120, "U");
+    
+    cout << "=== RECEIPTS: ON THE BOOKING THREAD VS PIPELINE ===" << endl;
+    cout << "Bookings: " << bookings << ", threads: " << threads << endl;
+    cout << left << setw(12) << "Mode" << setw(14) << "Latency(us)" << setw(15) << "Bookings/sec"
+         << setw(15) << "Receipts/sec" << setw(10) << "Batches" << "MB" << endl;
+    for(bool pipelined : {false, true}) {
+        Theater theater("Receipt Bench", ROWS, COLS);
+        for(int s = 0; s < showCount; s++) {
+            theater.addShow(Show(movie, getBenchShowStart(s), 101 + s));
+        }
+        FILE* file = tmpfile();
+        if(!file) {
+            cout << "Cannot create a temporary file" << endl;
+            return;
+        }
+        ReceiptPipeline pipeline;
+        mutex fileLock;
+        atomic<long long> bytes(0);
+        if(pipelined) {
+            pipeline.open(file, false);
+            theater.setReceiptPipeline(&pipeline);
+        }
+        
+        // Thread t books every seat of shows t, t + threads, ... one at a time
+        atomic<long long> latencyNanos(0);
+        auto worker = [&](int first, long long count) {
+            Customer customer("Bench Buyer", to_string(9000000000LL + first), "bench@example.com", 1 + first);
+            string text;
+            long long nanos = 0;
+            for(long long k = 0; k < count; k++) {
+                int showIndex = first + int(k / SEATS) * threads;
+                int seat = k % SEATS;
+                vector<string> seatIds = {SeatCode::toString(seat / COLS, seat % COLS)};
+                auto start = chrono::steady_clock::now();
+                BookingResult result = theater.commitBooking(showIndex, seatIds, customer);
+                if(!pipelined && result.booking) {
+                    text.clear();
+                    result.booking->renderReceipt(theater.getCatalog(), text);
+                    lock_guard<mutex> guard(fileLock);
+                    fwrite(text.data(), 1, text.size(), file);
+                    fflush(file);
+                    bytes += text.size();
+                }
+                nanos += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+            }
+            latencyNanos += nanos;
+        };
+        auto start = chrono::steady_clock::now();
+        vector<thread> pool;
+        for(int t = 0; t < threads; t++) {
+            pool.emplace_back(worker, t, bookings / threads + (t < bookings % threads ? 1 : 0));
+        }
+        for(auto& t : pool) t.join();
+        double bookingSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        pipeline.close(); // waits for the last receipts to be written
+        double receiptSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        fclose(file);
+        
+        long long booked = theater.getBookingCount();
+        long long batches = pipelined ? pipeline.getBatchCount() : booked;
+        if(pipelined) bytes = pipeline.getBytesWritten();
+        cout << left << setw(12) << (pipelined ? "pipeline" : "synchronous")
+             << setw(14) << fixed << setprecision(2) << latencyNanos / 1000.0 / max(booked, 1LL)
+             << setw(15) << setprecision(0) << booked / bookingSeconds
+             << setw(15) << booked / receiptSeconds << setw(10) << batches
+             << setprecision(1) << bytes / 1048576.0 << endl;
+    }
+}
+
+// Settlement queries over a large booking history: every grouping on one
+// thread and on many, then booking throughput with and without queries
+// running alongside, to show queries do not hold up bookings
+void runSettlementBenchmark(long long bookings, int threads) {
+    const int ROWS = 26, COLS = 64;
+    const int SEATS_PER_BOOKING = 2;
+    const int BOOKINGS_PER_SHOW = ROWS * COLS / SEATS_PER_BOOKING;
+    const int MOVIES = 20;
+    const int CANCEL_EVERY = 25;
+    const int QUERY_ROUNDS = 5;
+    const int LIVE_SHOWS_PER_THREAD = 8;
+    int historyShows = int((bookings + BOOKINGS_PER_SHOW - 1) / BOOKINGS_PER_SHOW);
+    historyShows = (historyShows + threads - 1) / threads * threads; // whole shows per thread
+    int liveShows = 2 * threads * LIVE_SHOWS_PER_THREAD;
+    
+    Theater theater("Settlement Bench", ROWS, COLS);
+    for(int s = 0; s < historyShows + liveShows; s++) {
+        Movie movie("Settlement Movie " + to_string(s % MOVIES), "Benchmark", 120, "U");
+        theater.addShow(Show(movie, getBenchShowStart(s), 101 + s));
+    }
+    theater.preallocateBookings(int(min<long long>(bookings + (long long)liveShows * BOOKINGS_PER_SHOW,
+                                                   BookingStore::capacity())));
+    
+    // Books `count` pairs of seats in shows first, first + stride, ...
+    auto bookShows = [&](int first, int stride, long long count) {
+        Customer customer("Bench Buyer", to_string(9000000000LL + first), "bench@example.com", 1 + first);
+        vector<string> seatIds(SEATS_PER_BOOKING);
+        for(long long k = 0; k < count; k++) {
+            int showIndex = first + int(k / BOOKINGS_PER_SHOW) * stride;
+            int seat = int(k % BOOKINGS_PER_SHOW) * SEATS_PER_BOOKING;
+            for(int i = 0; i < SEATS_PER_BOOKING; i++, seat++) {
+                seatIds[i] = SeatCode::toString(seat / COLS, seat % COLS);
+            }
+            theater.commitBooking(showIndex, seatIds, customer);
+        }
+    };
+    auto start = chrono::steady_clock::now();
+    vector<thread> pool;
+    for(int t = 0; t < threads; t++) {
+        pool.emplace_back(bookShows, t, threads, bookings / threads + (t < bookings % threads ? 1 : 0));
+    }
+    for(auto& t : pool) t.join();
+    pool.clear();
+    for(int id = 1001; id < 1001 + theater.getBookingCount(); id += CANCEL_EVERY) {
+        theater.commitCancellation(id);
+    }
+    double fillSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    
+    cout << "=== SETTLEMENT QUERIES ===" << endl;
+    cout << "Bookings: " << theater.getBookingCount() << " (every " << CANCEL_EVERY << "th cancelled), shows: "
+         << historyShows << ", built in " << fixed << setprecision(2) << fillSeconds << " s" << endl;
+    cout << left << setw(10) << "Group" << setw(10) << "Threads" << setw(12) << "Lines" << setw(12) << "Time(ms)"
+         << "Lines/sec" << endl;
+    const pair<const char*, SettlementTable::Group> groups[] = {
+        {"show", SettlementTable::Group::SHOW}, {"movie", SettlementTable::Group::MOVIE},
+        {"tier", SettlementTable::Group::TIER}, {"hour", SettlementTable::Group::HOUR}};
+    for(const auto& group : groups) {
+        for(int queryThreads : {1, threads}) {
+            long long lines = 0;
+            double best = 1e9;
+            for(int round = 0; round < QUERY_ROUNDS; round++) {
+                auto queryStart = chrono::steady_clock::now();
+                lines = theater.settle(group.second, -1, queryThreads).total.lines;
+                best = min(best, chrono::duration<double>(chrono::steady_clock::now() - queryStart).count());
+            }
+            cout << left << setw(10) << group.first << setw(10) << queryThreads << setw(12) << lines
+                 << setw(12) << setprecision(2) << best * 1000 << setprecision(0) << lines / max(best, 1e-9) << endl;
+            if(queryThreads == threads) break;
+        }
+    }
+    
+    // Booking threads filling fresh shows, first alone and then with
+    // settlement queries running back to back on this thread
+    cout << "\nLive booking" << setw(14) << "" << "Bookings/sec   Queries" << endl;
+    for(bool querying : {false, true}) {
+        atomic<int> running(threads);
+        start = chrono::steady_clock::now();
+        for(int t = 0; t < threads; t++) {
+            pool.emplace_back([&, t] {
+                int first = historyShows + ((querying ? threads : 0) + t) * LIVE_SHOWS_PER_THREAD;
+                bookShows(first, 1, (long long)LIVE_SHOWS_PER_THREAD * BOOKINGS_PER_SHOW);
+                running--;
+            });
+        }
+        long long queries = 0;
+        while(querying && running.load() > 0) {
+            theater.settle(SettlementTable::Group::SHOW);
+            queries++;
+        }
+        for(auto& t : pool) t.join();
+        pool.clear();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << left << setw(26) << (querying ? "while settling" : "alone") << setw(15) << setprecision(0)
+             << (long long)threads * LIVE_SHOWS_PER_THREAD * BOOKINGS_PER_SHOW / seconds << queries << endl;
+    }
+    cout << (theater.verifyIntegrity() ? "Settlement totals match the booking counters." :
+                                         "SETTLEMENT TOTALS DO NOT MATCH!") << endl;
+}
+
+// Schedule queries over a chain's week of shows: the start-time and movie
+// indexes against scanning every show, plus overlap detection
+bool runScheduleBenchmark(int screens, int days) {
+    const int MOVIES = 40;
+    const int QUERIES = 20000;
+    const int PROBES = 20000;
+    mt19937 rng(7);
+    vector<string> titles;
+    vector<int> durations;
+    for(int m = 0; m < MOVIES; m++) {
+        titles.push_back("Movie " + to_string(m + 1));
+        durations.push_back(90 + int(rng() % 91));
+    }
+    
+    // Back-to-back shows on every screen from about 9 AM, with 15-45
+    // minutes between them for cleaning
+    ShowSchedule schedule;
+    vector<ShowSchedule::Entry> all;
+    vector<int> movieOf;
+    time_t firstDay = Show::parseStartTime("2024-01-15", "09:00");
+    auto start = chrono::steady_clock::now();
+    for(int screen = 0; screen < screens; screen++) {
+        for(int day = 0; day < days; day++) {
+            time_t dayStart = firstDay + time_t(day) * 86400;
+            for(time_t at = dayStart + rng() % 7 * 300; at < dayStart + 14 * 3600; ) {
+                int movie = rng() % MOVIES;
+                ShowSchedule::Entry entry = {at, at + time_t(durations[movie]) * 60, screen, 101 + int(all.size())};
+                if(!schedule.add(entry, titles[movie])) {
+                    cout << "Back-to-back show rejected as overlapping" << endl;
+                    return false;
+                }
+                all.push_back(entry);
+                movieOf.push_back(movie);
+                at = entry.end + (3 + rng() % 7) * 300;
+            }
+        }
+    }
+    double buildSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    
+    // Every probe starts inside an existing show on the same screen
+    int detected = 0;
+    for(int i = 0; i < PROBES; i++) {
+        const ShowSchedule::Entry& existing = all[rng() % all.size()];
+        time_t at = existing.start + rng() % (existing.end - existing.start);
+        if(!schedule.add({at, at + 5400, existing.screen, -1}, titles[0])) detected++;
+    }
+    
+    // "The next 5 shows of movie X after 6 PM" and "everything starting in
+    // the next hour", at random times through the week
+    vector<pair<time_t, int>> queries(QUERIES);
+    for(auto& query : queries) query = {firstDay + time_t(rng() % (days * 86400)), int(rng() % MOVIES)};
+    auto timeQueries = [&](bool indexed, long long& found) {
+        found = 0;
+        auto begin = chrono::steady_clock::now();
+        for(const auto& query : queries) {
+            time_t from = query.first;
+            if(indexed) {
+                found += schedule.getStarting(titles[query.second], from, numeric_limits<time_t>::max(), 5).size();
+                found += schedule.getStarting(from, from + 3600).size();
+                continue;
+            }
+            vector<ShowSchedule::Entry> next;
+            int inHour = 0;
+            for(size_t i = 0; i < all.size(); i++) {
+                if(movieOf[i] == query.second && all[i].start >= from) next.push_back(all[i]);
+                if(all[i].start >= from && all[i].start < from + 3600) inHour++;
+            }
+            found += min<size_t>(next.size(), 5) + inHour;
+        }
+        return chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    };
+    long long indexedFound = 0, scannedFound = 0;
+    double indexedSeconds = timeQueries(true, indexedFound);
+    double scannedSeconds = timeQueries(false, scannedFound);
+    
+    cout << "=== SHOW SCHEDULE ===" << endl;
+    cout << "Screens: " << screens << ", days: " << days << ", movies: " << MOVIES << ", shows: " << schedule.size()
+         << " (indexed in " << fixed << setprecision(1) << buildSeconds * 1000 << " ms)" << endl;
+    cout << "Overlaps detected   : " << detected << "/" << PROBES << endl;
+    cout << left << setw(20) << "Query pair" << setw(14) << "us/query" << "Shows found" << endl;
+    cout << setw(20) << "indexed" << setw(14) << setprecision(3) << indexedSeconds / QUERIES * 1e6 << indexedFound << endl;
+    cout << setw(20) << "full scan" << setw(14) << scannedSeconds / QUERIES * 1e6 << scannedFound << endl;
+    cout << "Speedup             : " << setprecision(0) << scannedSeconds / max(indexedSeconds, 1e-9) << "x" << endl;
+    bool ok = detected == PROBES && indexedFound == scannedFound;
+    cout << (ok ? "Index answers match a full scan." : "SCHEDULE INDEX IS WRONG!") << endl;
+    return ok;
+}
+
+// Weekly schedule load: writes a chain's export, then imports it into a
+// multiplex with one parsing thread and with `threads`
+bool runImportBenchmark(long long shows, int threads) {
+    const string path = "cinereserve_import.csv";
+    const int MOVIES = 400, DAYS = 7, SHOWS_PER_DAY = 5;
+    const int ROWS = 10, COLS = 12;
+    const char* genres[] = {"Action/Adventure", "Animation/Family", "Crime/Drama", "Comedy", "Horror"};
+    const char* ratings[] = {"G", "PG", "PG-13", "R"};
+    
+    // Some titles need quoting; every show is shorter than its 3 hour slot
+    mt19937 rng(11);
+    vector<string> movies;
+    for(int m = 0; m < MOVIES; m++) {
+        string title = "Feature " + to_string(m + 1);
+        if(m % 25 == 0) {
+            title = "\"The \"\"" + title + "\"\" Story\"";
+        } else if(m % 10 == 0) {
+            title = "\"" + title + ", Director's Cut\"";
+        }
+        movies.push_back(title + "," + genres[m % 5] + "," + to_string(80 + rng() % 95) + "," + ratings[m % 4]);
+    }
+    
+    // Exported screen by screen, so the importer has to put the shows in
+    // start order itself
+    long long screens = (shows + DAYS * SHOWS_PER_DAY - 1) / (DAYS * SHOWS_PER_DAY);
+    {
+        ofstream out(path, ios::binary);
+        out << "showId,date,time,title,genre,duration,rating,screen\n";
+        char prefix[64];
+        long long written = 0;
+        for(long long screen = 1; screen <= screens; screen++) {
+            for(int day = 0; day < DAYS && written < shows; day++) {
+                for(int slot = 0; slot < SHOWS_PER_DAY && written < shows; slot++) {
+                    int hour = 10 + slot * 3;
+                    snprintf(prefix, sizeof(prefix), "%lld,2024-01-%02d,%02d:00 %s,", 100000 + written, 15 + day,
+                             (hour + 11) % 12 + 1, hour < 12 ? "AM" : "PM");
+                    out << prefix << movies[rng() % MOVIES] << "," << screen << "\n";
+                    written++;
+                }
+            }
+        }
+        if(!out) {
+            cout << "Cannot write " << path << endl;
+            return false;
+        }
+    }
+    
+    cout << "=== SCHEDULE IMPORT ===" << endl;
+    cout << "Shows: " << shows << ", screens: " << screens << ", movies: " << MOVIES << endl;
+    cout << left << setw(10) << "Threads" << setw(12) << "Parse ms" << setw(12) << "Load ms"
+         << setw(12) << "Total ms" << setw(10) << "MB/s" << "Shows/s" << endl;
+    vector<int> threadCounts = {1};
+    if(threads > 1) threadCounts.push_back(threads);
+    bool ok = true;
+    for(int count : threadCounts) {
+        // The chain's screens exist before its schedule is loaded
+        Multiplex chain("Import Bench", 1);
+        int venue = chain.addVenue("Chain");
+        for(long long screen = 1; screen <= screens; screen++) {
+            chain.addScreen(venue, "Screen " + to_string(screen), ROWS, COLS);
+        }
+        auto sink = [&](int screen, const Show& show) {
+            return screen >= 1 && screen <= screens && chain.addShow(screen - 1, show);
+        };
+        ScheduleImporter::Stats stats;
+        if(!ScheduleImporter(count).import(path, sink, stats)) {
+            cout << "Cannot read " << path << endl;
+            return false;
+        }
+        cout << setw(10) << count << fixed << setprecision(1) << setw(12) << stats.parseSeconds * 1000
+             << setw(12) << stats.loadSeconds * 1000 << setw(12) << stats.getSeconds() * 1000
+             << setw(10) << stats.getMegabytesPerSecond() << setprecision(0) << stats.shows / stats.getSeconds() << endl;
+        if(stats.shows != shows || stats.refused > 0 || stats.badLines > 0 || stats.movies > MOVIES ||
+           chain.getSchedule().size() != shows) {
+            cout << "Imported " << stats.shows << " shows of " << stats.movies << " movies, " << stats.refused
+                 << " refused, " << stats.badLines << " bad lines" << endl;
+            ok = false;
+        }
+    }
+    remove(path.c_str());
+    cout << (ok ? "Every show imported, movies deduplicated." : "SCHEDULE IMPORT IS WRONG!") << endl;
+    return ok;
+}
+
+// Startup benchmark: full journal replay versus loading a snapshot
+void runSnapshotBenchmark(long long records) {
+    const int ROWS = 26, COLS = 64;
+    const string journalPath = "cinereserve_bench.journal";
+    const string snapshotPath = Theater::getSnapshotPathFor(journalPath);
+    Movie movie("Snapshot Bench", "Benchmark", 120, "U");
+    remove(journalPath.c_str());
+    remove(snapshotPath.c_str());
+    
+    int showCount = writeSyntheticJournal(journalPath, records, ROWS, COLS);
+    if(showCount < 0) {
+        cout << "Cannot write " << journalPath << endl;
+        return;
+    }
+    auto makeTheater = [&]() {
+        unique_ptr<Theater> theater(new Theater("Snapshot Bench", ROWS, COLS));
+        for(int s = 0; s < showCount; s++) {
+            theater->addShow(Show(movie, getBenchShowStart(s), 101 + s));
+        }
+        return theater;
+    };
+    
+    cout << "=== STARTUP: JOURNAL REPLAY VS SNAPSHOT ===" << endl;
+    cout << "Bookings: " << records << ", shows: " << showCount << endl;
+    
+    Theater::RecoveryStats replayed, loaded;
+    double writeSeconds;
+    {
+        unique_ptr<Theater> theater = makeTheater();
+        if(!theater->openJournal(journalPath, replayed)) {
+            cout << "Replay failed" << endl;
+            return;
+        }
+        auto start = chrono::steady_clock::now();
+        bool ok = theater->writeSnapshot();
+        writeSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if(!ok) {
+            cout << "Snapshot write failed" << endl;
+            return;
+        }
+    }
+    
+    unique_ptr<Theater> theater = makeTheater();
+    if(!theater->openJournal(journalPath, loaded)) {
+        cout << "Snapshot load failed" << endl;
+        return;
+    }
+    
+    // First reads decode bookings straight from the mapped file
+    mt19937 rng(7);
+    const int LOOKUPS = 10000;
+    int found = 0;
+    auto start = chrono::steady_clock::now();
+    for(int i = 0; i < LOOKUPS; i++) {
+        if(theater->findBooking(1001 + int(rng() % records))) found++;
+    }
+    double lookupSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    
+    struct stat info;
+    double snapshotMb = stat(snapshotPath.c_str(), &info) == 0 ? info.st_size / 1048576.0 : 0.0;
+    cout << fixed << setprecision(3);
+    cout << "Full journal replay : " << replayed.seconds << " s (" << replayed.restored << " bookings)" << endl;
+    cout << "Snapshot write      : " << writeSeconds << " s (" << setprecision(1) << snapshotMb << " MB)" << endl;
+    cout << setprecision(3);
+    cout << "Snapshot load       : " << loaded.seconds << " s (" << loaded.snapshotBookings << " bookings)" << endl;
+    cout << "Startup speedup     : " << setprecision(0) << replayed.seconds / max(loaded.seconds, 1e-9) << "x" << endl;
+    cout << "First lookups       : " << setprecision(2) << lookupSeconds / LOOKUPS * 1e6
+         << " us each (" << found << "/" << LOOKUPS << " found)" << endl;
+    
+    theater.reset();
+    remove(journalPath.c_str());
+    remove(snapshotPath.c_str());
+}
+
+// Synthetic booking load with opening-night skew: show popularity follows
+// a Zipf distribution, and seats near the middle of the row and the ideal
+// viewing distance are picked far more often than aisle or front seats.
+class LoadGenerator {
+private:
+    int rows, cols;
+    vector<double> showCdf; // cumulative popularity of shows 0..n-1
+    mt19937 rng;
+    uniform_real_distribution<double> unit;
+    normal_distribution<double> rowSpread, colSpread;
+    
+    static int clampTo(double value, int low, int high) {
+        return max(low, min(high, int(lround(value))));
+    }
+    
+public:
+    LoadGenerator(int r, int c, int shows, unsigned seed, double skew = 1.0)
+        : rows(r), cols(c), rng(seed), unit(0.0, 1.0),
+          // The ideal distance is two thirds of the hall back from the
+          // screen, which is past the last row
+          rowSpread(r - 1 - r * 2 / 3.0, max(r / 4.0, 1.0)),
+          colSpread((c - 1) / 2.0, max(c / 6.0, 1.0)) {
+        double total = 0.0;
+        for(int s = 0; s < shows; s++) {
+            total += 1.0 / pow(s + 1, skew);
+            showCdf.push_back(total);
+        }
+        for(double& p : showCdf) p /= total;
+    }
+    
+    int nextShow() {
+        int show = upper_bound(showCdf.begin(), showCdf.end(), unit(rng)) - showCdf.begin();
+        return min(show, int(showCdf.size()) - 1);
+    }
+    
+    // One seat id, centre-weighted
+    string nextSeatId() {
+        int row = clampTo(rowSpread(rng), 0, rows - 1);
+        int col = clampTo(colSpread(rng), 0, cols - 1);
+        return SeatCode::toString(row, col);
+    }
+    
+    // Fills seatIds with a party of 1-4 adjacent seats in one row, centred
+    // on a popular seat; returns the show index
+    int nextRequest(vector<string>& seatIds) {
+        const double PARTY_CDF[] = {0.35, 0.75, 0.85, 1.0}; // couples are most common
+        int count = 1;
+        double u = unit(rng);
+        while(count < 4 && u > PARTY_CDF[count - 1]) count++;
+        count = min(count, cols);
+        int row = clampTo(rowSpread(rng), 0, rows - 1);
+        int col = clampTo(colSpread(rng) - (count - 1) / 2.0, 0, cols - count);
+        seatIds.clear();
+        for(int k = 0; k < count; k++) {
+            seatIds.push_back(SeatCode::toString(row, col + k));
+        }
+        return nextShow();
+    }
+};
+
+// Stream buffer that drops everything, so console output can be timed
+// without a terminal
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int c) override { return traits_type::not_eof(c); }
+    streamsize xsputn(const char*, streamsize count) override { return count; }
+};
+
+struct BenchConfig {
+    int rows, cols, shows;
+    long long bookings;
+};
+
+// One JSON object per line, so results can be collected and compared
+void printBenchResult(const char* bench, const BenchConfig& config, long long ops, double seconds,
+                      long long succeeded = -1) {
+    cout << "{\"bench\":\"" << bench << "\",\"rows\":" << config.rows << ",\"cols\":" << config.cols
+         << ",\"shows\":" << config.shows << ",\"bookings\":" << config.bookings << ",\"ops\":" << ops;
+    if(succeeded >= 0) cout << ",\"succeeded\":" << succeeded;
+    cout << fixed << setprecision(6) << ",\"seconds\":" << seconds
+         << setprecision(1) << ",\"nsPerOp\":" << seconds * 1e9 / max(ops, 1LL)
+         << setprecision(0) << ",\"opsPerSec\":" << ops / max(seconds, 1e-9) << "}" << endl;
+}
+
+// Times the booking core for one hall size, show count and booking volume
+void runBenchConfig(const BenchConfig& config) {
+    const int FIND_SEAT_OPS = 200000;
+    const int SCAN_OPS = 20000;
+    const int STATS_OPS = 2000;
+    const int GRID_OPS = 500;
+    Movie movie("Bench Movie", "Benchmark", 120, "U");
+    auto makeTheater = [&]() {
+        unique_ptr<Theater> theater(new Theater("Bench Theater", config.rows, config.cols));
+        for(int s = 0; s < config.shows; s++) {
+            theater->addShow(Show(movie, getBenchShowStart(s), 101 + s));
+        }
+        return theater;
+    };
+    auto secondsSince = [](chrono::steady_clock::time_point start) {
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    };
+    
+    // Requests are generated up front so only the booking core is timed
+    LoadGenerator load(config.rows, config.cols, config.shows, 42);
+    vector<pair<int, vector<string>>> requests(config.bookings);
+    for(auto& request : requests) request.first = load.nextRequest(request.second);
+    vector<string> seatIds(4096);
+    for(string& id : seatIds) id = load.nextSeatId();
+    Customer customer("Bench Buyer", "9000000000", "bench@example.com", 1);
+    NullBuffer nullBuffer;
+    
+    unique_ptr<Theater> theater = makeTheater();
+    int found = 0;
+    auto start = chrono::steady_clock::now();
+    for(int i = 0; i < FIND_SEAT_OPS; i++) {
+        if(theater->findSeat(load.nextShow(), seatIds[i & 4095])) found++;
+    }
+    printBenchResult("findSeat", config, FIND_SEAT_OPS, secondsSince(start), found);
+    
+    // Seat lists as batch clients send them, then ids that must be rejected
+    vector<string> seatLists(4096);
+    for(size_t i = 0; i < seatLists.size(); i++) {
+        for(const string& seatId : requests[i % requests.size()].second) {
+            if(!seatLists[i].empty()) seatLists[i] += ',';
+            seatLists[i] += seatId;
+        }
+    }
+    int parsed = 0;
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < FIND_SEAT_OPS; i++) {
+        const string& seatList = seatLists[i & 4095];
+        SeatRequest request;
+        request.parseList(seatList.data(), seatList.size());
+        if(request.getRow(0) >= 0) parsed++;
+    }
+    printBenchResult("parseSeatList", config, FIND_SEAT_OPS, secondsSince(start), parsed);
+    
+    const string BAD_IDS[] = {"AX", "A0", "A", "?1", "A12345", "1A", "AAA1", "a-1"};
+    int rejected = 0;
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < FIND_SEAT_OPS; i++) {
+        if(!theater->findSeat(load.nextShow(), BAD_IDS[i & 7])) rejected++;
+    }
+    printBenchResult("findSeat(bad)", config, FIND_SEAT_OPS, secondsSince(start), rejected);
+    
+    long long booked = 0;
+    start = chrono::steady_clock::now();
+    for(const auto& request : requests) {
+        if(theater->commitBooking(request.first, request.second, customer).status == BookingStatus::SUCCESS) {
+            booked++;
+        }
+    }
+    printBenchResult("commitBooking", config, config.bookings, secondsSince(start), booked);
+    
+    // Seat map scans over the booked theater, specialised for the row width
+    // and generic
+    for(bool generic : {false, true}) {
+        long long counted = 0;
+        start = chrono::steady_clock::now();
+        for(int i = 0; i < SCAN_OPS; i++) {
+            const ShowOccupancy& seatMap = theater->getSeatMap(i % config.shows);
+            counted += generic ? seatMap.countStatusGeneric(SeatStatus::BOOKED) : seatMap.countStatus(SeatStatus::BOOKED);
+        }
+        printBenchResult(generic ? "countStatus(generic)" : "countStatus", config, SCAN_OPS, secondsSince(start), counted);
+        
+        int blocks = 0, row = 0, col = 0;
+        start = chrono::steady_clock::now();
+        for(int i = 0; i < SCAN_OPS; i++) {
+            const ShowOccupancy& seatMap = theater->getSeatMap(i % config.shows);
+            SeatType tier = SeatType(i % 3);
+            int count = 1 + i % 4;
+            if(generic ? seatMap.findBestBlockGeneric(tier, count, row, col) : seatMap.findBestBlock(tier, count, row, col)) {
+                blocks++;
+            }
+        }
+        printBenchResult(generic ? "findBestBlock(generic)" : "findBestBlock", config, SCAN_OPS, secondsSince(start), blocks);
+    }
+    
+    // The same with metrics attached, to show what instrumentation costs
+    {
+        BookingMetrics metrics;
+        unique_ptr<Theater> metered = makeTheater();
+        metered->setMetrics(&metrics);
+        int meteredFound = 0;
+        start = chrono::steady_clock::now();
+        for(int i = 0; i < FIND_SEAT_OPS; i++) {
+            if(metered->findSeat(load.nextShow(), seatIds[i & 4095])) meteredFound++;
+        }
+        printBenchResult("findSeat+metrics", config, FIND_SEAT_OPS, secondsSince(start), meteredFound);
+        long long meteredBooked = 0;
+        start = chrono::steady_clock::now();
+        for(const auto& request : requests) {
+            if(metered->commitBooking(request.first, request.second, customer).status == BookingStatus::SUCCESS) {
+                meteredBooked++;
+            }
+        }
+        printBenchResult("commitBooking+metrics", config, config.bookings, secondsSince(start), meteredBooked);
+    }
+    
+    // Repricing every show against the booked state
+    const int REPRICE_OPS = 200;
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < REPRICE_OPS; i++) theater->repriceAll();
+    printBenchResult("repriceAll", config, REPRICE_OPS, secondsSince(start));
+    
+    // The interactive path: booking plus the printed receipt, declining
+    // the offer to save a copy
+    {
+        unique_ptr<Theater> printing = makeTheater();
+        string answers;
+        for(long long i = 0; i < config.bookings; i++) answers += "n\n";
+        istringstream input(answers);
+        streambuf* keyboard = cin.rdbuf(input.rdbuf());
+        streambuf* console = cout.rdbuf(&nullBuffer);
+        long long printed = 0;
+        start = chrono::steady_clock::now();
+        for(const auto& request : requests) {
+            if(printing->bookSeats(request.first, request.second, customer)) printed++;
+        }
+        double seconds = secondsSince(start);
+        cout.rdbuf(console);
+        cin.rdbuf(keyboard);
+        printBenchResult("bookSeats", config, config.bookings, seconds, printed);
+    }
+    
+    // Lookup by id and the details searchBooking shows, without its prompt
+    int lastId = 1001 + theater->getBookingCount() - 1;
+    mt19937 rng(7);
+    streambuf* console = cout.rdbuf(&nullBuffer);
+    found = 0;
+    start = chrono::steady_clock::now();
+    for(long long i = 0; i < config.bookings; i++) {
+        if(const Booking* booking = theater->findBooking(1001 + int(rng() % max(lastId - 1000, 1)))) {
+            booking->displayBookingDetails(theater->getCatalog());
+            found++;
+        }
+    }
+    double searchSeconds = secondsSince(start);
+    
+    auto statsStart = chrono::steady_clock::now();
+    for(int i = 0; i < STATS_OPS; i++) theater->displayStats(load.nextShow());
+    double statsSeconds = secondsSince(statsStart);
+    
+    auto gridStart = chrono::steady_clock::now();
+    for(int i = 0; i < GRID_OPS; i++) theater->displaySeatingGrid(load.nextShow());
+    double gridSeconds = secondsSince(gridStart);
+    cout.rdbuf(console);
+    
+    printBenchResult("searchBooking", config, config.bookings, searchSeconds, found);
+    printBenchResult("displayStats", config, STATS_OPS, statsSeconds);
+    printBenchResult("seatGrid", config, GRID_OPS, gridSeconds);
+}
+
+// Benchmark suite; sweeps hall sizes and show counts unless one is given
+void runBenchmarks(long long bookings, int rows, int cols, int shows) {
+    vector<BenchConfig> configs;
+    if(rows > 0 && cols > 0 && shows > 0) {
+        configs.push_back({rows, cols, shows, bookings});
+    } else {
+        for(auto hall : {make_pair(10, 10), make_pair(20, 40), make_pair(26, 64)}) {
+            for(int showCount : {4, 64}) {
+                configs.push_back({hall.first, hall.second, showCount, bookings});
+            }
+        }
+    }
+    for(const BenchConfig& config : configs) runBenchConfig(config);
+}
+
+// Multiplex load test: client threads submit skewed booking traffic for
+// a whole chain while chain-wide statistics are read as it runs
+void runMultiplexTest(int venueCount, int screensPerVenue, int shardCount, long long bookings, int clients) {
+    const int ROWS = 20, COLS = 30, SHOWS_PER_SCREEN = 4;
+    const int WINDOW = 512; // requests a client keeps in flight
+    const char* TIMES[SHOWS_PER_SCREEN] = {"10:00 AM", "01:30 PM", "05:00 PM", "09:00 PM"};
+    Movie movie("Chain Premiere", "Benchmark", 150, "U");
+    
+    Multiplex chain("Cineplex Chain", shardCount);
+    vector<int> showIds;
+    for(int v = 0; v < venueCount; v++) {
+        int venue = chain.addVenue("Venue " + to_string(v + 1));
+        for(int s = 0; s < screensPerVenue; s++) {
+            int screen = chain.addScreen(venue, "Screen " + to_string(s + 1), ROWS, COLS);
+            for(int k = 0; k < SHOWS_PER_SCREEN; k++) {
+                int showId = 101 + int(showIds.size());
+                chain.addShow(screen, Show(movie, TIMES[k], "2024-01-15", showId));
+                showIds.push_back(showId);
+            }
+        }
+    }
+    
+    cout << "=== MULTIPLEX: SHARD-PER-CORE SCREENS ===" << endl;
+    cout << "Venues: " << chain.getVenueCount() << ", screens: " << chain.getScreenCount()
+         << ", shows: " << chain.getShowCount() << ", shards: " << chain.getShardCount()
+         << ", clients: " << clients << ", requests: " << bookings << endl;
+    
+    atomic<long long> succeeded(0), completed(0);
+    atomic<int> running(clients);
+    auto client = [&](int seed, long long count) {
+        LoadGenerator load(ROWS, COLS, showIds.size(), seed);
+        Customer customer("Chain Buyer", to_string(9000000000LL + seed), "chain@example.com", seed);
+        atomic<int> inFlight(0);
+        vector<string> seatIds;
+        for(long long i = 0; i < count; i++) {
+            while(inFlight.load(memory_order_acquire) >= WINDOW) this_thread::yield();
+            int showId = showIds[load.nextRequest(seatIds)];
+            inFlight.fetch_add(1, memory_order_relaxed);
+            chain.submitBooking(showId, seatIds, customer, [&](const BookingResult& result) {
+                if(result.status == BookingStatus::SUCCESS) succeeded.fetch_add(1, memory_order_relaxed);
+                completed.fetch_add(1, memory_order_relaxed);
+                inFlight.fetch_sub(1, memory_order_release);
+            });
+        }
+        while(inFlight.load(memory_order_acquire) > 0) this_thread::yield();
+        running.fetch_sub(1, memory_order_release);
+    };
+    
+    auto start = chrono::steady_clock::now();
+    vector<thread> pool;
+    for(int c = 0; c < clients; c++) {
+        pool.emplace_back(client, c + 1, bookings / clients + (c < bookings % clients ? 1 : 0));
+    }
+    
+    // Sample chain totals while the shards keep booking
+    int samples = 0;
+    while(running.load(memory_order_acquire) > 0) {
+        this_thread::sleep_for(chrono::milliseconds(50));
+        ShowStats live = chain.getStats();
+        if(samples++ < 5) {
+            cout << "  live: " << completed.load() << " requests done, " << live.bookingCount
+                 << " bookings, " << fixed << setprecision(1) << live.getOccupancyRate() << "% full" << endl;
+        }
+    }
+    for(auto& t : pool) t.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    
+    ShowStats totals = chain.getStats();
+    bool ok = chain.verifyIntegrity() && totals.bookingCount == succeeded.load();
+    long long busiest = 0, idlest = bookings;
+    for(int s = 0; s < chain.getShardCount(); s++) {
+        busiest = max(busiest, chain.getShardExecuted(s));
+        idlest = min(idlest, chain.getShardExecuted(s));
+    }
+    cout << "Bookings: " << succeeded.load() << " of " << completed.load() << " requests in "
+         << setprecision(3) << seconds << " s (" << setprecision(0) << completed / seconds << " requests/sec)" << endl;
+    cout << "Requests per shard: " << idlest << " to " << busiest << endl;
+    for(int v = 0; v < min(chain.getVenueCount(), 3); v++) {
+        ShowStats venue = chain.getStats(v);
+        cout << "Venue " << (v + 1) << ": " << venue.bookedSeats << "/" << venue.totalSeats << " seats, Rs."
+             << formatRupees(venue.revenue) << endl;
+    }
+    cout << "Chain: " << totals.bookedSeats << "/" << totals.totalSeats << " seats ("
+         << setprecision(1) << totals.getOccupancyRate() << "%), Rs." << formatRupees(totals.revenue) << endl;
+    cout << (ok ? "Integrity OK: no seat sold twice, totals match." : "INTEGRITY CHECK FAILED!") << endl;
+}
+
+#ifdef __linux__
+// Loopback load client: keeps many connections open against a booking
+// server, each with one request in flight, and reports request latency
+// percentiles. The mix is mostly bookings, with holds, seat maps, booking
+// lookups and show listings. Port 0 starts a server in this process.
+bool runLoadClient(int port, int connectionCount, long long requests) {
+    const int MAX_EVENTS = 256;
+    BookingServer::raiseDescriptorLimit();
+    
+    // An in-process server gets a larger theater so bookings keep succeeding
+    unique_ptr<Theater> localTheater;
+    unique_ptr<BookingServer> localServer;
+    thread serverThread;
+    if(port == 0) {
+        localTheater.reset(new Theater("Load Test Theater", 26, 64));
+        Movie movie("Load Test", "Benchmark", 120, "U");
+        for(int s = 0; s < 64; s++) {
+            localTheater->addShow(Show(movie, getBenchShowStart(s), 101 + s));
+        }
+        localServer.reset(new BookingServer(*localTheater));
+        if(!localServer->listen(0)) {
+            cout << "Cannot start a local server" << endl;
+            return false;
+        }
+        port = localServer->getPort();
+        serverThread = thread([&] { localServer->run(); });
+    }
+    
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    auto connectOne = [&]() {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if(fd >= 0 && connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+            close(fd);
+            fd = -1;
+        }
+        return fd;
+    };
+    auto stopLocalServer = [&]() {
+        if(localServer) {
+            localServer->stop();
+            serverThread.join();
+        }
+    };
+    
+    // Learn the shows and hall size with one blocking request
+    vector<int> showIds;
+    int rows = 0, cols = 0;
+    {
+        int fd = connectOne();
+        string response;
+        char buffer[4096];
+        ssize_t n;
+        if(fd >= 0 && send(fd, "SHOWS\n", 6, MSG_NOSIGNAL) == 6) {
+            while(response.find('\n') == string::npos && (n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+                response.append(buffer, n);
+            }
+        }
+        if(fd >= 0) close(fd);
+        auto numberAfter = [&](const string& key, size_t from) {
+            size_t at = response.find(key, from);
+            return at == string::npos ? -1 : atoi(response.c_str() + at + key.size());
+        };
+        for(size_t at = response.find("\"showId\":"); at != string::npos;
+            at = response.find("\"showId\":", at + 1)) {
+            showIds.push_back(numberAfter("\"showId\":", at));
+        }
+        rows = numberAfter("\"rows\":", 0);
+        cols = numberAfter("\"cols\":", 0);
+    }
+    if(showIds.empty() || rows <= 0 || cols <= 0) {
+        cout << "Cannot read the show list from 127.0.0.1:" << port << endl;
+        stopLocalServer();
+        return false;
+    }
+    
+    struct ClientConnection {
+        int fd;
+        string in;
+        chrono::steady_clock::time_point sentAt;
+    };
+    int epollFd = epoll_create1(0);
+    vector<ClientConnection> clients;
+    for(int c = 0; c < connectionCount; c++) {
+        int fd = connectOne();
+        if(fd < 0) break;
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        clients.push_back({fd, "", {}});
+    }
+    for(size_t c = 0; c < clients.size(); c++) {
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u32 = c;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, clients[c].fd, &event);
+    }
+    
+    LoadGenerator load(rows, cols, showIds.size(), 42);
+    mt19937 rng(11);
+    vector<string> seatIds;
+    long long sent = 0, booked = 0, failed = 0;
+    auto sendNext = [&](int c) {
+        string request;
+        int showId = showIds[load.nextRequest(seatIds)];
+        int kind = rng() % 100;
+        if(kind < 55) {
+            request = "BOOK " + to_string(showId) + " ";
+            for(size_t k = 0; k < seatIds.size(); k++) request += (k ? "," : "") + seatIds[k];
+            request += " " + to_string(9000000000LL + c) + " load" + to_string(c) + "@example.com Load Client";
+        } else if(kind < 65) {
+            request = "HOLD " + to_string(showId) + " " + seatIds[0] + " 30";
+        } else if(kind < 80) {
+            request = "SEATS " + to_string(showId);
+        } else if(kind < 95) {
+            request = "SEARCH " + to_string(1001 + rng() % (booked + 1));
+        } else {
+            request = "SHOWS";
+        }
+        request += '\n';
+        clients[c].sentAt = chrono::steady_clock::now();
+        sent++;
+        return send(clients[c].fd, request.data(), request.size(), MSG_NOSIGNAL) == (ssize_t)request.size();
+    };
+    
+    cout << "=== LOOPBACK LOAD CLIENT ===" << endl;
+    cout << "Server: 127.0.0.1:" << port << ", connections: " << clients.size()
+         << ", requests: " << requests << endl;
+    
+    vector<long long> latencies; // microseconds
+    latencies.reserve(requests);
+    int open = 0;
+    auto start = chrono::steady_clock::now();
+    for(size_t c = 0; c < clients.size() && sent < requests; c++) {
+        if(sendNext(c)) open++;
+        else failed++;
+    }
+    epoll_event events[MAX_EVENTS];
+    char buffer[65536];
+    while(open > 0) {
+        int ready = epoll_wait(epollFd, events, MAX_EVENTS, 5000);
+        if(ready <= 0) break; // the server stopped answering
+        for(int i = 0; i < ready; i++) {
+            ClientConnection& client = clients[events[i].data.u32];
+            ssize_t n = recv(client.fd, buffer, sizeof(buffer), 0);
+            if(n <= 0) {
+                if(n < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, client.fd, nullptr);
+                open--;
+                failed++;
+                continue;
+            }
+            client.in.append(buffer, n);
+            size_t end = client.in.find('\n');
+            if(end == string::npos) continue;
+            auto now = chrono::steady_clock::now();
+            latencies.push_back(chrono::duration_cast<chrono::microseconds>(now - client.sentAt).count());
+            if(client.in.compare(0, 25, "{\"cmd\":\"BOOK\",\"ok\":true,\"") == 0) booked++;
+            client.in.erase(0, end + 1);
+            if(sent >= requests) {
+                open--;
+            } else if(!sendNext(events[i].data.u32)) {
+                open--;
+                failed++;
+            }
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    for(auto& client : clients) close(client.fd);
+    close(epollFd);
+    stopLocalServer();
+    
+    sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies.empty() ? 0LL : latencies[min(latencies.size() - 1, size_t(p / 100.0 * latencies.size()))];
+    };
+    cout << "Responses: " << latencies.size() << " (" << booked << " bookings made, " << failed
+         << " connection errors) in " << fixed << setprecision(3) << seconds << " s, "
+         << setprecision(0) << latencies.size() / seconds << " requests/sec" << endl;
+    cout << "Latency (us): p50 " << percentile(50) << ", p90 " << percentile(90) << ", p99 " << percentile(99)
+         << ", p99.9 " << percentile(99.9) << ", max " << (latencies.empty() ? 0LL : latencies.back()) << endl;
+    return failed == 0 && (long long)latencies.size() == requests;
+}
+#endif
+
+#ifdef CINE_ALLOC_CHECK
+// Heap allocations made by the current thread, counted by the global
+// operator new below; read by the allocation check. Only in builds made
+// for the check, so other builds keep the standard allocator.
+thread_local long long heapAllocations = 0;
+
+void* operator new(size_t size) {
+    heapAllocations++;
+    if(void* memory = malloc(size ? size : 1)) return memory;
+    throw bad_alloc();
+}
+
+// Kept out of line so the compiler does not pair an inlined free with
+// the operator new above
+__attribute__((noinline)) void operator delete(void* memory) noexcept { free(memory); }
+__attribute__((noinline)) void operator delete(void* memory, size_t) noexcept { free(memory); }
+
+// Counts heap allocations on the booking path once it is warm, in memory
+// and with a journal. Room for the bookings is set aside first, as a
+// deployment would at startup. Returns false if anything was allocated.
+bool runAllocationCheck(long long bookings) {
+    const int ROWS = 26, COLS = 64;
+    const int SEATS_PER_BOOKING = 2;
+    const int BOOKINGS_PER_SHOW = ROWS * COLS / SEATS_PER_BOOKING;
+    const int WARMUP = 1000;
+    const string path = "cinereserve_alloc.journal";
+    int showCount = int((WARMUP + bookings + BOOKINGS_PER_SHOW - 1) / BOOKINGS_PER_SHOW);
+    Movie movie("Allocation Check", "Benchmark", 120, "U");
+    
+    // Seat ids are built up front; seatIds only ever holds short strings
+    vector<string> ids;
+    for(int seat = 0; seat < ROWS * COLS; seat++) {
+        ids.push_back(SeatCode::toString(seat / COLS, seat % COLS));
+    }
+    vector<string> seatIds(SEATS_PER_BOOKING);
+    
+    cout << "=== ALLOCATIONS ON THE BOOKING PATH ===" << endl;
+    cout << "Bookings: " << bookings << " after " << WARMUP << " warm-up bookings" << endl;
+    cout << left << setw(12) << "Mode" << setw(14) << "Allocations" << setw(14) << "Per booking"
+         << "Booked" << endl;
+    bool allOk = true;
+    for(bool journaled : {false, true}) {
+        remove(path.c_str());
+        remove(Theater::getSnapshotPathFor(path).c_str());
+        Theater theater("Allocation Check", ROWS, COLS);
+        for(int s = 0; s < showCount; s++) {
+            theater.addShow(Show(movie, getBenchShowStart(s), 101 + s));
+        }
+        Theater::RecoveryStats recovery;
+        if(journaled && !theater.openJournal(path, recovery)) {
+            cout << "Cannot open " << path << endl;
+            return false;
+        }
+        theater.preallocateBookings(int(WARMUP + bookings));
+        Customer customer("Alloc Buyer", "9000000000", "alloc@example.com", 1);
+        
+        long long booked = 0, allocations = 0;
+        for(long long k = 0; k < WARMUP + bookings; k++) {
+            if(k == WARMUP) allocations = heapAllocations;
+            int showIndex = int(k / BOOKINGS_PER_SHOW);
+            int seat = int(k % BOOKINGS_PER_SHOW) * SEATS_PER_BOOKING;
+            for(int i = 0; i < SEATS_PER_BOOKING; i++) seatIds[i] = ids[seat + i];
+            if(theater.commitBooking(showIndex, seatIds, customer).status == BookingStatus::SUCCESS &&
+               k >= WARMUP) booked++;
+        }
+        allocations = heapAllocations - allocations;
+        
+        allOk = allOk && allocations == 0 && booked == bookings;
+        cout << left << setw(12) << (journaled ? "journaled" : "in-memory") << setw(14) << allocations
+             << setw(14) << fixed << setprecision(3) << double(allocations) / max(bookings, 1LL)
+             << booked << endl;
+    }
+    remove(path.c_str());
+    remove(Theater::getSnapshotPathFor(path).c_str());
+    cout << (allOk ? "No heap allocations while booking." : "BOOKING PATH ALLOCATES!") << endl;
+    return allOk;
+}
+#endif
+
+int main(int argc, char* argv[]) {
+    // --journal <path>, --receipts <path>, --metrics <path>, --layout <path>
+    // and --schedule <path> may appear anywhere; the first remaining
+    // argument picks the mode
+    vector<string> args;
+    string journalPath, receiptsPath, metricsPath, layoutPath, schedulePath;
+    bool journalGiven = false;
+    for(int i = 1; i < argc; i++) {
+        if(string(argv[i]) == "--journal" && i + 1 < argc) {
+            journalPath = argv[++i];
+            journalGiven = true;
+        } else if(string(argv[i]) == "--receipts" && i + 1 < argc) {
+            receiptsPath = argv[++i];
+        } else if(string(argv[i]) == "--metrics" && i + 1 < argc) {
+            metricsPath = argv[++i];
+        } else if(string(argv[i]) == "--layout" && i + 1 < argc) {
+            layoutPath = argv[++i];
+        } else if(string(argv[i]) == "--schedule" && i + 1 < argc) {
+            schedulePath = argv[++i];
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    string mode = args.empty() ? "" : args[0];
+    
+    if(mode == "--stress") {
+        int threads = args.size() > 1 ? atoi(args[1].c_str()) : int(thread::hardware_concurrency());
+        runStressTest(max(threads, 1));
+        return 0;
+    }
+    if(mode == "--view-bench") {
+        double seconds = args.size() > 1 ? atof(args[1].c_str()) : 2.0;
+        int writers = args.size() > 2 ? atoi(args[2].c_str()) : 4;
+        int readers = args.size() > 3 ? atoi(args[3].c_str()) : 4;
+        return runViewBenchmark(max(seconds, 0.1), max(writers, 1), max(readers, 1)) ? 0 : 1;
+    }
+    if(mode == "--snapshot-bench") {
+        long long records = args.size() > 1 ? atoll(args[1].c_str()) : 1000000;
+        runSnapshotBenchmark(max(records, 1LL));
+        return 0;
+    }
+    if(mode == "--wal-bench") {
+        long long records = args.size() > 1 ? atoll(args[1].c_str()) : 1000000;
+        int threads = args.size() > 2 ? atoi(args[2].c_str()) : 16;
+        runJournalBenchmark(max(records, 1LL), max(threads, 1));
+        return 0;
+    }
+    
+    if(mode == "--receipt-bench") {
+        long long bookings = args.size() > 1 ? atoll(args[1].c_str()) : 200000;
+        int threads = args.size() > 2 ? atoi(args[2].c_str()) : 4;
+        runReceiptBenchmark(max(bookings, 1LL), max(threads, 1));
+        return 0;
+    }
+    
+    if(mode == "--schedule-bench") {
+        int screens = args.size() > 1 ? atoi(args[1].c_str()) : 120;
+        int days = args.size() > 2 ? atoi(args[2].c_str()) : 7;
+        return runScheduleBenchmark(max(screens, 1), max(days, 1)) ? 0 : 1;
+    }
+    
+    if(mode == "--import-bench") {
+        long long shows = args.size() > 1 ? atoll(args[1].c_str()) : 50000;
+        int threads = args.size() > 2 ? atoi(args[2].c_str()) : int(thread::hardware_concurrency());
+        return runImportBenchmark(max(shows, 1LL), max(threads, 1)) ? 0 : 1;
+    }
+    
+    if(mode == "--settle-bench") {
+        long long bookings = args.size() > 1 ? atoll(args[1].c_str()) : 2000000;
+        int threads = args.size() > 2 ? atoi(args[2].c_str()) : int(thread::hardware_concurrency());
+        runSettlementBenchmark(max(bookings, 1LL), max(threads, 1));
+        return 0;
+    }
+    
+    if(mode == "--bench") {
+        long long bookings = args.size() > 1 ? atoll(args[1].c_str()) : 20000;
+        int rows = args.size() > 2 ? min(atoi(args[2].c_str()), SeatCode::MAX_ROWS) : 0;
+        int cols = args.size() > 3 ? min(atoi(args[3].c_str()), SeatCode::MAX_COLS) : 0;
+        int shows = args.size() > 4 ? atoi(args[4].c_str()) : 0;
+        runBenchmarks(max(bookings, 1LL), rows, cols, shows);
+        return 0;
+    }
+    
+    if(mode == "--multiplex") {
+        int venues = args.size() > 1 ? atoi(args[1].c_str()) : 8;
+        int screens = args.size() > 2 ? atoi(args[2].c_str()) : 12;
+        int shards = args.size() > 3 ? atoi(args[3].c_str()) : 0;
+        long long requests = args.size() > 4 ? atoll(args[4].c_str()) : 400000;
+        int clients = args.size() > 5 ? atoi(args[5].c_str()) : 4;
+        runMultiplexTest(max(venues, 1), max(screens, 1), shards, max(requests, 1LL), max(clients, 1));
+        return 0;
+    }
+    
+#ifdef __linux__
+    if(mode == "--load-client") {
+        int port = args.size() > 1 ? atoi(args[1].c_str()) : 0;
+        int connections = args.size() > 2 ? atoi(args[2].c_str()) : 1000;
+        long long requests = args.size() > 3 ? atoll(args[3].c_str()) : 200000;
+        return runLoadClient(port, max(connections, 1), max(requests, 1LL)) ? 0 : 1;
+    }
+#endif
+    
+    if(mode == "--alloc-check") {
+#ifdef CINE_ALLOC_CHECK
+        long long bookings = args.size() > 1 ? atoll(args[1].c_str()) : 20000;
+        return runAllocationCheck(max(bookings, 1LL)) ? 0 : 1;
+#else
+        cerr << "Allocation counting is not built in; rebuild with -DCINE_ALLOC_CHECK" << endl;
+        return 1;
+#endif
+    }
+    
+    shared_ptr<const SeatLayout> layout = make_shared<SeatLayout>(8, 10); // the standard hall
+    if(!layoutPath.empty()) {
+        string error;
+        layout = SeatLayout::load(layoutPath, error);
+        if(!layout) {
+            cerr << "Bad hall layout " << layoutPath << ": " << error << endl;
+            return 1;
+        }
+    }
+    MovieBookingSystem system(layout);
+    if(schedulePath.empty()) {
+        system.addSampleShows();
+    } else if(!system.importSchedule(schedulePath)) {
+        return 1;
+    }
+    if(!receiptsPath.empty() && !system.openReceipts(receiptsPath)) return 1;
+    if(!metricsPath.empty() && !system.openMetrics(metricsPath)) return 1;
+    if(mode == "--batch") {
+        ios::sync_with_stdio(false);
+        if(journalGiven && !system.openJournal(journalPath)) return 1;
+        if(args.size() > 1 && args[1] != "-") {
+            ifstream in(args[1]);
+            if(!in) {
+                cerr << "Cannot open command file: " << args[1] << endl;
+                return 1;
+            }
+            system.runBatch(in, cout);
+        } else {
+            system.runBatch(cin, cout);
+        }
+        return 0;
+    }
+    
+#ifdef __linux__
+    if(mode == "--serve") {
+        if(journalGiven && !system.openJournal(journalPath)) return 1;
+        return system.serve(args.size() > 1 ? atoi(args[1].c_str()) : 9090) ? 0 : 1;
+    }
+#endif
+    
+    // Interactive sessions are always journaled so bookings survive a restart
+    if(!system.openJournal(journalGiven ? journalPath : "cinereserve.journal")) return 1;
     system.run();
     return 0;
 }
\ No newline at end of file